@@ -0,0 +1,502 @@
+#!/usr/bin/env python3
+"""
+Golden-output regression check
+Runs Stage 1-3 on the bundled Data/AC_LGAD_TEST run and compares every
+branch of waveforms.root / waveforms_analyzed.root and every HDF5 dataset
+against the stored reference, plus the per-stage wall time against the
+stored baseline timing.
+
+Each branch (or dataset field) is reduced to its value count, NaN count,
+mean, std, min, max and the means of 16 consecutive blocks of its values,
+plus an order-sensitive signature per event (ac_lgad_test_events.npz), so
+reordered events and swapped channels fail too. Counts must match exactly,
+the other statistics within the per-feature tolerances of tolerances.json.
+
+The check also exports the analysis output with the channels split over two
+sensors, per sensor and combined (--no-split-by-sensor), and requires the
+combined Hits table to hold the per-sensor hits merged by event and sensor.
+
+The reference is blessed from a build of a committed, reviewed state
+(GOLDEN_REF, default HEAD), checked out into a temporary git worktree, so
+uncommitted edits are never blessed. Against a reference blessed from an
+older commit, the intended output changes since that commit listed in
+tolerances.json "accepted_deltas" are reported, not failed.
+
+Usage (from data_converter/, normally through make):
+  make check          # run and compare
+  make check-bless    # build GOLDEN_REF, run it and store its outputs/timings
+  python3 golden/golden_check.py [--bless [--ref COMMIT]] [--no-timing] [--repeat N]
+"""
+
+import argparse
+import fnmatch
+import glob
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+try:
+    import ROOT
+    ROOT.gROOT.SetBatch(True)
+except ImportError:
+    print("ERROR: ROOT Python module not found.", file=sys.stderr)
+    print("Please source ROOT environment before running this script:", file=sys.stderr)
+    print("  source /opt/root/bin/thisroot.sh", file=sys.stderr)
+    sys.exit(1)
+
+try:
+    import h5py
+    import numpy as np
+except ImportError as e:
+    print(f"ERROR: Required Python module not found: {e}", file=sys.stderr)
+    print("Please install: pip install h5py numpy", file=sys.stderr)
+    sys.exit(1)
+
+GOLDEN_DIR = os.path.dirname(os.path.abspath(__file__))
+N_BLOCKS = 16
+COLUMN_BATCH = 64
+MAX_EVENT_BLOCKS = 8192
+GOLDEN_REF = "HEAD"
+BINARIES = ["convert_to_root", "analyze_waveforms", "export_to_hdf5"]
+
+
+def summarize(values):
+    """Reduce a flat array of values to the statistics that are compared."""
+    values = np.asarray(values, dtype=np.float64).ravel()
+    finite = values[np.isfinite(values)]
+    summary = {"n": int(values.size), "nan": int(values.size - finite.size)}
+    if finite.size:
+        summary.update({
+            "mean": float(finite.mean()),
+            "std": float(finite.std()),
+            "min": float(finite.min()),
+            "max": float(finite.max()),
+            "blocks": [float(b.mean()) if b.size else 0.0
+                       for b in np.array_split(finite, N_BLOCKS)],
+        })
+    return summary
+
+
+def event_signatures(values, lengths):
+    """Order-sensitive signature of a column, per event.
+
+    values are the concatenated rows (tree entries or dataset rows) of the
+    column, lengths the number of values in each row. Rows are grouped into
+    at most MAX_EVENT_BLOCKS blocks: one entry per block for the trees and
+    the event-wide datasets, the channels of about one event for the
+    per-channel tables. Each value is weighted by its position in the block;
+    a block holds the weighted sum, the weighted sum of magnitudes (the
+    tolerance scale), the weighted NaN count and the sum of the weights.
+    Returns (rows per block, [blocks x 4] array).
+    """
+    lengths = np.asarray(lengths, dtype=np.int64)
+    rows = lengths.size
+    block_rows = max(1, -(-rows // MAX_EVENT_BLOCKS))
+    n_blocks = -(-rows // block_rows)
+    if n_blocks == 0:
+        return block_rows, np.zeros((0, 4))
+    block_of_value = np.repeat(np.arange(rows) // block_rows, lengths)
+    row_start = np.cumsum(lengths) - lengths
+    block_start = row_start[np.arange(n_blocks) * block_rows]
+    weight = np.arange(values.size) - block_start[block_of_value] + 1.0
+    finite = np.isfinite(values)
+    clean = np.where(finite, values, 0.0)
+    signature = np.zeros((n_blocks, 4))
+    signature[:, 0] = np.bincount(block_of_value, weights=weight * clean, minlength=n_blocks)
+    signature[:, 1] = np.bincount(block_of_value, weights=weight * np.abs(clean), minlength=n_blocks)
+    signature[:, 2] = np.bincount(block_of_value, weights=weight * ~finite, minlength=n_blocks)
+    signature[:, 3] = np.bincount(block_of_value, weights=weight, minlength=n_blocks)
+    return block_rows, signature
+
+
+def add_column(summaries, events, key, values, lengths):
+    summaries[key] = summarize(values)
+    block_rows, events[key] = event_signatures(values, lengths)
+    summaries[key]["event_block_rows"] = block_rows
+
+
+def flatten_column(column):
+    """Concatenate per-entry values (scalars, vectors or arrays) into one
+    array; also returns the number of values of each entry."""
+    if column.dtype != object:
+        return column.astype(np.float64), np.ones(column.size, dtype=np.int64)
+    parts = [np.asarray(v, dtype=np.float64).ravel() for v in column]
+    lengths = np.array([p.size for p in parts], dtype=np.int64)
+    return (np.concatenate(parts) if parts else np.zeros(0)), lengths
+
+
+def summarize_root(path, tree_name, label, summaries, events):
+    rfile = ROOT.TFile.Open(path)
+    if not rfile or rfile.IsZombie():
+        raise RuntimeError(f"cannot open {path}")
+    tree = rfile.Get(tree_name)
+    if not tree:
+        raise RuntimeError(f"tree {tree_name} not found in {path}")
+    names = [b.GetName() for b in tree.GetListOfBranches()]
+    rfile.Close()
+
+    df = ROOT.RDataFrame(tree_name, path)
+    for start in range(0, len(names), COLUMN_BATCH):
+        batch = names[start:start + COLUMN_BATCH]
+        columns = df.AsNumpy(batch)
+        for name in batch:
+            try:
+                values, lengths = flatten_column(columns[name])
+            except (TypeError, ValueError):
+                continue  # non-numeric branch
+            add_column(summaries, events, f"{label}:{name}", values, lengths)
+
+
+def summarize_hdf5(path, label, summaries, events):
+    def add_dataset(key, data):
+        data = np.asarray(data, dtype=np.float64)
+        rows = data.shape[0] if data.ndim else 1
+        per_row = data.size // rows if rows else 0
+        add_column(summaries, events, key, data.ravel(), np.full(rows, per_row, dtype=np.int64))
+
+    def visit(name, obj):
+        if not isinstance(obj, h5py.Dataset):
+            return
+        data = obj[()]
+        if obj.dtype.names:
+            for field in obj.dtype.names:
+                if np.issubdtype(obj.dtype[field].base, np.number) or obj.dtype[field].base == np.bool_:
+                    add_dataset(f"{label}:{name}.{field}", data[field])
+        elif np.issubdtype(obj.dtype, np.number) or obj.dtype == np.bool_:
+            add_dataset(f"{label}:{name}", data)
+
+    with h5py.File(path, "r") as f:
+        f.visititems(visit)
+
+
+def load_json(path):
+    with open(path) as f:
+        return json.load(f)
+
+
+def write_json(path, data):
+    with open(path, "w") as f:
+        json.dump(data, f, indent=1, sort_keys=True)
+        f.write("\n")
+
+
+def run_stage(cmd):
+    """Run one stage, returning its wall time in seconds."""
+    start = time.perf_counter()
+    result = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True)
+    elapsed = time.perf_counter() - start
+    if result.returncode != 0:
+        print(result.stdout)
+        raise RuntimeError(f"stage failed ({result.returncode}): {' '.join(cmd)}")
+    return elapsed
+
+
+def build_reference(ref, worktree):
+    """Check ref out into worktree and build the stage binaries there;
+    returns the directory holding them."""
+    top = subprocess.run(["git", "rev-parse", "--show-toplevel"], stdout=subprocess.PIPE,
+                         text=True, check=True).stdout.strip()
+    subdir = os.path.relpath(os.getcwd(), top)
+    subprocess.run(["git", "worktree", "add", "--detach", worktree, ref], check=True)
+    bin_dir = os.path.join(worktree, subdir)
+    result = subprocess.run(["make", "-C", bin_dir] + BINARIES)
+    if result.returncode != 0:
+        raise RuntimeError(f"build of {ref} failed")
+    return bin_dir
+
+
+def run_pipeline(config_path, base_dir, repeat, bin_dir="."):
+    """Run all stages with the binaries in bin_dir; per-stage time is the
+    minimum over the repeats."""
+    cfg = load_json(config_path)
+    common = cfg["common"]
+    raw_root = common.get("waveforms_root", "waveforms.root")
+    analysis_root = common.get("analysis_root", "waveforms_analyzed.root")
+    raw_tree = common.get("waveforms_tree", "Waveforms")
+    analysis_tree = common.get("analysis_tree", "Analysis")
+
+    stages = [
+        ("stage1", ["./convert_to_root", "--config", config_path, "--root", raw_root]),
+        ("stage2", ["./analyze_waveforms", "--config", config_path,
+                    "--input", raw_root, "--output", analysis_root]),
+        ("stage3_raw", ["./export_to_hdf5", "--mode", "raw", "--input", raw_root,
+                        "--tree", raw_tree, "--output", "waveforms_raw.h5",
+                        "--output-dir", base_dir]),
+        ("stage3_analysis", ["./export_to_hdf5", "--mode", "analysis", "--input", analysis_root,
+                             "--tree", analysis_tree, "--output", "waveforms_analyzed.h5",
+                             "--output-dir", base_dir, "--sensor-mapping", config_path]),
+        ("stage3_corry", ["./export_to_hdf5", "--mode", "corry", "--input", analysis_root,
+                          "--tree", analysis_tree, "--output", "waveforms_corry.h5",
+                          "--output-dir", base_dir, "--sensor-mapping", config_path,
+                          "--column-id", "1"]),
+    ]
+
+    timings = {}
+    for _ in range(repeat):
+        for name, cmd in stages:
+            cmd = [os.path.join(bin_dir, cmd[0])] + cmd[1:]
+            print(f"  {name}: {' '.join(cmd[:3])} ...")
+            elapsed = run_stage(cmd)
+            timings[name] = min(elapsed, timings.get(name, elapsed))
+
+    summaries = {}
+    events = {}
+    summarize_root(os.path.join(base_dir, "root", raw_root), raw_tree, raw_root, summaries, events)
+    summarize_root(os.path.join(base_dir, "root", analysis_root), analysis_tree, analysis_root,
+                   summaries, events)
+    for path in sorted(glob.glob(os.path.join(base_dir, "hdf5", "*.h5"))):
+        summarize_hdf5(path, os.path.basename(path), summaries, events)
+    return summaries, events, timings
+
+
+def check_combined_layout(config_path, base_dir, bin_dir="."):
+    """Multi-DAQ export of the Stage 2 output with the channels split over
+    two sensors, once per sensor and once combined (--no-split-by-sensor).
+    The combined Hits table must hold exactly the rows of the per-sensor
+    files, ordered by event and within an event by sensor. Returns the
+    failures."""
+    cfg = load_json(config_path)
+    sensor_ids = cfg["waveform_analyzer"]["sensor_mapping"]["sensor_ids"]
+    sensors = [1 if ch < len(sensor_ids) // 2 else 2 for ch in range(len(sensor_ids))]
+    cfg["waveform_analyzer"]["sensor_mapping"]["sensor_ids"] = sensors
+    calibration = cfg["common"].get("calibration_file")
+    if calibration:
+        cfg["common"]["calibration_file"] = os.path.abspath(
+            os.path.join(os.path.dirname(config_path), calibration))
+
+    # Outside hdf5/, so these files are not part of the compared outputs
+    out_dir = os.path.join(base_dir, "layout_check")
+    os.makedirs(out_dir, exist_ok=True)
+    layout_config = os.path.join(out_dir, "two_sensor_config.json")
+    write_json(layout_config, cfg)
+    export = [os.path.join(bin_dir, "export_to_hdf5"), "--config", layout_config,
+              "--mode", "analysis", "--output-dir", out_dir, "--output-name", "hits.h5"]
+    print("  layout: per-sensor and combined multi-DAQ export ...")
+    run_stage(export)
+    run_stage(export + ["--no-split-by-sensor"])
+
+    failures = []
+    parts = []
+    for sensor in sorted(set(sensors)):
+        path = os.path.join(out_dir, f"sensor{sensor}_hits.h5")
+        if not os.path.exists(path):
+            failures.append(f"layout: no hits file for sensor {sensor}")
+            continue
+        with h5py.File(path, "r") as f:
+            parts.append((sensor, f["Hits"][()]))
+    with h5py.File(os.path.join(out_dir, "hits.h5"), "r") as f:
+        combined = f["Hits"][()]
+    if failures or not parts:
+        return failures or ["layout: no per-sensor hits files"]
+
+    # Each per-sensor file is ordered by event, column and row
+    rows = np.concatenate([hits for _, hits in parts])
+    order = np.lexsort((np.concatenate([np.arange(hits.size) for _, hits in parts]),
+                        np.concatenate([np.full(hits.size, sensor) for sensor, hits in parts]),
+                        rows["trigger_number"]))
+    expected = rows[order]
+    if combined.size != expected.size:
+        failures.append(f"layout: combined file has {combined.size} hits, "
+                        f"per-sensor files {expected.size}")
+    elif combined.dtype != expected.dtype or combined.tobytes() != expected.tobytes():
+        failures.append("layout: combined Hits differ from the per-sensor hits ordered "
+                        "by event and sensor")
+    print(f"  layout: {combined.size} combined hits, {len(parts)} sensor files")
+    return failures
+
+
+def tolerance_for(key, tolerances):
+    for entry in tolerances["features"]:
+        if fnmatch.fnmatch(key, entry["pattern"]):
+            return entry["abs"], entry["rel"]
+    return 0.0, 0.0
+
+
+def resolve_commit(ref):
+    return subprocess.run(["git", "rev-parse", "--verify", "-q", ref + "^{commit}"],
+                          stdout=subprocess.PIPE, text=True).stdout.strip()
+
+
+def split_accepted(differences, reference, tolerances):
+    """Separate the differences that are intended output changes since the
+    commit the reference was blessed from (tolerances "accepted_deltas")."""
+    source = reference.get("_source", {}).get("commit", "")
+    deltas = [d for d in tolerances.get("accepted_deltas", [])
+              if source and resolve_commit(d["since"]) == source]
+    accepted, failures = [], []
+    for difference in differences:
+        key = difference.split(": ", 1)[0]
+        delta = next((d for d in deltas if fnmatch.fnmatch(key, d["pattern"])), None)
+        if delta:
+            accepted.append(f"{difference} [{delta['request']}: {delta['reason']}]")
+        else:
+            failures.append(difference)
+    return accepted, failures
+
+
+def compare_summaries(reference, current, tolerances):
+    failures = []
+    for key, ref in sorted(reference.items()):
+        if key.startswith("_"):
+            continue  # provenance
+        cur = current.get(key)
+        if cur is None:
+            failures.append(f"{key}: missing from the output")
+            continue
+        for stat in ("n", "nan"):
+            if cur[stat] != ref[stat]:
+                failures.append(f"{key}: {stat} {cur[stat]} != reference {ref[stat]}")
+        abs_tol, rel_tol = tolerance_for(key, tolerances)
+        for stat in ("mean", "std", "min", "max"):
+            if stat not in ref or stat not in cur:
+                continue
+            if abs(cur[stat] - ref[stat]) > abs_tol + rel_tol * abs(ref[stat]):
+                failures.append(f"{key}: {stat} {cur[stat]:.9g} != reference {ref[stat]:.9g}")
+        for i, (c, r) in enumerate(zip(cur.get("blocks", []), ref.get("blocks", []))):
+            if abs(c - r) > abs_tol + rel_tol * abs(r):
+                failures.append(f"{key}: block {i}/{N_BLOCKS} mean {c:.9g} != reference {r:.9g}")
+                break
+    for key in sorted(set(current) - set(reference)):
+        print(f"  WARNING: {key} is not in the reference (not produced by the reference build)")
+    return failures
+
+
+def compare_events(reference, current, summaries, tolerances):
+    """Per-event comparison of the signatures; reports the first differing
+    event block of each column."""
+    failures = []
+    for key in sorted(reference.files):
+        ref = reference[key]
+        cur = current.get(key)
+        if cur is None or cur.shape != ref.shape:
+            continue  # missing columns and count changes fail in compare_summaries
+        abs_tol, rel_tol = tolerance_for(key, tolerances)
+        nan_changed = cur[:, 2].astype(np.float32) != ref[:, 2]  # stored as float32
+        value_changed = np.abs(cur[:, 0] - ref[:, 0]) > abs_tol * ref[:, 3] + rel_tol * ref[:, 1]
+        bad = np.flatnonzero(nan_changed | value_changed)
+        if bad.size:
+            rows = summaries[key]["event_block_rows"]
+            first = int(bad[0]) * rows
+            failures.append(f"{key}: {bad.size} event blocks differ, first at rows "
+                            f"{first}-{first + rows - 1} (values, order or channel assignment)")
+    return failures
+
+
+def compare_timings(reference, current, tolerances):
+    failures = []
+    max_ratio = tolerances["timing"]["max_ratio"]
+    min_seconds = tolerances["timing"]["min_seconds"]
+    for stage, seconds in sorted(current.items()):
+        ref = reference.get("stages", {}).get(stage)
+        if ref is None:
+            continue
+        ratio = seconds / ref if ref > 0 else 1.0
+        print(f"  {stage:16s} {seconds:8.2f} s  (reference {ref:.2f} s, x{ratio:.2f})")
+        # Differences below min_seconds are treated as timing noise
+        if seconds > max_ratio * ref and seconds - ref > min_seconds:
+            failures.append(f"{stage}: {seconds:.2f} s exceeds {max_ratio} x reference {ref:.2f} s")
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Golden-output regression check on Data/AC_LGAD_TEST")
+    parser.add_argument("--config", default=os.path.join(GOLDEN_DIR, "ac_lgad_test_config.json"),
+                        help="Pipeline configuration of the check run")
+    parser.add_argument("--reference", default=os.path.join(GOLDEN_DIR, "ac_lgad_test_reference.json"),
+                        help="Stored output statistics")
+    parser.add_argument("--events", default=os.path.join(GOLDEN_DIR, "ac_lgad_test_events.npz"),
+                        help="Stored per-event signatures")
+    parser.add_argument("--timing", default=os.path.join(GOLDEN_DIR, "ac_lgad_test_timing.json"),
+                        help="Stored per-stage wall times")
+    parser.add_argument("--tolerances", default=os.path.join(GOLDEN_DIR, "tolerances.json"),
+                        help="Per-feature tolerances and the timing gate")
+    parser.add_argument("--bless", action="store_true",
+                        help="Run a build of --ref and store it as the reference and baseline timing")
+    parser.add_argument("--ref", default=GOLDEN_REF,
+                        help="Reviewed commit blessed by --bless (default: %(default)s); it is "
+                             "built in a temporary worktree, uncommitted edits are not blessed")
+    parser.add_argument("--no-timing", action="store_true",
+                        help="Skip the wall-time gate (e.g. on a different machine)")
+    parser.add_argument("--repeat", type=int, default=1,
+                        help="Run the pipeline N times and use the fastest time per stage")
+    args = parser.parse_args()
+
+    cfg = load_json(args.config)
+    common = cfg["common"]
+    run_dir = os.path.join(common["output_dir"], f"{common['runnumber']:06d}")
+    base_dir = os.path.join(run_dir, common["daq_name"], "output")
+    shutil.rmtree(run_dir, ignore_errors=True)
+
+    worktree = None
+    bin_dir = "."
+    commit = None
+    try:
+        if args.bless:
+            commit = resolve_commit(args.ref)
+            if not commit:
+                raise RuntimeError(f"unknown commit {args.ref}")
+            worktree = tempfile.mkdtemp(prefix="golden_ref_")
+            os.rmdir(worktree)
+            print(f"Building reference {args.ref} ({commit}) in {worktree}")
+            bin_dir = build_reference(commit, worktree)
+        print(f"Running pipeline on {cfg['waveform_converter']['input_dir']} -> {base_dir}")
+        summaries, events, timings = run_pipeline(args.config, base_dir, max(1, args.repeat), bin_dir)
+    except (RuntimeError, subprocess.CalledProcessError) as e:
+        print(f"ERROR: {e}", file=sys.stderr)
+        return 1
+    finally:
+        if worktree:
+            subprocess.run(["git", "worktree", "remove", "--force", worktree])
+
+    if args.bless:
+        write_json(args.reference, dict(summaries, _source={"commit": commit}))
+        np.savez_compressed(args.events, **{k: v.astype(np.float32) for k, v in events.items()})
+        write_json(args.timing, {"host": os.uname().nodename, "commit": commit, "stages": timings})
+        print(f"Reference of {commit} written: {args.reference} ({len(summaries)} columns), {args.events}")
+        print(f"Baseline timing written: {args.timing}")
+        return 0
+
+    try:
+        failures = check_combined_layout(args.config, base_dir)
+    except (RuntimeError, OSError, KeyError) as e:
+        failures = [f"layout: {e}"]
+
+    if not os.path.exists(args.reference) or not os.path.exists(args.events):
+        for failure in failures:
+            print(f"  FAIL {failure}")
+        print(f"ERROR: no reference at {args.reference} / {args.events}; run 'make check-bless' "
+              f"(blesses a build of {GOLDEN_REF}) and commit the files", file=sys.stderr)
+        return 1
+
+    tolerances = load_json(args.tolerances)
+    reference = load_json(args.reference)
+    differences = compare_summaries(reference, summaries, tolerances)
+    with np.load(args.events) as reference_events:
+        differences += compare_events(reference_events, events, summaries, tolerances)
+    accepted, differences = split_accepted(differences, reference, tolerances)
+    print(f"Compared {len(summaries)} columns with the reference of "
+          f"{reference.get('_source', {}).get('commit', 'unknown commit')}: "
+          f"{len(differences)} differences, {len(accepted)} accepted")
+    for difference in accepted:
+        print(f"  ACCEPTED {difference}")
+    failures += differences
+
+    if not args.no_timing:
+        if os.path.exists(args.timing):
+            print("Stage wall times:")
+            failures += compare_timings(load_json(args.timing), timings, tolerances)
+        else:
+            print(f"WARNING: no baseline timing at {args.timing}; timing gate skipped")
+
+    for failure in failures:
+        print(f"  FAIL {failure}")
+    print("make check: " + ("FAILED" if failures else "OK"))
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "hdf5.h"
+#include "utils/hdf5_feature_rows.h"
+#include "utils/hdf5_utils.h"
+#include "utils/hdf5_write_queue.h"
+
+// HDF5 output of analyze_waveforms (output_format "hdf5" or "both"): the
+// AnalysisFeatures table of export_to_hdf5 --mode analysis and the Hits
+// table of --mode corry (all channels, no sensor split) in one file, so
+// Python or Corryvreckan consumers do not need the Stage 3 reread.
+//
+// Rows are collected per event and appended in chunk-sized batches to
+// extendible datasets on an Hdf5WriteQueue thread while the event loop
+// continues; all HDF5 calls between Open() and Close() run on that thread.
+class AnalysisHdf5Sink {
+public:
+  explicit AnalysisHdf5Sink(const Hdf5StorageOptions &storage = Hdf5StorageOptions());
+  ~AnalysisHdf5Sink();
+  AnalysisHdf5Sink(const AnalysisHdf5Sink &) = delete;
+  AnalysisHdf5Sink &operator=(const AnalysisHdf5Sink &) = delete;
+
+  // Create the file and its datasets; nChannels rows make up one event.
+  bool Open(const std::string &path, int nChannels);
+  bool IsOpen() const { return file_ >= 0; }
+
+  // Add the feature rows of one event (one per channel) and the hits derived
+  // from them as in export_to_hdf5 --mode corry: DUT timestamps relative to
+  // the 50% CFD fit time of row referenceRow (the sensor-3 channel), DUT hits
+  // dropped when there is no reference (referenceRow < 0).
+  void AddEvent(const std::vector<AnalysisFeatureMeta> &rows, int referenceRow);
+
+  // Write the remaining rows and the file attributes, then close the file.
+  // Returns false (and removes the file) if a write failed.
+  bool Close(const std::string &calibrationVersion);
+
+  size_t FeatureRows() const { return featureRows_; }
+  size_t HitRows() const { return hitRows_; }
+
+private:
+  void FlushFeatures();
+  void FlushHits();
+
+  Hdf5StorageOptions storage_;
+  Hdf5WriteQueue writer_;
+  std::string path_;
+  hid_t file_ = -1;
+  hid_t featureType_ = -1;
+  hid_t hitType_ = -1;
+  hid_t featureSet_ = -1;
+  hid_t hitSet_ = -1;
+  hsize_t featureChunkRows_ = 1;
+  hsize_t hitChunkRows_ = 1;
+  std::vector<AnalysisFeatureMeta> features_;
+  std::vector<HitRow> hits_;
+  size_t featureRows_ = 0;
+  size_t hitRows_ = 0;
+};
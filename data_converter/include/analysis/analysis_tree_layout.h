@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+class TTree;
+
+// Layout of the per-threshold timing quantities in the Analysis tree.
+//   kScalar: one scalar branch per channel and threshold
+//            (ch03_timeCFD_50pc, ch03_jitterLE_20.0mV, ...)
+//   kArray:  one fixed-shape [n_channels][n_thresholds] branch per quantity
+//            (timeCFD[16][4]/F); threshold values are stored in the tree's
+//            UserInfo list so readers can map a threshold to its column.
+enum class TimingBranchLayout { kScalar, kArray };
+
+// Which threshold list a timing quantity is indexed by.
+enum class ThresholdFamily { kCFD, kLE, kCharge };
+
+bool ParseTimingBranchLayout(const std::string &text, TimingBranchLayout &layout);
+const char *TimingBranchLayoutName(TimingBranchLayout layout);
+
+// timeCFD, jitterCFD, timeCFD_Fit -> kCFD; timeLE, jitterLE, totLE -> kLE;
+// timeCharge -> kCharge.
+ThresholdFamily ThresholdFamilyOf(const std::string &quantity);
+
+struct AnalysisTreeLayout {
+  TimingBranchLayout layout = TimingBranchLayout::kScalar;
+  int nChannels = 0;
+  std::vector<int> cfdThresholds;     // percent
+  std::vector<float> leThresholds;    // mV
+  std::vector<int> chargeThresholds;  // percent
+  bool fromMetadata = false;          // false when the tree carries no layout info
+
+  size_t ThresholdCount(ThresholdFamily family) const;
+  // Column of a threshold value within its family, or -1 if not configured.
+  int ThresholdIndex(ThresholdFamily family, double threshold) const;
+};
+
+// Store the layout and threshold lists in tree->GetUserInfo().
+void WriteAnalysisTreeLayout(TTree *tree, const AnalysisTreeLayout &layout);
+
+// Read the layout back from tree->GetUserInfo(). Trees written before the
+// metadata existed are reported as kScalar with empty threshold lists.
+AnalysisTreeLayout ReadAnalysisTreeLayout(TTree *tree, int nChannelsHint);
+
+// Scalar-layout branch name, e.g. ("timeCFD_Fit", 3, kCFD, 50) -> ch03_timeCFD_Fit_50pc
+std::string ScalarTimingBranchName(const std::string &quantity, int channel,
+                                   ThresholdFamily family, double threshold);
+
+// Read only the named branches of `tree` (those a reader bound): every other
+// branch is disabled and a read cache of cacheBytes holds just these, so
+// their baskets are fetched in one request per cluster. Names not in the
+// tree are ignored. Returns the number of branches left enabled.
+int ReadOnlyBranches(TTree *tree, const std::vector<std::string> &names,
+                     long long cacheBytes = 32LL << 20);
+
+// Per-channel view of one timing quantity at one threshold, independent of
+// the branch layout. Bind() sets the branch addresses; after each
+// tree->GetEntry() Value(ch) returns the current entry's value.
+class TimingColumnReader {
+public:
+  bool Bind(TTree *tree, const AnalysisTreeLayout &layout,
+            const std::string &quantity, double threshold);
+
+  bool IsBound() const { return bound_; }
+  bool Has(int channel) const;
+  float Value(int channel) const;
+
+  // Branch names touched by this reader (for branch-selective reading).
+  const std::vector<std::string> &BranchNames() const { return branchNames_; }
+
+private:
+  bool bound_ = false;
+  int stride_ = 1;
+  int column_ = 0;
+  std::vector<float> values_;
+  std::vector<bool> present_;
+  std::vector<std::string> branchNames_;
+};
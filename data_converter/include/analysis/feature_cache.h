@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "analysis/waveform_fit.h"
+#include "analysis/waveform_math.h"
+#include "config/analysis_config.h"
+
+class TFile;
+class TTree;
+
+// Stage 2 features are cached in groups. Each group depends on a fixed set of
+// waveform_analyzer fields (FeatureGroupConfigFields) and on its upstream
+// group, so changing e.g. cfd_thresholds only invalidates kTiming. The
+// waveform groups are the stages of AnalyzeWaveform: after a miss the
+// waveforms are read again and the analysis resumes at the first missing
+// group (ResumeWaveformAnalysis) with the earlier groups taken from the
+// cache; kFitParams is recomputed on its own:
+//
+//   kBaseline   baseline, rmsNoise, noise1Point, ampMinBefore, ampMaxBefore
+//   kPulse      ampMax, peakTime, charge, signalOverNoise       (<- kBaseline)
+//   kTiming     timeCFD/LE/Charge, jitter*, totLE, riseTime,
+//               slewRate, jitterRMS                              (<- kPulse)
+//   kFitParams  pol2/erf fit parameters (FitParams)             (<- kBaseline)
+//
+// hasSignal, the _Fit timing values and the _mV columns are cheap and always
+// recomputed. Fits are cached per channel: channels that newly pass the
+// signal cuts are fitted on the rerun and merged into the existing cache.
+enum class FeatureGroup { kBaseline, kPulse, kTiming, kFitParams };
+
+const char *FeatureGroupName(FeatureGroup group);
+
+// waveform_analyzer / common fields the group's results depend on.
+const std::vector<std::string> &FeatureGroupConfigFields(FeatureGroup group);
+
+class FeatureCache {
+public:
+  FeatureCache();
+  ~FeatureCache();
+  FeatureCache(const FeatureCache &) = delete;
+  FeatureCache &operator=(const FeatureCache &) = delete;
+
+  // Compute the group keys for this input file, entry range and config, open
+  // the cache files that match and prepare writers for the others.
+  bool Open(const AnalysisConfig &cfg,
+            const std::string &cacheDir,
+            const std::string &inputPath,
+            const std::string &inputTree,
+            long long firstEntry,
+            long long endEntry);
+
+  bool Enabled() const { return enabled_; }
+  bool Hit(FeatureGroup group) const;
+  // kBaseline, kPulse and kTiming are all cached: no waveform needs to be
+  // read except to fit channels without cached fit parameters.
+  bool WaveformGroupsHit() const;
+  // Stage the waveform analysis resumes at: the first of kBaseline, kPulse
+  // and kTiming that is not cached (kTiming if all are, kBaseline without a
+  // cache).
+  WaveformStage ResumeStage() const;
+
+  // Per processed entry, in order (index relative to firstEntry).
+  void StartEntry(long long index);
+  bool EntryValid() const;     // false for entries Stage 2 skipped
+  bool ChannelPresent(int channel) const;
+  void GetWaveformFeatures(int channel, WaveformFeatures &features) const;
+  bool GetFitParams(int channel, FitParams &params) const;  // false if never fitted
+
+  void PutWaveformFeatures(int channel, const WaveformFeatures &features);
+  void PutFitParams(int channel, const FitParams &params);
+  void FinishEntry(bool valid);
+
+  // Write the rebuilt groups (only those that changed) and print a summary.
+  bool Commit();
+  // Drop partially written groups (analysis failed).
+  void Abort();
+
+private:
+  struct Group;
+
+  Group &Get(FeatureGroup group);
+  const Group &Get(FeatureGroup group) const;
+  void CloseInputs();
+
+  bool enabled_ = false;
+  int nChannels_ = 0;
+  size_t nCFD_ = 0;
+  size_t nLE_ = 0;
+  size_t nCharge_ = 0;
+  long long nEntries_ = 0;
+  long long newFits_ = 0;
+  bool finished_ = false;
+  std::vector<std::unique_ptr<Group>> groups_;
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "analysis/sensor_layout.h"
+#include "config/analysis_config.h"
+
+// quality_check/<name>.root for the given waveform_plots_dir
+// ("waveform_plots_chunk_0" -> "quality_check_chunk_0").
+std::string QualityCheckFilePath(const AnalysisConfig &cfg, const std::string &outnameBase);
+
+// Start a fresh (empty) quality_check file; later writers add to it.
+bool CreateQualityCheckFile(const std::string &path);
+
+// Run-level QC maps, accumulated in plain per-channel counters during the
+// event loop and turned into histograms once at the end:
+//
+//   qc_events                  TH1D, entries = analysed events
+//   sensorNN_occupancy         TH2F, events with signal per strip
+//   sensorNN_amplitude_sum     TH2F, summed ampMax of those events
+//
+// All three are plain sums, so hadd of chunks or DAQs stays exact; the mean
+// amplitude map is amplitude_sum / occupancy.
+class QualityCheckMaps {
+public:
+  explicit QualityCheckMaps(const SensorLayout &layout);
+
+  void AddEvent(const std::vector<bool> &hasSignal, const std::vector<float> &ampMax);
+
+  // Add the histograms to the file (created if missing).
+  bool Write(const std::string &path) const;
+
+private:
+  const SensorLayout &layout_;
+  long long nEvents_ = 0;
+  std::vector<long long> nSignal_;
+  std::vector<double> sumAmp_;
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+
+#include "config/analysis_config.h"
+
+// Sensor geometry of the configured channels, computed once per run.
+//
+// Each channel sits at (strip, column) of its sensor (sensor_cols holds the
+// strip ID, sensor_rows the column ID). Vertical sensors are drawn with the
+// column on X and the strip on Y, horizontal ones the other way round.
+struct SensorLayout {
+  struct Sensor {
+    int id = 0;
+    bool horizontal = false;
+    int nStrips = 0;  // max strip ID + 1
+    int nColumns = 0; // max column ID + 1
+    std::vector<int> channels;
+  };
+
+  std::vector<Sensor> sensors;  // ordered by sensor ID
+  std::vector<int> sensorIndex; // per channel: index into sensors, -1 if unmapped
+  std::vector<int> strip;       // per channel
+  std::vector<int> column;      // per channel
+  int maxSensorId = 0;
+
+  int NumChannels() const { return static_cast<int>(sensorIndex.size()); }
+  const Sensor *SensorOf(int channel) const;
+  // Map axes of the channel's sensor: (x, y) bin centre coordinates.
+  void MapPosition(int channel, float &x, float &y) const;
+  int MapBinsX(const Sensor &sensor) const;
+  int MapBinsY(const Sensor &sensor) const;
+};
+
+SensorLayout BuildSensorLayout(const AnalysisConfig &cfg);
+
+// True if the sensor's amplitude map is drawn with strips along X.
+bool IsSensorHorizontal(int sensorID, const AnalysisConfig &cfg);
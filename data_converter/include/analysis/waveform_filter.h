@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+
+#include "config/analysis_config.h"
+
+// Optional digital pre-filter of the baseline-corrected waveform, applied
+// before the peak search and the threshold crossings (cfg.prefilter).
+//
+// The kernels work in place and are written as plain loops over contiguous
+// float buffers so the compiler vectorizes them.
+
+// Zero-phase FIR: out[i] = sum_k taps[k] * in[i + k - (nTaps - 1) / 2], with
+// the input held at its first/last sample beyond the edges. Symmetric taps
+// therefore do not shift the timing. scratch holds the padded input.
+void ApplyFirFilter(std::vector<float> &samples,
+                    const std::vector<float> &taps,
+                    std::vector<float> &scratch);
+
+// Biquad IIR, direct form II transposed, zero initial state.
+// coeffs = {b0, b1, b2, a1, a2} with a0 = 1.
+void ApplyBiquadFilter(std::vector<float> &samples,
+                       const std::vector<float> &coeffs);
+
+// True if cfg configures a pre-filter for this channel.
+bool PrefilterApplies(const AnalysisConfig &cfg, int channel);
+
+// Filter the channel's samples as configured. Returns false (samples
+// untouched) if no pre-filter applies to this channel.
+bool ApplyPrefilter(std::vector<float> &samples,
+                    const AnalysisConfig &cfg,
+                    int channel);
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+
+// ── Fit-based feature extraction ─────────────────────────────────────────────
+//
+// Results use polarity-corrected space (peak is always positive) to stay
+// consistent with the existing ampMax / peakTime output branches.
+//
+// DUT0-2:
+//   1. pol2 fit in [peak_time ± 0.4 ns]  → ampMax_Fit, peakTime_Fit
+//   2. erf fit in [t_5%, peak_time]       → timeCFD_Fit, riseTime_Fit, leadingEdge_Fit
+//
+// DUT3 (sensor_id == 3):
+//   1. Data peak → peakTime_Fit (raw sample), amp_ref = data peak amplitude
+//   2. erf fit in [t_5%, t_5% + 5 ns]    → ampMax_Fit (= erf |A|),
+//                                            timeCFD_Fit, riseTime_Fit, leadingEdge_Fit
+//
+// All timing quantities are in ns.  Amplitude is in polarity-corrected ADC units.
+// Failed / skipped values are set to kBad = -999.
+struct FitFeatures {
+    static constexpr float kBad = -999.f;
+    float ampMax_Fit      = kBad;
+    float peakTime_Fit    = kBad;
+    float riseTime_Fit    = kBad;
+    float leadingEdge_Fit = kBad;   // time at 10% of amplitude (LE discriminator)
+    std::vector<float> timeCFD_Fit; // one entry per cfd_thresholds element
+};
+
+// Outcome of the pol2 / erf fits. Everything in FitFeatures follows from these
+// parameters and the configured thresholds, so they are what gets cached.
+struct FitParams {
+    float ampMax_Fit   = FitFeatures::kBad;
+    float peakTime_Fit = FitFeatures::kBad;
+    float erfT0        = FitFeatures::kBad;  // erf midpoint (ns)
+    float erfSigma     = FitFeatures::kBad;  // erf width (ns), kBad if the erf fit failed
+};
+
+// Analytical least-squares pol2 fit (y = a0 + a1·x + a2·x²).
+// Gaussian elimination with partial pivoting. Returns false if system is singular.
+bool FitPol2Analytical(const double* x, const double* y, int n,
+                       double& a0, double& a1, double& a2);
+
+// Run the fits on one ped-subtracted waveform.
+FitParams FitWaveformEdge(const std::vector<float> &amp_raw,
+                          const std::vector<float> &time,
+                          float baseline,
+                          int polarity,
+                          int sensor_id);
+
+// Threshold-dependent quantities from the fit parameters (no refit).
+FitFeatures DeriveFitFeatures(const FitParams &params,
+                              const std::vector<int> &cfd_thresholds,
+                              double rt_low = 0.1,
+                              double rt_high = 0.9);
+
+inline FitFeatures ComputeFitFeatures(
+    const std::vector<float>& amp_raw,      // ped-subtracted ADC (from ch%02d_ped)
+    const std::vector<float>& time,
+    float  baseline,                         // already computed by AnalyzeWaveform
+    int    polarity,                         // cfg.signal_polarity[ch]: +1 or -1
+    int    sensor_id,                        // cfg.sensor_ids[ch]
+    const std::vector<int>& cfd_thresholds, // cfg.cfd_thresholds (in percent)
+    double rt_low  = 0.1,                   // cfg.rise_time_low  (fraction, e.g. 0.4)
+    double rt_high = 0.9)                   // cfg.rise_time_high (fraction, e.g. 0.6)
+{
+    return DeriveFitFeatures(FitWaveformEdge(amp_raw, time, baseline, polarity, sensor_id),
+                             cfd_thresholds, rt_low, rt_high);
+}
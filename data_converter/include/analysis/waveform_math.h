@@ -103,7 +103,45 @@ ThresholdCrossing FindTrailingEdgeForward(const std::vector<float> &amp_corr,
                                           int stop_idx,
                                           float threshold);
 
+// Largest deviation from the baseline in signal direction within the window,
+// from a min/max scan (baseline 0 and polarity 1 for a corrected waveform).
+float MaxDeviationInWindow(const std::vector<float> &amp,
+                           const WindowIndices &window,
+                           float baseline,
+                           int polarity);
+
+// Features of an early-rejected channel: the baseline/noise fields of
+// baselineFeatures, ampMax = maxDeviation, signalOverNoise against
+// timingNoise, hasSignal = false and the "not found" values for all timing
+// fields.
+WaveformFeatures MakeRejectedFeatures(const WaveformFeatures &baselineFeatures,
+                                      float maxDeviation,
+                                      float timingNoise,
+                                      const AnalysisConfig &cfg);
+
+// Signal decision (SNR and amplitude cuts, early reject threshold) from
+// already extracted features, so features replayed from the feature cache
+// get the same decision as a fresh analysis.
+bool PassesSignalCuts(const WaveformFeatures &features,
+                      const AnalysisConfig &cfg,
+                      int channel);
+
 WaveformFeatures AnalyzeWaveform(const std::vector<float> &amp,
                                  const std::vector<float> &time,
                                  const AnalysisConfig &cfg,
                                  int channel);
+
+// Stages of AnalyzeWaveform, in order. Their results are the baseline, pulse
+// and timing groups of the feature cache.
+enum class WaveformStage { kBaseline, kPulse, kTiming };
+
+// AnalyzeWaveform from stage `from` on, taking the features of the earlier
+// stages from `cached` instead of recomputing them. The result equals that
+// of AnalyzeWaveform when `cached` came from it under the same settings of
+// those stages.
+WaveformFeatures ResumeWaveformAnalysis(const std::vector<float> &amp,
+                                        const std::vector<float> &time,
+                                        const AnalysisConfig &cfg,
+                                        int channel,
+                                        const WaveformFeatures &cached,
+                                        WaveformStage from);
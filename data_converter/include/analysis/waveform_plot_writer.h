@@ -0,0 +1,85 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "analysis/sensor_layout.h"
+#include "analysis/waveform_store.h"
+#include "config/analysis_config.h"
+
+class TFile;
+
+// Writes the sampled waveforms on a dedicated thread, either to a compact
+// WaveformStore ("store", the default; plots are drawn later by
+// render_waveforms) or directly as graphs and quality-check canvases
+// ("graphs"). In graphs mode the per-event quality-check canvases are added
+// to the quality_check file only for every quality_check_event_every_n-th
+// event; the run-level maps come from QualityCheckMaps.
+//
+// The analysis loop hands over EventPlotRecords through a bounded queue; all
+// ROOT object construction, directory handling, serialization and the 4 GB
+// plots-file rotation happen on the writer thread. When the queue is full, Push()
+// waits until the writer has caught up (back-pressure), so memory stays bounded
+// at waveform_plots_queue_depth events.
+class WaveformPlotWriter {
+public:
+  WaveformPlotWriter(const AnalysisConfig &cfg, const std::string &outnameBase);
+  ~WaveformPlotWriter();
+  WaveformPlotWriter(const WaveformPlotWriter &) = delete;
+  WaveformPlotWriter &operator=(const WaveformPlotWriter &) = delete;
+
+  // Open the output files and start the writer thread. Returns false if
+  // nothing could be opened (plots are then silently skipped).
+  bool Start();
+  bool Enabled() const { return running_; }
+
+  // Write the per-event quality-check canvases to a new file at path instead
+  // of adding them to the Stage 2 quality_check file (call before Start()).
+  void SetQualityCheckFile(const std::string &path) { qualityCheckPath_ = path; }
+
+  // Sampling: every waveform_plots_every_n-th processed event.
+  bool SampleEvent(long long index) const;
+  // Channel and event filters applied to a sampled event.
+  bool WantsChannel(const WaveformFeatures &features) const;
+  bool WantsEvent(const EventPlotRecord &record) const;
+
+  void Push(EventPlotRecord &&record);
+
+  // Drain the queue, stop the thread and close the files.
+  void Finish();
+
+private:
+  void Run();
+  bool OpenPlotsFile(int fileNum);
+  bool OpenQualityCheckFile();
+  void RotatePlotsFileIfNeeded();
+  bool OpenStore();
+  void Write(const EventPlotRecord &record);
+
+  const AnalysisConfig &cfg_;
+  std::string outnameBase_;
+  std::string qualityCheckPath_;
+  SensorLayout layout_;
+
+  bool storeOutput_ = true;
+  WaveformStoreWriter store_;
+  TFile *plotsFile_ = nullptr;
+  TFile *qualityCheckFile_ = nullptr;
+  int plotsFileCounter_ = 0;
+
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable notEmpty_;
+  std::condition_variable notFull_;
+  std::deque<EventPlotRecord> queue_;
+  size_t capacity_ = 1;
+  bool running_ = false;
+  bool stopping_ = false;
+
+  long long eventsWritten_ = 0;
+  long long pushStalls_ = 0;  // Push() calls that had to wait for space
+};
@@ -3,6 +3,7 @@
 #include <vector>
 
 #include "config/analysis_config.h"
+#include "analysis/sensor_layout.h"
 #include "analysis/waveform_math.h"
 
 class TFile;
@@ -12,3 +13,10 @@ void SaveWaveformPlots(TFile *waveformPlotsFile, int event, int channel,
                        const std::vector<float> &time,
                        const WaveformFeatures &features,
                        const AnalysisConfig &cfg);
+
+// Per-event sensor amplitude maps: one TH2F per sensor under
+// event_NNNNNN/sensorNN in waveformPlotsFile, and one canvas with all sensors
+// in qualityCheckFile. Either file may be null.
+void SaveEventAmplitudeMaps(TFile *waveformPlotsFile, TFile *qualityCheckFile,
+                            int event, const std::vector<float> &ampMax,
+                            const SensorLayout &layout);
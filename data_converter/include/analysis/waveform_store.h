@@ -0,0 +1,88 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "analysis/waveform_math.h"
+
+class TFile;
+class TTree;
+
+// One channel to draw: the (untrimmed) waveform and its features.
+struct ChannelPlotRecord {
+  int channel = 0;
+  std::vector<float> amp;
+  std::vector<float> time;
+  WaveformFeatures features;
+};
+
+// Everything needed to draw one event, copied out of the analysis loop.
+struct EventPlotRecord {
+  int event = 0;
+  std::vector<float> ampMax;  // per channel, for the sensor amplitude maps
+  std::vector<ChannelPlotRecord> channels;
+};
+
+// Compact store of the sampled waveforms (TTree "WaveformStore"), written by
+// Stage 2 instead of pre-rendered graphs and turned into plots on demand by
+// render_waveforms. One entry per stored event, indexed by "event":
+//
+//   event                 int
+//   eventAmpMax           float[n_channels]    all channels (amplitude maps)
+//   channel               int[nStored]         stored channels
+//   nSamples              int[nStored]         samples per stored channel
+//   time                  float[nTime]         event time axis (shared)
+//   amp                   float[sum nSamples]  ped-subtracted samples, concatenated
+//   hasSignal             char[nStored]
+//   baseline, rmsNoise, ampMax, peakTime, riseTime, charge,
+//   signalOverNoise       float[nStored]
+//   timeCFD, timeLE, timeCharge
+//                         float[nStored * nThr] channel-major
+class WaveformStoreWriter {
+public:
+  WaveformStoreWriter();
+  ~WaveformStoreWriter();
+  WaveformStoreWriter(const WaveformStoreWriter &) = delete;
+  WaveformStoreWriter &operator=(const WaveformStoreWriter &) = delete;
+
+  bool Open(const std::string &path);
+  void Fill(const EventPlotRecord &record);
+  // Build the event index, write the tree and close the file.
+  void Close();
+
+  bool IsOpen() const { return file_ != nullptr; }
+  const std::string &Path() const { return path_; }
+  long long Entries() const { return entries_; }
+
+private:
+  struct Columns;
+
+  TFile *file_ = nullptr;
+  TTree *tree_ = nullptr;
+  std::string path_;
+  long long entries_ = 0;
+  std::unique_ptr<Columns> columns_;
+};
+
+class WaveformStoreReader {
+public:
+  WaveformStoreReader();
+  ~WaveformStoreReader();
+  WaveformStoreReader(const WaveformStoreReader &) = delete;
+  WaveformStoreReader &operator=(const WaveformStoreReader &) = delete;
+
+  bool Open(const std::string &path);
+  long long Entries() const;
+  // Entry of an event through the tree's event index, -1 if not stored.
+  long long EntryOf(int event) const;
+  bool Read(long long entry, EventPlotRecord &record);
+  void Close();
+
+private:
+  struct Columns;
+
+  TFile *file_ = nullptr;
+  TTree *tree_ = nullptr;
+  std::unique_ptr<Columns> columns_;
+};
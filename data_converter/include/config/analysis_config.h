@@ -69,13 +69,70 @@ struct AnalysisConfig {
   // Signal quality cuts (per channel)
   std::vector<float> cut_amp_max;
 
+  // Early reject (ADC counts, 0 = off): channels whose baseline-corrected,
+  // pre-filtered waveform stays below this value in the signal window skip
+  // the charge/timing analysis and keep only baseline/noise features
+  float early_reject_threshold = 0.0f;
+
   // Impedance for charge calculation (Ohms)
   float impedance = 50.0f;
 
+  // Pre-filter of the baseline-corrected waveform before the peak search and
+  // timing (analysis/waveform_filter.h)
+  //   "none"
+  //   "fir":    prefilter_fir_taps, applied zero-phase (centred on the middle tap)
+  //   "biquad": prefilter_biquad = {b0, b1, b2, a1, a2}
+  // SNR cut and jitters then use the noise of the filtered baseline region.
+  std::string prefilter = "none";
+  std::vector<float> prefilter_fir_taps;
+  std::vector<float> prefilter_biquad;
+  std::vector<int> prefilter_channels;  // per channel: 1 = filter, 0 = leave raw
+
+  // Layout of the per-threshold timing branches in the output tree:
+  // "scalar" (chXX_timeCFD_50pc, ...) or "array" (timeCFD[n_channels][nCFD])
+  std::string timing_branch_layout = "scalar";
+
+  // ADC-to-mV calibration of the _mV branches (table: common.calibration_file)
+  //   "inline":   compute the _mV branches in Stage 2
+  //   "deferred": persist raw-unit features only; export_to_hdf5 applies the
+  //               calibration table at export time
+  std::string calibration_mode = "inline";
+
+  // Feature output: "root" (Analysis tree, exported by export_to_hdf5),
+  // "hdf5" (AnalysisFeatures and Hits tables written during the event loop
+  // to output/hdf5/<analysis_root stem>.h5) or "both"
+  std::string output_format = "root";
+
+  // Feature-level cache for incremental reanalysis (analysis/feature_cache.h).
+  // Each feature group is stored under a key built from the input file and
+  // the config fields it depends on; unchanged groups are reused on reruns.
+  bool feature_cache_enabled = false;
+  std::string feature_cache_dir;  // default: <output_dir>/<run>/<daq>/output/cache
+
+  // Upper bound on the input TTreeCache per process (MB). The cache is sized to
+  // the compressed size of the branches actually read over the event range.
+  int io_memory_budget_mb = 256;
+  // Input decompression threads (0 = inline in GetEntry). With N > 0 ROOT's
+  // implicit MT and TTreeCacheUnzip decompress the baskets of the cached
+  // cluster in parallel while the current entries are analysed.
+  int io_unzip_threads = 0;
+  // Read the next cache block in the background (TFile.AsyncPrefetching)
+  bool io_async_prefetch = false;
+
   // Waveform plots output options
   bool waveform_plots_enabled = false;
   std::string waveform_plots_dir = "waveform_plots";
   bool waveform_plots_only_signal = true;  // Only save waveforms with detected signal
+  // Plots are written by a separate thread (analysis/waveform_plot_writer.h)
+  //   "store":  compact waveform+feature TTree, rendered later by render_waveforms
+  //   "graphs": TGraph/TCanvas plots and quality-check canvases written directly
+  std::string waveform_plots_format = "store";
+  int waveform_plots_every_n = 1;                  // plot every Nth processed event
+  bool waveform_plots_signal_events_only = false;  // skip events without any signal channel
+  int waveform_plots_queue_depth = 32;             // events buffered before analysis waits
+  // quality_check/*.root holds run-level occupancy/amplitude maps; per-event
+  // canvases are added for every Nth event number (0 = none)
+  int quality_check_event_every_n = 0;
 
   // Sensor mapping (per channel)
   std::vector<int> sensor_ids;  // Which sensor each channel belongs to
@@ -95,6 +152,7 @@ struct AnalysisConfig {
     charge_region_min.assign(common.n_channels, 0.0f);
     charge_region_max.assign(common.n_channels, 200.0f);
     cut_amp_max.assign(common.n_channels, 1.0f);
+    prefilter_channels.assign(common.n_channels, 1);
     signal_polarity.assign(common.n_channels, 1);  // Default: positive signals
 
     // Default sensor mapping: ch0-7 = sensor 1, ch8-15 = sensor 2
@@ -163,6 +221,9 @@ inline bool LoadAnalysisConfigFromJson(const std::string &path,
     if (GetString(common, "analysis_tree", strValue)) {
       cfg.common.analysis_tree = strValue;
     }
+    if (GetString(common, "calibration_file", strValue)) {
+      cfg.common.calibration_file = ResolvePathRelativeTo(path, strValue);
+    }
   }
 
   simdjson::dom::element waveformAnalyzer;
@@ -179,9 +240,27 @@ inline bool LoadAnalysisConfigFromJson(const std::string &path,
     if (GetNumber(waveformAnalyzer, "impedance", numValue)) {
       cfg.impedance = static_cast<float>(numValue);
     }
+    if (GetNumber(waveformAnalyzer, "early_reject_threshold", numValue)) {
+      cfg.early_reject_threshold = static_cast<float>(numValue);
+    }
     if (GetNumber(waveformAnalyzer, "snr_threshold", numValue)) {
       cfg.snr_threshold = static_cast<float>(numValue);
     }
+    if (GetNumber(waveformAnalyzer, "waveform_plots_every_n", numValue)) {
+      cfg.waveform_plots_every_n = static_cast<int>(numValue);
+    }
+    if (GetNumber(waveformAnalyzer, "quality_check_event_every_n", numValue)) {
+      cfg.quality_check_event_every_n = static_cast<int>(numValue);
+    }
+    if (GetNumber(waveformAnalyzer, "waveform_plots_queue_depth", numValue)) {
+      cfg.waveform_plots_queue_depth = static_cast<int>(numValue);
+    }
+    if (GetNumber(waveformAnalyzer, "io_memory_budget_mb", numValue)) {
+      cfg.io_memory_budget_mb = static_cast<int>(numValue);
+    }
+    if (GetNumber(waveformAnalyzer, "io_unzip_threads", numValue)) {
+      cfg.io_unzip_threads = static_cast<int>(numValue);
+    }
 
     GetFloatArray(waveformAnalyzer, "analysis_region_min", cfg.analysis_region_min);
     GetFloatArray(waveformAnalyzer, "analysis_region_max", cfg.analysis_region_max);
@@ -193,10 +272,13 @@ inline bool LoadAnalysisConfigFromJson(const std::string &path,
     GetFloatArray(waveformAnalyzer, "charge_region_max", cfg.charge_region_max);
     GetFloatArray(waveformAnalyzer, "cut_amp_max", cfg.cut_amp_max);
     GetFloatArray(waveformAnalyzer, "le_thresholds", cfg.le_thresholds);
+    GetFloatArray(waveformAnalyzer, "prefilter_fir_taps", cfg.prefilter_fir_taps);
+    GetFloatArray(waveformAnalyzer, "prefilter_biquad", cfg.prefilter_biquad);
 
     GetIntArray(waveformAnalyzer, "cfd_thresholds", cfg.cfd_thresholds);
     GetIntArray(waveformAnalyzer, "charge_thresholds", cfg.charge_thresholds);
     GetIntArray(waveformAnalyzer, "signal_polarity", cfg.signal_polarity);
+    GetIntArray(waveformAnalyzer, "prefilter_channels", cfg.prefilter_channels);
 
     bool boolValue = false;
     if (GetBool(waveformAnalyzer, "waveform_plots_enabled", boolValue)) {
@@ -205,10 +287,37 @@ inline bool LoadAnalysisConfigFromJson(const std::string &path,
     if (GetBool(waveformAnalyzer, "waveform_plots_only_signal", boolValue)) {
       cfg.waveform_plots_only_signal = boolValue;
     }
+    if (GetBool(waveformAnalyzer, "waveform_plots_signal_events_only", boolValue)) {
+      cfg.waveform_plots_signal_events_only = boolValue;
+    }
+    if (GetBool(waveformAnalyzer, "io_async_prefetch", boolValue)) {
+      cfg.io_async_prefetch = boolValue;
+    }
+    if (GetBool(waveformAnalyzer, "feature_cache", boolValue)) {
+      cfg.feature_cache_enabled = boolValue;
+    }
 
     if (GetString(waveformAnalyzer, "waveform_plots_dir", strValue)) {
       cfg.waveform_plots_dir = strValue;
     }
+    if (GetString(waveformAnalyzer, "waveform_plots_format", strValue)) {
+      cfg.waveform_plots_format = strValue;
+    }
+    if (GetString(waveformAnalyzer, "timing_branch_layout", strValue)) {
+      cfg.timing_branch_layout = strValue;
+    }
+    if (GetString(waveformAnalyzer, "calibration_mode", strValue)) {
+      cfg.calibration_mode = strValue;
+    }
+    if (GetString(waveformAnalyzer, "output_format", strValue)) {
+      cfg.output_format = strValue;
+    }
+    if (GetString(waveformAnalyzer, "feature_cache_dir", strValue)) {
+      cfg.feature_cache_dir = strValue;
+    }
+    if (GetString(waveformAnalyzer, "prefilter", strValue)) {
+      cfg.prefilter = strValue;
+    }
 
     simdjson::dom::element sensorSection;
     if (GetObject(waveformAnalyzer, "sensor_mapping", sensorSection)) {
@@ -263,6 +372,25 @@ inline bool LoadAnalysisConfigFromJson(const std::string &path,
   if (cfg.signal_polarity.size() < static_cast<size_t>(cfg.common.n_channels)) {
     cfg.signal_polarity.resize(cfg.common.n_channels, 1);
   }
+  if (cfg.prefilter_channels.size() < static_cast<size_t>(cfg.common.n_channels)) {
+    cfg.prefilter_channels.resize(cfg.common.n_channels, 1);
+  }
+
+  std::transform(cfg.prefilter.begin(), cfg.prefilter.end(), cfg.prefilter.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  if (cfg.prefilter == "fir" && cfg.prefilter_fir_taps.empty()) {
+    std::cerr << "WARNING: prefilter 'fir' without prefilter_fir_taps, pre-filter disabled"
+              << std::endl;
+    cfg.prefilter = "none";
+  } else if (cfg.prefilter == "biquad" && cfg.prefilter_biquad.size() != 5) {
+    std::cerr << "WARNING: prefilter_biquad needs 5 coefficients {b0, b1, b2, a1, a2}, "
+              << "pre-filter disabled" << std::endl;
+    cfg.prefilter = "none";
+  } else if (cfg.prefilter != "none" && cfg.prefilter != "fir" && cfg.prefilter != "biquad") {
+    std::cerr << "WARNING: unknown prefilter '" << cfg.prefilter << "', pre-filter disabled"
+              << std::endl;
+    cfg.prefilter = "none";
+  }
 
   // Ensure sensor mapping vectors have correct size
   if (cfg.sensor_ids.size() < static_cast<size_t>(cfg.common.n_channels)) {
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "utils/json_utils.h"
+
+// Lightweight linear calibration: mv = offset + slope * adc
+// Matches the interface of TF1::Eval() used in QuickCheckHitMapDUT.C.
+struct CalibPol1 {
+  float offset = 0.f;
+  float slope  = 0.f;
+  bool  valid  = false;
+  float Eval(float adc) const { return offset + slope * adc; }
+};
+
+// Versioned ADC-to-mV calibration table loaded from JSON
+// (see calibration/adc_to_mv_pol1_v1.json). Channels without an entry are
+// reported as invalid, i.e. uncalibrated.
+struct CalibrationTable {
+  std::string version;
+  std::map<std::string, std::vector<CalibPol1>> daqs;  // daq_name -> per-channel entries
+
+  // Per-channel calibration for one DAQ, padded with invalid entries to nChannels.
+  std::vector<CalibPol1> ChannelsFor(const std::string &daqName, int nChannels) const {
+    std::vector<CalibPol1> channels(nChannels > 0 ? nChannels : 0);
+    auto it = daqs.find(daqName);
+    if (it != daqs.end()) {
+      for (size_t ch = 0; ch < channels.size() && ch < it->second.size(); ++ch) {
+        channels[ch] = it->second[ch];
+      }
+    }
+    return channels;
+  }
+};
+
+inline bool LoadCalibrationTableFromJson(const std::string &path,
+                                         CalibrationTable &table,
+                                         std::string *errorMessage = nullptr) {
+  simdjson::dom::parser parser;
+  simdjson::dom::element root;
+  if (!ParseJsonFile(path, parser, root, errorMessage)) {
+    return false;
+  }
+
+  table = CalibrationTable();
+  if (!GetString(root, "version", table.version) || table.version.empty()) {
+    if (errorMessage) {
+      *errorMessage = "calibration table has no version: " + path;
+    }
+    return false;
+  }
+
+  simdjson::dom::object daqs;
+  if (root["daqs"].get(daqs) != simdjson::SUCCESS) {
+    if (errorMessage) {
+      *errorMessage = "calibration table has no daqs section: " + path;
+    }
+    return false;
+  }
+
+  for (auto field : daqs) {
+    std::vector<float> offsets;
+    std::vector<float> slopes;
+    GetFloatArray(field.value, "offset", offsets);
+    GetFloatArray(field.value, "slope", slopes);
+    if (offsets.size() != slopes.size()) {
+      if (errorMessage) {
+        *errorMessage = "offset/slope length mismatch for " + std::string(field.key) +
+                        " in " + path;
+      }
+      return false;
+    }
+    std::vector<CalibPol1> &channels = table.daqs[std::string(field.key)];
+    channels.resize(slopes.size());
+    for (size_t ch = 0; ch < slopes.size(); ++ch) {
+      channels[ch].offset = offsets[ch];
+      channels[ch].slope = slopes[ch];
+      channels[ch].valid = true;
+    }
+  }
+  return true;
+}
+
+// Fit outputs use this marker for failed / skipped fits.
+constexpr float kCalibFitBad = -999.f;
+
+// How each _mV quantity is derived from its raw-unit counterpart. The rules
+// reproduce the conventions the inline Stage 2 calibration has always used.
+enum class CalibRule {
+  kScaleOrRaw,      // slope * x, uncalibrated channels keep x     (rmsNoise, slewRate)
+  kScaleOrZero,     // slope * x, uncalibrated channels give 0     (charge)
+  kEvalPositive,    // offset + slope * x for x > 0, otherwise 0   (ampMax)
+  kFitScaleOrZero,  // slope * x, 0 for failed fits / uncalibrated (ampMax_Fit)
+  kFitScaleOrRaw    // slope * x (x if uncalibrated), 0 for failed fits (slewRate_Fit)
+};
+
+// Convert one per-channel column in a single pass.
+inline void ApplyCalibration(CalibRule rule,
+                             const std::vector<float> &raw,
+                             const std::vector<CalibPol1> &channels,
+                             std::vector<float> &mv) {
+  const size_t n = raw.size();
+  mv.resize(n);
+  for (size_t ch = 0; ch < n; ++ch) {
+    const float x = raw[ch];
+    const bool valid = ch < channels.size() && channels[ch].valid;
+    const float slope = valid ? channels[ch].slope : 1.f;
+    const float offset = valid ? channels[ch].offset : 0.f;
+    switch (rule) {
+    case CalibRule::kScaleOrRaw:
+      mv[ch] = slope * x;
+      break;
+    case CalibRule::kScaleOrZero:
+      mv[ch] = valid ? slope * x : 0.f;
+      break;
+    case CalibRule::kEvalPositive:
+      mv[ch] = (valid && x > 0.f) ? offset + slope * x : 0.f;
+      break;
+    case CalibRule::kFitScaleOrZero:
+      mv[ch] = (valid && x != kCalibFitBad) ? slope * x : 0.f;
+      break;
+    case CalibRule::kFitScaleOrRaw:
+      mv[ch] = (x != kCalibFitBad) ? slope * x : 0.f;
+      break;
+    }
+  }
+}
@@ -21,4 +21,7 @@ struct CommonConfig {
   // Handling for events where channels have different sample counts.
   // Supported values: "strict" (fail on mismatch), "pad" (pad to max samples).
   std::string nsamples_policy = "strict";
+  // Versioned ADC-to-mV calibration table (JSON). Relative paths are resolved
+  // against the directory of the config file that sets them.
+  std::string calibration_file;
 };
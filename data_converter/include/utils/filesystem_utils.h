@@ -37,6 +37,15 @@ inline bool CreateDirectoryIfNeeded(const std::string &path) {
   return true;
 }
 
+// Size of a file in bytes, 0 if it does not exist.
+inline long long FileSizeBytes(const std::string &path) {
+  struct stat info;
+  if (stat(path.c_str(), &info) != 0) {
+    return 0;
+  }
+  return static_cast<long long>(info.st_size);
+}
+
 // Build path: output_dir/subdir/filename (handles absolute filename and ".").
 inline std::string BuildOutputPath(const std::string &output_dir,
                                    const std::string &subdir,
@@ -60,6 +69,20 @@ inline std::string BuildOutputPath(const std::string &output_dir,
   return path;
 }
 
+// Resolve a path relative to the directory containing baseFile
+// (absolute paths and bare baseFile names are returned unchanged).
+inline std::string ResolvePathRelativeTo(const std::string &baseFile,
+                                         const std::string &path) {
+  if (path.empty() || path[0] == '/') {
+    return path;
+  }
+  size_t lastSlash = baseFile.find_last_of('/');
+  if (lastSlash == std::string::npos) {
+    return path;
+  }
+  return baseFile.substr(0, lastSlash + 1) + path;
+}
+
 // Backward-compatible alias for BuildOutputPath used in export stage.
 inline std::string BuildPath(const std::string &output_dir,
                              const std::string &subdir,
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "hdf5.h"
+#include "utils/hdf5_utils.h"
+#include "utils/hdf5_write_queue.h"
+
+// Filters of a chunk encoded outside the HDF5 library: byte shuffle and
+// deflate as set by ApplyHdf5Compression, or none. The lz4/zstd plugins are
+// only reachable through the library's filter pipeline.
+inline bool ChunksEncodable(const Hdf5StorageOptions &options) {
+  return options.compression == "none" || options.compression == "deflate";
+}
+
+// Encode nElements records of elementSize bytes exactly as the dataset's
+// filter pipeline would, for H5Dwrite_chunk. Returns false on a zlib error.
+bool EncodeHdf5Chunk(const unsigned char *data,
+                     size_t elementSize,
+                     size_t nElements,
+                     const Hdf5StorageOptions &options,
+                     std::vector<unsigned char> &encoded);
+
+// Encodes whole chunks of 1-D chunked datasets on worker threads, so the
+// compression of several datasets (e.g. one Hits file per sensor) runs in
+// parallel, and hands each encoded chunk to the Hdf5WriteQueue, which
+// stores it with H5Dwrite_chunk and grows the dataset to cover it. The
+// HDF5 library itself is only called from the writer thread.
+//
+// Submit() waits while 2 x threads chunks are pending (back-pressure).
+class Hdf5ChunkEncoder {
+public:
+  Hdf5ChunkEncoder(size_t threads, Hdf5WriteQueue &writer, const Hdf5StorageOptions &options);
+  ~Hdf5ChunkEncoder();
+  Hdf5ChunkEncoder(const Hdf5ChunkEncoder &) = delete;
+  Hdf5ChunkEncoder &operator=(const Hdf5ChunkEncoder &) = delete;
+
+  void Start();
+
+  // Queue chunk `chunkIndex` of *dset (created on the writer thread, read
+  // there when the write runs). rows holds `validRows` records of rowBytes,
+  // zero padded to the full chunk of chunkRows records.
+  void Submit(const hid_t *dset, hsize_t chunkIndex, hsize_t chunkRows, hsize_t validRows,
+              size_t rowBytes, std::vector<unsigned char> rows);
+
+  // Encode the pending chunks and queue their writes. Returns false if an
+  // encoding failed.
+  bool Finish();
+
+private:
+  void Run();
+
+  Hdf5WriteQueue &writer_;
+  Hdf5StorageOptions options_;
+  size_t nThreads_ = 1;
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable notEmpty_;
+  std::condition_variable notFull_;
+  std::deque<std::function<bool()>> queue_;
+  bool running_ = false;
+  bool stopping_ = false;
+  bool failed_ = false;
+};
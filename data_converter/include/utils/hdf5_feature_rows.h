@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+#include "hdf5.h"
+
+// Records of the AnalysisFeatures and Hits tables, shared by export_to_hdf5
+// (--mode analysis / corry) and the HDF5 output of analyze_waveforms so both
+// write the same file layout.
+
+#pragma pack(push, 1)
+struct AnalysisFeatureMeta {
+  uint32_t event;
+  uint16_t channel;
+  uint16_t sensor_id;
+  uint16_t column_id;
+  uint16_t strip_id;
+  float baseline;
+  float rmsNoise;
+  float rmsNoise_mV;
+  float noise1Point;
+  float ampMinBefore;
+  float ampMaxBefore;
+  float ampMax;
+  float ampMax_Fit_mV;
+  float charge;
+  float signalOverNoise;
+  float peakTime;
+  float riseTime;
+  float riseTime_Fit;
+  float slewRate;
+  float slewRate_Fit_mV;
+  float timeCFD_50pc;
+  float timeCFD_Fit_50pc;
+};
+
+// Corryvreckan hit record
+struct HitRow {
+  uint16_t column;
+  uint16_t row;
+  uint8_t raw;
+  double charge;
+  double timestamp;
+  uint32_t trigger_number;
+};
+#pragma pack(pop)
+
+inline hid_t CreateAnalysisFeatureType() {
+  hid_t type = H5Tcreate(H5T_COMPOUND, sizeof(AnalysisFeatureMeta));
+  H5Tinsert(type, "event", HOFFSET(AnalysisFeatureMeta, event), H5T_NATIVE_UINT32);
+  H5Tinsert(type, "channel", HOFFSET(AnalysisFeatureMeta, channel), H5T_NATIVE_UINT16);
+  H5Tinsert(type, "sensor_id", HOFFSET(AnalysisFeatureMeta, sensor_id), H5T_NATIVE_UINT16);
+  H5Tinsert(type, "column_id", HOFFSET(AnalysisFeatureMeta, column_id), H5T_NATIVE_UINT16);
+  H5Tinsert(type, "strip_id", HOFFSET(AnalysisFeatureMeta, strip_id), H5T_NATIVE_UINT16);
+  H5Tinsert(type, "baseline",         HOFFSET(AnalysisFeatureMeta, baseline),         H5T_NATIVE_FLOAT);
+  H5Tinsert(type, "rmsNoise",         HOFFSET(AnalysisFeatureMeta, rmsNoise),         H5T_NATIVE_FLOAT);
+  H5Tinsert(type, "rmsNoise_mV",      HOFFSET(AnalysisFeatureMeta, rmsNoise_mV),      H5T_NATIVE_FLOAT);
+  H5Tinsert(type, "noise1Point",      HOFFSET(AnalysisFeatureMeta, noise1Point),      H5T_NATIVE_FLOAT);
+  H5Tinsert(type, "ampMinBefore",     HOFFSET(AnalysisFeatureMeta, ampMinBefore),     H5T_NATIVE_FLOAT);
+  H5Tinsert(type, "ampMaxBefore",     HOFFSET(AnalysisFeatureMeta, ampMaxBefore),     H5T_NATIVE_FLOAT);
+  H5Tinsert(type, "ampMax_mV",        HOFFSET(AnalysisFeatureMeta, ampMax),           H5T_NATIVE_FLOAT);
+  H5Tinsert(type, "ampMax_Fit_mV",    HOFFSET(AnalysisFeatureMeta, ampMax_Fit_mV),    H5T_NATIVE_FLOAT);
+  H5Tinsert(type, "charge",           HOFFSET(AnalysisFeatureMeta, charge),           H5T_NATIVE_FLOAT);
+  H5Tinsert(type, "signalOverNoise",  HOFFSET(AnalysisFeatureMeta, signalOverNoise),  H5T_NATIVE_FLOAT);
+  H5Tinsert(type, "peakTime",         HOFFSET(AnalysisFeatureMeta, peakTime),         H5T_NATIVE_FLOAT);
+  H5Tinsert(type, "riseTime",         HOFFSET(AnalysisFeatureMeta, riseTime),         H5T_NATIVE_FLOAT);
+  H5Tinsert(type, "riseTime_Fit",     HOFFSET(AnalysisFeatureMeta, riseTime_Fit),     H5T_NATIVE_FLOAT);
+  H5Tinsert(type, "slewRate",         HOFFSET(AnalysisFeatureMeta, slewRate),         H5T_NATIVE_FLOAT);
+  H5Tinsert(type, "slewRate_Fit_mV",  HOFFSET(AnalysisFeatureMeta, slewRate_Fit_mV),  H5T_NATIVE_FLOAT);
+  H5Tinsert(type, "timeCFD_50pc",     HOFFSET(AnalysisFeatureMeta, timeCFD_50pc),     H5T_NATIVE_FLOAT);
+  H5Tinsert(type, "timeCFD_Fit_50pc", HOFFSET(AnalysisFeatureMeta, timeCFD_Fit_50pc), H5T_NATIVE_FLOAT);
+  return type;
+}
+
+inline hid_t CreateHitRowType() {
+  hid_t type = H5Tcreate(H5T_COMPOUND, sizeof(HitRow));
+  H5Tinsert(type, "column", HOFFSET(HitRow, column), H5T_NATIVE_UINT16);
+  H5Tinsert(type, "row", HOFFSET(HitRow, row), H5T_NATIVE_UINT16);
+  H5Tinsert(type, "raw", HOFFSET(HitRow, raw), H5T_NATIVE_UINT8);
+  H5Tinsert(type, "charge", HOFFSET(HitRow, charge), H5T_NATIVE_DOUBLE);
+  H5Tinsert(type, "timestamp", HOFFSET(HitRow, timestamp), H5T_NATIVE_DOUBLE);
+  H5Tinsert(type, "trigger_number", HOFFSET(HitRow, trigger_number), H5T_NATIVE_UINT32);
+  return type;
+}
+
+// Hit of one channel: raw = ampMax clamped to [0, 255], charge =
+// ampMax_Fit_mV, timestamp = timeCFD_Fit_50pc, taken relative to the sensor3
+// reference (refTime - t) when subtractReference is set.
+inline HitRow MakeCorryHit(uint16_t column, uint16_t row, float ampMax, float ampMaxFitMilliVolt,
+                           float timeCfdFit, bool subtractReference, float refTime,
+                           uint32_t triggerNumber) {
+  HitRow hit{};
+  hit.column = column;
+  hit.row = row;
+  hit.raw = static_cast<uint8_t>(std::min(255.0f, std::max(0.0f, ampMax)));
+  hit.charge = static_cast<double>(ampMaxFitMilliVolt);
+  hit.timestamp = static_cast<double>(subtractReference ? (refTime - timeCfdFit) : timeCfdFit);
+  hit.trigger_number = triggerNumber;
+  return hit;
+}
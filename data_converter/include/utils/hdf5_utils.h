@@ -0,0 +1,234 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <string>
+
+#include "hdf5.h"
+
+// Helpers for the exported HDF5 datasets: storage layout (chunking and
+// compression) and datasets written in row batches instead of one H5Dwrite
+// of the whole run.
+
+// Registered filter ids of the optional HDF5 plugins (found through
+// HDF5_PLUGIN_PATH when installed)
+constexpr H5Z_filter_t kH5FilterLz4 = 32004;
+constexpr H5Z_filter_t kH5FilterZstd = 32015;
+
+// Chunked storage and compression of the exported datasets
+// (export_to_hdf5 --compression, --chunk-rows).
+struct Hdf5StorageOptions {
+  std::string compression = "deflate";  // "none", "deflate", "lz4" or "zstd"
+  int level = 4;                        // deflate 1-9, zstd 1-22
+  bool shuffle = true;                  // byte shuffle before compressing
+  hsize_t chunkRows = 0;                // 0: about kDefaultChunkBytes per chunk
+
+  // Chunks no larger than the default HDF5 chunk cache (1 MiB), so readers
+  // such as h5py decompress each chunk once also for strided selections
+  static constexpr size_t kDefaultChunkBytes = 1 << 20;
+
+  bool Compressed() const { return compression != "none"; }
+};
+
+// Parse "none", "deflate[:LEVEL]" ("gzip" is accepted), "lz4" or
+// "zstd[:LEVEL]".
+inline bool ParseHdf5Compression(const std::string &spec,
+                                 Hdf5StorageOptions &options,
+                                 std::string *errorMessage = nullptr) {
+  std::string name = spec;
+  std::string levelText;
+  const size_t colon = spec.find(':');
+  if (colon != std::string::npos) {
+    name = spec.substr(0, colon);
+    levelText = spec.substr(colon + 1);
+  }
+  std::transform(name.begin(), name.end(), name.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  if (name == "gzip") {
+    name = "deflate";
+  }
+  if (name != "none" && name != "deflate" && name != "lz4" && name != "zstd") {
+    if (errorMessage) *errorMessage = "unknown compression '" + spec + "' (none, deflate[:L], lz4, zstd[:L])";
+    return false;
+  }
+  int level = (name == "zstd") ? 3 : 4;
+  if (!levelText.empty()) {
+    try {
+      level = std::stoi(levelText);
+    } catch (...) {
+      if (errorMessage) *errorMessage = "invalid compression level in '" + spec + "'";
+      return false;
+    }
+    const int maxLevel = (name == "zstd") ? 22 : 9;
+    if (level < 1 || level > maxLevel) {
+      if (errorMessage) *errorMessage = "compression level of " + name + " must be 1-" + std::to_string(maxLevel);
+      return false;
+    }
+  }
+  options.compression = name;
+  options.level = level;
+  return true;
+}
+
+// Rows per chunk: --chunk-rows, or about kDefaultChunkBytes rounded down to
+// whole events (rowsPerEvent rows each, e.g. the exported channels) so an
+// event never straddles two chunks. maxRows > 0 caps it for fixed-size
+// datasets.
+inline hsize_t ChunkRowsFor(const Hdf5StorageOptions &options,
+                            size_t rowBytes,
+                            hsize_t rowsPerEvent = 1,
+                            hsize_t maxRows = 0) {
+  hsize_t rows = options.chunkRows;
+  if (rows == 0) {
+    const hsize_t perEvent = std::max<hsize_t>(1, rowsPerEvent);
+    const hsize_t fit = Hdf5StorageOptions::kDefaultChunkBytes / std::max<size_t>(1, rowBytes);
+    rows = std::max<hsize_t>(perEvent, fit / perEvent * perEvent);
+  }
+  if (maxRows > 0) {
+    rows = std::min(rows, maxRows);
+  }
+  return std::max<hsize_t>(1, rows);
+}
+
+// Add the configured filters to a chunked dataset creation property list.
+// A plugin filter that is not available falls back to deflate.
+inline void ApplyHdf5Compression(hid_t dcpl, const Hdf5StorageOptions &options) {
+  if (!options.Compressed()) {
+    return;
+  }
+  if (options.shuffle) {
+    H5Pset_shuffle(dcpl);
+  }
+  if (options.compression == "lz4" || options.compression == "zstd") {
+    const H5Z_filter_t id = (options.compression == "lz4") ? kH5FilterLz4 : kH5FilterZstd;
+    if (H5Zfilter_avail(id) > 0) {
+      const unsigned int level = static_cast<unsigned int>(options.level);
+      H5Pset_filter(dcpl, id, H5Z_FLAG_MANDATORY, (options.compression == "zstd") ? 1 : 0, &level);
+      return;
+    }
+    static bool warned = false;
+    if (!warned) {
+      std::cerr << "WARNING: HDF5 " << options.compression
+                << " filter plugin not found (HDF5_PLUGIN_PATH); using deflate" << std::endl;
+      warned = true;
+    }
+    H5Pset_deflate(dcpl, 4);
+    return;
+  }
+  H5Pset_deflate(dcpl, static_cast<unsigned int>(options.level));
+}
+
+// Create a fixed-size 1-D dataset of `rows` records of `type`, chunked and
+// compressed as configured (contiguous when empty). Returns the dataset id,
+// or a negative value on error.
+inline hid_t CreateRowDataset(hid_t loc,
+                              const char *name,
+                              hid_t type,
+                              hsize_t rows,
+                              const Hdf5StorageOptions &options,
+                              hsize_t rowsPerEvent = 1) {
+  hid_t space = H5Screate_simple(1, &rows, nullptr);
+  hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+  if (rows > 0) {
+    const hsize_t chunk = ChunkRowsFor(options, H5Tget_size(type), rowsPerEvent, rows);
+    H5Pset_chunk(dcpl, 1, &chunk);
+    ApplyHdf5Compression(dcpl, options);
+  }
+  hid_t dset = H5Dcreate(loc, name, type, space, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+  H5Pclose(dcpl);
+  H5Sclose(space);
+  if (dset < 0) {
+    std::cerr << "ERROR: cannot create dataset " << name << std::endl;
+  }
+  return dset;
+}
+
+// Create an empty chunked dataset with an unlimited number of rows.
+// columns == 0: 1-D dataset of `type` records.
+// columns > 0:  2-D dataset rows x columns; the column count is unlimited
+//               too and grows with AppendRows. Cells never written (padding
+//               of short rows) read back as *fillValue when given.
+// Returns the dataset id, or a negative value on error.
+inline hid_t CreateAppendableDataset(hid_t loc,
+                                     const char *name,
+                                     hid_t type,
+                                     hsize_t columns,
+                                     hsize_t chunkRows,
+                                     const void *fillValue = nullptr,
+                                     const Hdf5StorageOptions *options = nullptr) {
+  const int rank = (columns > 0) ? 2 : 1;
+  hsize_t dims[2] = {0, columns};
+  hsize_t maxDims[2] = {H5S_UNLIMITED, H5S_UNLIMITED};
+  hsize_t chunk[2] = {std::max<hsize_t>(1, chunkRows), std::max<hsize_t>(1, columns)};
+
+  hid_t space = H5Screate_simple(rank, dims, maxDims);
+  hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+  H5Pset_chunk(dcpl, rank, chunk);
+  if (fillValue) {
+    H5Pset_fill_value(dcpl, type, fillValue);
+  }
+  if (options) {
+    ApplyHdf5Compression(dcpl, *options);
+  }
+  hid_t dset = H5Dcreate(loc, name, type, space, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+  H5Pclose(dcpl);
+  H5Sclose(space);
+  if (dset < 0) {
+    std::cerr << "ERROR: cannot create dataset " << name << std::endl;
+  }
+  return dset;
+}
+
+// Append `rows` rows of `columns` values (columns == 0 for a 1-D dataset)
+// from data, extending the dataset first. A 2-D dataset is widened when
+// columns exceeds its current width; narrower rows leave the remaining
+// cells at the fill value.
+inline bool AppendRows(hid_t dset, hid_t memType, hsize_t rows, hsize_t columns,
+                       const void *data) {
+  if (rows == 0) {
+    return true;
+  }
+  hid_t fileSpace = H5Dget_space(dset);
+  const int rank = H5Sget_simple_extent_ndims(fileSpace);
+  hsize_t dims[2] = {0, 0};
+  H5Sget_simple_extent_dims(fileSpace, dims, nullptr);
+  H5Sclose(fileSpace);
+
+  const hsize_t offset[2] = {dims[0], 0};
+  const hsize_t count[2] = {rows, columns};
+  hsize_t newDims[2] = {dims[0] + rows, std::max(dims[1], columns)};
+  if (H5Dset_extent(dset, newDims) < 0) {
+    std::cerr << "ERROR: cannot extend dataset to " << newDims[0] << " rows" << std::endl;
+    return false;
+  }
+
+  fileSpace = H5Dget_space(dset);
+  H5Sselect_hyperslab(fileSpace, H5S_SELECT_SET, offset, nullptr, count, nullptr);
+  hid_t memSpace = H5Screate_simple(rank, count, nullptr);
+  const herr_t status = H5Dwrite(dset, memType, memSpace, fileSpace, H5P_DEFAULT, data);
+  H5Sclose(memSpace);
+  H5Sclose(fileSpace);
+  if (status < 0) {
+    std::cerr << "ERROR: H5Dwrite of " << rows << " rows failed" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Scalar string attribute, replacing an existing one of the same name
+inline void WriteStringAttribute(hid_t loc, const char *name, const std::string &value) {
+  if (H5Aexists(loc, name) > 0) {
+    H5Adelete(loc, name);
+  }
+  hid_t strType = H5Tcopy(H5T_C_S1);
+  H5Tset_size(strType, value.size() + 1);
+  hid_t attrSpace = H5Screate(H5S_SCALAR);
+  hid_t attr = H5Acreate2(loc, name, strType, attrSpace, H5P_DEFAULT, H5P_DEFAULT);
+  if (attr >= 0) {
+    H5Awrite(attr, strType, value.c_str());
+    H5Aclose(attr);
+  }
+  H5Sclose(attrSpace);
+  H5Tclose(strType);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Runs HDF5 write jobs in submission order on one dedicated thread, so the
+// exporter can read the next batch from ROOT while the previous one is
+// written. All HDF5 calls between Start() and Finish() must go through the
+// queue (the library is not thread-safe).
+//
+// Push() waits while `depth` jobs are pending (back-pressure), which bounds
+// the memory held by queued batches. After a job returns false the remaining
+// jobs are skipped and Finish() reports the failure.
+class Hdf5WriteQueue {
+public:
+  explicit Hdf5WriteQueue(size_t depth = 2);
+  ~Hdf5WriteQueue();
+  Hdf5WriteQueue(const Hdf5WriteQueue &) = delete;
+  Hdf5WriteQueue &operator=(const Hdf5WriteQueue &) = delete;
+
+  void Start();
+  void Push(std::function<bool()> job);
+  bool Failed() const { return failed_; }
+
+  // Run the queued jobs and stop the thread. Returns false if any job failed.
+  bool Finish();
+
+private:
+  void Run();
+
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable notEmpty_;
+  std::condition_variable notFull_;
+  std::deque<std::function<bool()>> queue_;
+  size_t capacity_ = 1;
+  bool running_ = false;
+  bool stopping_ = false;
+  std::atomic<bool> failed_{false};
+};
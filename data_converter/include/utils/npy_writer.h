@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Streaming writer of one NumPy .npy file (format version 1.0, C order).
+// The header is written with room for the final shape, rows are appended as
+// they come and Close() rewrites the header with the row count, so the file
+// opens with np.load(path, mmap_mode='r'). The header is padded to 128
+// bytes, which keeps the data 64-byte aligned for memory mapping.
+class NpyWriter {
+public:
+  NpyWriter() = default;
+  ~NpyWriter();
+  NpyWriter(const NpyWriter &) = delete;
+  NpyWriter &operator=(const NpyWriter &) = delete;
+
+  // descr: NumPy type string ('<f4', '<i4', '<u4', '|u1', ...); rowShape:
+  // trailing dimensions of one row (empty for a 1-D array).
+  bool Open(const std::string &path, const std::string &descr, const std::vector<size_t> &rowShape,
+            size_t valueBytes);
+  bool Append(const void *rows, size_t nRows);
+  // Patch the row count into the header and close the file.
+  bool Close();
+
+  bool IsOpen() const { return file_ != nullptr; }
+  size_t Rows() const { return rows_; }
+  const std::string &Path() const { return path_; }
+
+private:
+  bool WriteHeader();
+
+  std::string path_;
+  std::string descr_;
+  std::vector<size_t> rowShape_;
+  size_t rowBytes_ = 0;
+  size_t rows_ = 0;
+  std::FILE *file_ = nullptr;
+};
+
+// NumPy type string of a little-endian value of the given kind and size
+// ('f', 'i' or 'u').
+std::string NpyDescr(char kind, size_t valueBytes);
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+// Lightweight hot-path instrumentation, compiled in everywhere and switched
+// on at run time (--perf):
+//
+//   static const PerfSection kFill("fill");
+//   ...
+//   {
+//     PerfScope scope(kFill);
+//     tree->Fill();
+//   }
+//
+// A disabled PerfScope costs one well-predicted branch. Timestamps are read
+// from the TSC on x86 (steady_clock elsewhere) and converted to seconds
+// with a rate calibrated between EnablePerf() and WritePerfReport(). Each
+// thread accumulates into its own counters; they are merged when the thread
+// exits, so worker threads must be joined before the report is written.
+
+class PerfSection {
+public:
+  // Sections are registered once, typically as function-local statics.
+  explicit PerfSection(const char *name);
+  int id() const { return id_; }
+
+private:
+  int id_;
+};
+
+extern bool gPerfEnabled;
+
+inline bool PerfEnabled() { return gPerfEnabled; }
+
+inline uint64_t PerfNow() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+void PerfRecord(int section, uint64_t ticks);
+
+class PerfScope {
+public:
+  explicit PerfScope(const PerfSection &section)
+      : id_(section.id()), start_(PerfEnabled() ? PerfNow() : 0) {}
+  ~PerfScope() {
+    if (start_ != 0) {
+      PerfRecord(id_, PerfNow() - start_);
+    }
+  }
+  PerfScope(const PerfScope &) = delete;
+  PerfScope &operator=(const PerfScope &) = delete;
+
+private:
+  int id_;
+  uint64_t start_;
+};
+
+// Start timing; also starts the wall clock of the report.
+void EnablePerf();
+
+// Run totals for the report (no-ops while disabled).
+void PerfAddEvents(long long n);
+void PerfAddBytesRead(long long n);
+void PerfAddBytesWritten(long long n);
+
+// <dir>/<stem>.perf.json for an output file <dir>/<stem>.<ext>.
+std::string PerfReportPath(const std::string &outputPath);
+
+// JSON breakdown: wall time, events/s, bytes read/written, peak RSS and per
+// section seconds, calls and share of the wall time. No-op while disabled.
+bool WritePerfReport(const std::string &path, const std::string &program);
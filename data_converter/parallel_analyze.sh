@@ -13,6 +13,7 @@ DEFAULT_CONFIG="converter_config.json"
 DEFAULT_CHUNK_SIZE=500
 DEFAULT_MAX_CORES=8
 DEFAULT_TEMP_DIR="./temp_analysis"
+DEFAULT_IO_BUDGET_MB=1024
 
 # Parse command line arguments
 CONFIG="$DEFAULT_CONFIG"
@@ -21,6 +22,7 @@ OUTPUT_ROOT=""
 CHUNK_SIZE=$DEFAULT_CHUNK_SIZE
 MAX_CORES=$DEFAULT_MAX_CORES
 TEMP_DIR=$DEFAULT_TEMP_DIR
+IO_BUDGET_MB=$DEFAULT_IO_BUDGET_MB
 
 print_usage() {
     cat << EOF
@@ -35,6 +37,7 @@ Options:
     --chunk-size N      Events per chunk (default: 100)
     --max-cores N       Maximum parallel processes (default: 8)
     --temp-dir DIR      Temporary directory for chunks (default: ./temp_analysis)
+    --io-budget-mb N    Read cache memory shared by all processes (default: 1024)
     -h, --help          Show this help
 
 Example:
@@ -69,6 +72,10 @@ while [[ $# -gt 0 ]]; do
             TEMP_DIR="$2"
             shift 2
             ;;
+        --io-budget-mb)
+            IO_BUDGET_MB="$2"
+            shift 2
+            ;;
         -h|--help)
             print_usage
             exit 0
@@ -89,6 +96,12 @@ fi
 
 ANALYZE_BIN="${SCRIPT_DIR}/analyze_waveforms"
 
+# Each process gets an equal share of the read cache budget
+PROCESS_IO_BUDGET_MB=$(( IO_BUDGET_MB / MAX_CORES ))
+if [ "$PROCESS_IO_BUDGET_MB" -lt 1 ]; then
+    PROCESS_IO_BUDGET_MB=1
+fi
+
 if [ ! -x "$ANALYZE_BIN" ]; then
     echo "ERROR: analyze_waveforms executable not found at $ANALYZE_BIN"
     echo "Please run 'make' to build the executables"
@@ -101,6 +114,17 @@ output_dir=$(sed -nE 's/^[[:space:]]*"output_dir"[[:space:]]*:[[:space:]]*"([^"]
 run_str=$(printf "%06d" "$runnumber")
 OUTPUT_DIR="${output_dir}/${run_str}/${daq_name}"
 
+# Chunks are merged with hadd, so only the ROOT output of Stage 2 can be
+# parallelized: each chunk would write its own unmerged HDF5 file
+output_format=$(sed -nE 's/^[[:space:]]*"output_format"[[:space:]]*:[[:space:]]*"([^"]+)".*/\1/p' "$CONFIG" | head -n1)
+output_format=$(echo "${output_format:-root}" | tr '[:upper:]' '[:lower:]')
+if [ "$output_format" != "root" ]; then
+    echo "ERROR: output_format \"$output_format\" is not supported in parallel mode"
+    echo "       Set \"output_format\": \"root\" (or max_cores 1) and export the merged"
+    echo "       analysis file with export_to_hdf5"
+    exit 1
+fi
+
 # If inputs not specified, try to read from config
 if [ -z "$INPUT_ROOT" ]; then
     INPUT_ROOT=$(sed -nE 's/^[[:space:]]*"waveforms_root"[[:space:]]*:[[:space:]]*"([^"]+)".*/\1/p' "$CONFIG" | head -n1)
@@ -187,6 +211,7 @@ process_chunk() {
         --output "$(basename $CHUNK_OUTPUT)" \
         --event-range "$START_EVENT:$END_EVENT" \
         --waveform-plots-file "$CHUNK_PLOTS" \
+        --io-budget-mb "$PROCESS_IO_BUDGET_MB" \
         > "$TEMP_DIR/chunk_${CHUNK_ID}.log" 2>&1    
     
     # Move output(analysis result) to temp directory
@@ -207,6 +232,11 @@ process_chunk() {
     # Also handle possibility of split files (.root, _001.root ...) if large
     # But for chunks it's unlikely to be > 4GB unless chunk is huge
     
+    # Move the compact waveform store (waveform_plots_format "store")
+    if [ -f "$OUTPUT_DIR/output/waveform_store/${CHUNK_PLOTS}.root" ]; then
+        mv "$OUTPUT_DIR/output/waveform_store/${CHUNK_PLOTS}.root" "$TEMP_DIR/store_${CHUNK_PLOTS}.root"
+    fi
+
     # Move quality check files to temp directory if they exist
     local CHUNK_QC=$(echo "$CHUNK_PLOTS" | sed 's/waveform_plots/quality_check/')
     if [ -f "$OUTPUT_DIR/output/quality_check/${CHUNK_QC}.root" ]; then
@@ -267,13 +297,16 @@ echo ""
 # Merge chunk results
 echo "Merging results..."
 
-# Check that all chunk files exist
+# Check that all chunk files exist; list them in chunk order (a glob would put
+# chunk_10 before chunk_2 and hadd would merge the events out of order)
 MISSING_CHUNKS=0
+CHUNK_FILES=()
 for ((i=0; i<NUM_CHUNKS; i++)); do
     if [ ! -f "$TEMP_DIR/chunk_${i}.root" ]; then
         echo "ERROR: Missing chunk file: chunk_${i}.root"
         MISSING_CHUNKS=$((MISSING_CHUNKS + 1))
     fi
+    CHUNK_FILES+=("$TEMP_DIR/chunk_${i}.root")
 done
 
 if [ $MISSING_CHUNKS -gt 0 ]; then
@@ -283,7 +316,7 @@ fi
 
 # Use hadd to merge analysis ROOT files
 OUTPUT_PATH="$OUTPUT_DIR/output/root/$OUTPUT_ROOT"
-hadd -f "$OUTPUT_PATH" "$TEMP_DIR"/chunk_*.root > "$TEMP_DIR/merge.log" 2>&1
+hadd -f "$OUTPUT_PATH" "${CHUNK_FILES[@]}" > "$TEMP_DIR/merge.log" 2>&1
 
 if [ $? -ne 0 ]; then
     echo "ERROR: Failed to merge chunk files (see $TEMP_DIR/merge.log)"
@@ -293,16 +326,29 @@ fi
 echo "Merged $NUM_CHUNKS analysis chunks into $OUTPUT_PATH"
 echo ""
 
+# Collect the existing $TEMP_DIR/<prefix><N>.root files in chunk order into
+# ORDERED_FILES (a glob would put chunk_10 before chunk_2)
+ordered_chunk_files() {
+    local PREFIX=$1
+    ORDERED_FILES=()
+    for ((i=0; i<NUM_CHUNKS; i++)); do
+        if [ -f "$TEMP_DIR/${PREFIX}${i}.root" ]; then
+            ORDERED_FILES+=("$TEMP_DIR/${PREFIX}${i}.root")
+        fi
+    done
+}
+
 # Handle waveform plots (SKIP MERGE by default, copy instead)
 # Check if --merge-plots is passed? No, user asked generally.
 # I'll implement a flag variable $MERGE_PLOTS and add it to args.
+ordered_chunk_files waveform_plots_chunk_
+PLOTS_FILES=("${ORDERED_FILES[@]}")
 if [ "$MERGE_PLOTS" = "true" ]; then
-    PLOTS_FILES=("$TEMP_DIR"/waveform_plots_chunk_*.root)
-    if [ -f "${PLOTS_FILES[0]}" ]; then
+    if [ ${#PLOTS_FILES[@]} -gt 0 ]; then
         echo "Merging waveform plots files (this may take time)..."
         PLOTS_OUTPUT="$OUTPUT_DIR/output/waveform_plots/waveform_plots.root"
         mkdir -p "$OUTPUT_DIR/output/waveform_plots"
-        hadd -f "$PLOTS_OUTPUT" "$TEMP_DIR"/waveform_plots_chunk_*.root > "$TEMP_DIR/merge_plots.log" 2>&1
+        hadd -f "$PLOTS_OUTPUT" "${PLOTS_FILES[@]}" > "$TEMP_DIR/merge_plots.log" 2>&1
         if [ $? -eq 0 ]; then
             echo "Merged waveform plots into $PLOTS_OUTPUT"
         else
@@ -311,24 +357,39 @@ if [ "$MERGE_PLOTS" = "true" ]; then
     fi
 else
     # Copy instead of merge
-    PLOTS_FILES=("$TEMP_DIR"/waveform_plots_chunk_*.root)
-    if [ -f "${PLOTS_FILES[0]}" ]; then
+    if [ ${#PLOTS_FILES[@]} -gt 0 ]; then
         echo "Copying waveform plots chunks (skipping merge)..."
         mkdir -p "$OUTPUT_DIR/output/waveform_plots"
         # We rename them to be meaningful if possible, or just chunk_N
         # Maybe use the start/end event if we tracked it, but chunk_ID is simpler
-        cp "$TEMP_DIR"/waveform_plots_chunk_*.root "$OUTPUT_DIR/output/waveform_plots/"
+        cp "${PLOTS_FILES[@]}" "$OUTPUT_DIR/output/waveform_plots/"
         echo "Copied plot chunks to $OUTPUT_DIR/output/waveform_plots/"
     fi
 fi
 
+# Merge waveform stores (compact, render plots later with render_waveforms)
+ordered_chunk_files store_waveform_plots_chunk_
+STORE_FILES=("${ORDERED_FILES[@]}")
+if [ ${#STORE_FILES[@]} -gt 0 ]; then
+    echo "Merging waveform store files..."
+    STORE_OUTPUT="$OUTPUT_DIR/output/waveform_store/waveform_plots.root"
+    mkdir -p "$OUTPUT_DIR/output/waveform_store"
+    hadd -f "$STORE_OUTPUT" "${STORE_FILES[@]}" > "$TEMP_DIR/merge_store.log" 2>&1
+    if [ $? -eq 0 ]; then
+        echo "Merged waveform store into $STORE_OUTPUT"
+    else
+        echo "WARNING: Failed to merge waveform store files (see $TEMP_DIR/merge_store.log)"
+    fi
+fi
+
 # Merge quality check files (usually small so ok to merge)
-QC_FILES=("$TEMP_DIR"/quality_check_chunk_*.root)
-if [ -f "${QC_FILES[0]}" ]; then
+ordered_chunk_files quality_check_chunk_
+QC_FILES=("${ORDERED_FILES[@]}")
+if [ ${#QC_FILES[@]} -gt 0 ]; then
     echo "Merging quality check files..."
     QC_OUTPUT="$OUTPUT_DIR/output/quality_check/quality_check.root"
     mkdir -p "$OUTPUT_DIR/output/quality_check"
-    hadd -f "$QC_OUTPUT" "$TEMP_DIR"/quality_check_chunk_*.root > "$TEMP_DIR/merge_qc.log" 2>&1
+    hadd -f "$QC_OUTPUT" "${QC_FILES[@]}" > "$TEMP_DIR/merge_qc.log" 2>&1
     if [ $? -eq 0 ]; then
         echo "Merged quality check files into $QC_OUTPUT"
     else
@@ -0,0 +1,137 @@
+#include "analysis/analysis_hdf5_sink.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+#include "utils/perf_timer.h"
+
+namespace {
+
+const PerfSection kPerfSinkWrite("hdf5_sink_write");
+
+// Batches of a few chunks go to the writer thread at a time
+constexpr size_t kSinkQueueDepth = 4;
+
+}  // namespace
+
+AnalysisHdf5Sink::AnalysisHdf5Sink(const Hdf5StorageOptions &storage)
+    : storage_(storage), writer_(kSinkQueueDepth) {}
+
+AnalysisHdf5Sink::~AnalysisHdf5Sink() {
+  writer_.Finish();
+  if (hitSet_ >= 0) H5Dclose(hitSet_);
+  if (featureSet_ >= 0) H5Dclose(featureSet_);
+  if (hitType_ >= 0) H5Tclose(hitType_);
+  if (featureType_ >= 0) H5Tclose(featureType_);
+  if (file_ >= 0) H5Fclose(file_);
+}
+
+bool AnalysisHdf5Sink::Open(const std::string &path, int nChannels) {
+  path_ = path;
+  file_ = H5Fcreate(path.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+  if (file_ < 0) {
+    std::cerr << "ERROR: cannot create HDF5 file " << path << std::endl;
+    return false;
+  }
+  const hsize_t rowsPerEvent = static_cast<hsize_t>(std::max(1, nChannels));
+  featureType_ = CreateAnalysisFeatureType();
+  hitType_ = CreateHitRowType();
+  featureChunkRows_ = ChunkRowsFor(storage_, sizeof(AnalysisFeatureMeta), rowsPerEvent);
+  hitChunkRows_ = ChunkRowsFor(storage_, sizeof(HitRow), rowsPerEvent);
+  featureSet_ = CreateAppendableDataset(file_, "AnalysisFeatures", featureType_, 0,
+                                        featureChunkRows_, nullptr, &storage_);
+  hitSet_ = CreateAppendableDataset(file_, "Hits", hitType_, 0, hitChunkRows_, nullptr, &storage_);
+  if (featureSet_ < 0 || hitSet_ < 0) {
+    return false;
+  }
+  features_.reserve(featureChunkRows_ + rowsPerEvent);
+  hits_.reserve(hitChunkRows_ + rowsPerEvent);
+  writer_.Start();
+  return true;
+}
+
+void AnalysisHdf5Sink::AddEvent(const std::vector<AnalysisFeatureMeta> &rows, int referenceRow) {
+  if (file_ < 0) {
+    return;
+  }
+  features_.insert(features_.end(), rows.begin(), rows.end());
+
+  const bool hasReference = referenceRow >= 0 && referenceRow < static_cast<int>(rows.size());
+  const float refTime = hasReference ? rows[referenceRow].timeCFD_Fit_50pc : 0.0f;
+  for (const AnalysisFeatureMeta &row : rows) {
+    const bool isReference = (row.sensor_id == 3);
+    if (!isReference && !hasReference) {
+      continue;  // no sensor3 time to subtract
+    }
+    hits_.push_back(MakeCorryHit(row.column_id, row.strip_id, row.ampMax, row.ampMax_Fit_mV,
+                                 row.timeCFD_Fit_50pc, !isReference, refTime, row.event));
+  }
+
+  if (features_.size() >= featureChunkRows_) {
+    FlushFeatures();
+  }
+  if (hits_.size() >= hitChunkRows_) {
+    FlushHits();
+  }
+}
+
+void AnalysisHdf5Sink::FlushFeatures() {
+  if (features_.empty()) {
+    return;
+  }
+  auto rows = std::make_shared<std::vector<AnalysisFeatureMeta>>(std::move(features_));
+  features_.clear();
+  features_.reserve(featureChunkRows_);
+  featureRows_ += rows->size();
+  writer_.Push([this, rows]() {
+    PerfScope scope(kPerfSinkWrite);
+    return AppendRows(featureSet_, featureType_, rows->size(), 0, rows->data());
+  });
+}
+
+void AnalysisHdf5Sink::FlushHits() {
+  if (hits_.empty()) {
+    return;
+  }
+  auto rows = std::make_shared<std::vector<HitRow>>(std::move(hits_));
+  hits_.clear();
+  hits_.reserve(hitChunkRows_);
+  hitRows_ += rows->size();
+  writer_.Push([this, rows]() {
+    PerfScope scope(kPerfSinkWrite);
+    return AppendRows(hitSet_, hitType_, rows->size(), 0, rows->data());
+  });
+}
+
+bool AnalysisHdf5Sink::Close(const std::string &calibrationVersion) {
+  if (file_ < 0) {
+    return false;
+  }
+  FlushFeatures();
+  FlushHits();
+  const bool written = writer_.Finish();
+  if (written) {
+    WriteStringAttribute(file_, "calibration_version", calibrationVersion);
+    hid_t attrSpace = H5Screate(H5S_SCALAR);
+    const unsigned char corryOnly = 0;  // the file also holds AnalysisFeatures
+    hid_t attr = H5Acreate2(file_, "corry_only_fields", H5T_NATIVE_UCHAR, attrSpace,
+                            H5P_DEFAULT, H5P_DEFAULT);
+    if (attr >= 0) {
+      H5Awrite(attr, H5T_NATIVE_UCHAR, &corryOnly);
+      H5Aclose(attr);
+    }
+    H5Sclose(attrSpace);
+  }
+  H5Dclose(hitSet_);
+  H5Dclose(featureSet_);
+  H5Tclose(hitType_);
+  H5Tclose(featureType_);
+  H5Fclose(file_);
+  hitSet_ = featureSet_ = hitType_ = featureType_ = file_ = -1;
+  if (!written) {
+    std::cerr << "ERROR: writing " << path_ << " failed" << std::endl;
+    std::remove(path_.c_str());
+  }
+  return written;
+}
@@ -0,0 +1,276 @@
+#include "analysis/analysis_tree_layout.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+#include "TBranch.h"
+#include "TLeaf.h"
+#include "TList.h"
+#include "TNamed.h"
+#include "TTree.h"
+
+namespace {
+
+const char *kLayoutKey = "timing_branch_layout";
+const char *kChannelsKey = "n_channels";
+const char *kCfdKey = "cfd_thresholds";
+const char *kLeKey = "le_thresholds";
+const char *kChargeKey = "charge_thresholds";
+
+template <typename T>
+std::string JoinValues(const std::vector<T> &values) {
+  std::ostringstream oss;
+  for (size_t i = 0; i < values.size(); ++i) {
+    if (i > 0) {
+      oss << ',';
+    }
+    oss << values[i];
+  }
+  return oss.str();
+}
+
+template <typename T>
+std::vector<T> SplitValues(const std::string &text) {
+  std::vector<T> values;
+  std::stringstream ss(text);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if (item.empty()) {
+      continue;
+    }
+    values.push_back(static_cast<T>(std::strtod(item.c_str(), nullptr)));
+  }
+  return values;
+}
+
+void SetInfo(TList *info, const char *key, const std::string &value) {
+  if (TObject *old = info->FindObject(key)) {
+    info->Remove(old);
+    delete old;
+  }
+  info->Add(new TNamed(key, value.c_str()));
+}
+
+bool GetInfo(TList *info, const char *key, std::string &value) {
+  TObject *obj = info ? info->FindObject(key) : nullptr;
+  if (!obj) {
+    return false;
+  }
+  value = obj->GetTitle();
+  return true;
+}
+
+} // namespace
+
+bool ParseTimingBranchLayout(const std::string &text, TimingBranchLayout &layout) {
+  std::string lowered = text;
+  std::transform(lowered.begin(), lowered.end(), lowered.begin(),
+                 [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+  if (lowered == "scalar") {
+    layout = TimingBranchLayout::kScalar;
+    return true;
+  }
+  if (lowered == "array") {
+    layout = TimingBranchLayout::kArray;
+    return true;
+  }
+  return false;
+}
+
+const char *TimingBranchLayoutName(TimingBranchLayout layout) {
+  return layout == TimingBranchLayout::kArray ? "array" : "scalar";
+}
+
+ThresholdFamily ThresholdFamilyOf(const std::string &quantity) {
+  if (quantity.find("LE") != std::string::npos) {
+    return ThresholdFamily::kLE;
+  }
+  if (quantity.find("Charge") != std::string::npos) {
+    return ThresholdFamily::kCharge;
+  }
+  return ThresholdFamily::kCFD;
+}
+
+size_t AnalysisTreeLayout::ThresholdCount(ThresholdFamily family) const {
+  switch (family) {
+  case ThresholdFamily::kLE:
+    return leThresholds.size();
+  case ThresholdFamily::kCharge:
+    return chargeThresholds.size();
+  case ThresholdFamily::kCFD:
+  default:
+    return cfdThresholds.size();
+  }
+}
+
+int AnalysisTreeLayout::ThresholdIndex(ThresholdFamily family, double threshold) const {
+  if (family == ThresholdFamily::kLE) {
+    for (size_t i = 0; i < leThresholds.size(); ++i) {
+      if (std::abs(leThresholds[i] - threshold) < 1e-3) {
+        return static_cast<int>(i);
+      }
+    }
+    return -1;
+  }
+  const std::vector<int> &list =
+      (family == ThresholdFamily::kCharge) ? chargeThresholds : cfdThresholds;
+  for (size_t i = 0; i < list.size(); ++i) {
+    if (list[i] == static_cast<int>(std::lround(threshold))) {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+void WriteAnalysisTreeLayout(TTree *tree, const AnalysisTreeLayout &layout) {
+  if (!tree) {
+    return;
+  }
+  TList *info = tree->GetUserInfo();
+  SetInfo(info, kLayoutKey, TimingBranchLayoutName(layout.layout));
+  SetInfo(info, kChannelsKey, std::to_string(layout.nChannels));
+  SetInfo(info, kCfdKey, JoinValues(layout.cfdThresholds));
+  SetInfo(info, kLeKey, JoinValues(layout.leThresholds));
+  SetInfo(info, kChargeKey, JoinValues(layout.chargeThresholds));
+}
+
+AnalysisTreeLayout ReadAnalysisTreeLayout(TTree *tree, int nChannelsHint) {
+  AnalysisTreeLayout layout;
+  layout.nChannels = nChannelsHint;
+  if (!tree) {
+    return layout;
+  }
+
+  TList *info = tree->GetUserInfo();
+  std::string value;
+  if (!GetInfo(info, kLayoutKey, value)) {
+    return layout;
+  }
+  if (!ParseTimingBranchLayout(value, layout.layout)) {
+    std::cerr << "WARNING: unknown timing branch layout '" << value
+              << "' in tree metadata, assuming 'scalar'" << std::endl;
+  }
+  layout.fromMetadata = true;
+  if (GetInfo(info, kChannelsKey, value)) {
+    int stored = std::atoi(value.c_str());
+    if (stored > 0) {
+      layout.nChannels = stored;
+    }
+  }
+  if (GetInfo(info, kCfdKey, value)) {
+    layout.cfdThresholds = SplitValues<int>(value);
+  }
+  if (GetInfo(info, kLeKey, value)) {
+    layout.leThresholds = SplitValues<float>(value);
+  }
+  if (GetInfo(info, kChargeKey, value)) {
+    layout.chargeThresholds = SplitValues<int>(value);
+  }
+  return layout;
+}
+
+std::string ScalarTimingBranchName(const std::string &quantity, int channel,
+                                   ThresholdFamily family, double threshold) {
+  char name[96];
+  if (family == ThresholdFamily::kLE) {
+    std::snprintf(name, sizeof(name), "ch%02d_%s_%.1fmV", channel, quantity.c_str(), threshold);
+  } else {
+    std::snprintf(name, sizeof(name), "ch%02d_%s_%dpc", channel, quantity.c_str(),
+                  static_cast<int>(std::lround(threshold)));
+  }
+  return name;
+}
+
+int ReadOnlyBranches(TTree *tree, const std::vector<std::string> &names, long long cacheBytes) {
+  if (!tree) {
+    return 0;
+  }
+  tree->SetBranchStatus("*", false);
+  std::vector<TBranch *> enabled;
+  for (const auto &name : names) {
+    TBranch *branch = tree->GetBranch(name.c_str());
+    if (!branch || std::find(enabled.begin(), enabled.end(), branch) != enabled.end()) {
+      continue;
+    }
+    tree->SetBranchStatus(name.c_str(), true);
+    enabled.push_back(branch);
+  }
+  if (cacheBytes > 0) {
+    tree->SetCacheSize(cacheBytes);
+    for (TBranch *branch : enabled) {
+      tree->AddBranchToCache(branch, true);
+    }
+    tree->StopCacheLearningPhase();
+  }
+  return static_cast<int>(enabled.size());
+}
+
+bool TimingColumnReader::Bind(TTree *tree, const AnalysisTreeLayout &layout,
+                              const std::string &quantity, double threshold) {
+  bound_ = false;
+  values_.clear();
+  present_.clear();
+  branchNames_.clear();
+  if (!tree) {
+    return false;
+  }
+
+  const ThresholdFamily family = ThresholdFamilyOf(quantity);
+
+  if (layout.layout == TimingBranchLayout::kArray) {
+    TBranch *branch = tree->GetBranch(quantity.c_str());
+    TLeaf *leaf = branch ? branch->GetLeaf(quantity.c_str()) : nullptr;
+    if (!leaf) {
+      std::cerr << "WARNING: array branch " << quantity << " not found" << std::endl;
+      return false;
+    }
+    const int column = layout.ThresholdIndex(family, threshold);
+    const int stride = static_cast<int>(layout.ThresholdCount(family));
+    const int length = leaf->GetLenStatic();
+    if (column < 0 || stride <= 0 || length <= 0 || length % stride != 0) {
+      std::cerr << "WARNING: threshold " << threshold << " of " << quantity
+                << " is not stored in this tree" << std::endl;
+      return false;
+    }
+    stride_ = stride;
+    column_ = column;
+    values_.assign(length, 0.0f);
+    present_.assign(length / stride, true);
+    tree->SetBranchAddress(quantity.c_str(), values_.data());
+    branchNames_.push_back(quantity);
+    bound_ = true;
+    return true;
+  }
+
+  const int nChannels = std::max(0, layout.nChannels);
+  stride_ = 1;
+  column_ = 0;
+  values_.assign(nChannels, 0.0f);
+  present_.assign(nChannels, false);
+  for (int ch = 0; ch < nChannels; ++ch) {
+    const std::string name = ScalarTimingBranchName(quantity, ch, family, threshold);
+    if (tree->GetBranch(name.c_str())) {
+      tree->SetBranchAddress(name.c_str(), &values_[ch]);
+      present_[ch] = true;
+      branchNames_.push_back(name);
+      bound_ = true;
+    }
+  }
+  return bound_;
+}
+
+bool TimingColumnReader::Has(int channel) const {
+  return channel >= 0 && channel < static_cast<int>(present_.size()) && present_[channel];
+}
+
+float TimingColumnReader::Value(int channel) const {
+  if (!Has(channel)) {
+    return 0.0f;
+  }
+  return values_[static_cast<size_t>(channel) * stride_ + column_];
+}
@@ -0,0 +1,587 @@
+#include "analysis/feature_cache.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+
+#include "TDirectory.h"
+#include "TFile.h"
+#include "TList.h"
+#include "TNamed.h"
+#include "TTree.h"
+
+#include "utils/filesystem_utils.h"
+
+namespace {
+
+// Bump when the feature algorithms or the cache layout change, so that
+// caches written by older binaries are not reused.
+const char *kFeatureCacheFormat = "feature-cache-v1";
+const char *kCacheTreeName = "FeatureCache";
+
+const FeatureGroup kAllGroups[] = {FeatureGroup::kBaseline, FeatureGroup::kPulse,
+                                   FeatureGroup::kTiming, FeatureGroup::kFitParams};
+
+// Column order per group (indices used by the accessors below)
+enum BaselineColumn { kPresent, kBaselineValue, kRmsNoise, kNoise1Point, kAmpMinBefore, kAmpMaxBefore };
+enum PulseColumn { kAmpMax, kPeakTime, kCharge, kSignalOverNoise };
+enum TimingColumn { kRiseTime, kSlewRate, kJitterRMS, kTimeCFD, kJitterCFD,
+                    kTimeLE, kJitterLE, kTotLE, kTimeCharge };
+enum FitColumn { kFitStatus, kAmpMaxFit, kPeakTimeFit, kErfT0, kErfSigma };
+
+const std::vector<std::string> &GroupColumns(FeatureGroup group) {
+  static const std::vector<std::string> kBaselineColumns = {
+      "present", "baseline", "rmsNoise", "noise1Point", "ampMinBefore", "ampMaxBefore"};
+  static const std::vector<std::string> kPulseColumns = {
+      "ampMax", "peakTime", "charge", "signalOverNoise"};
+  static const std::vector<std::string> kTimingColumns = {
+      "riseTime", "slewRate", "jitterRMS", "timeCFD", "jitterCFD",
+      "timeLE", "jitterLE", "totLE", "timeCharge"};
+  static const std::vector<std::string> kFitColumns = {
+      "fitStatus", "ampMax_Fit", "peakTime_Fit", "erfT0", "erfSigma"};
+  switch (group) {
+  case FeatureGroup::kPulse:
+    return kPulseColumns;
+  case FeatureGroup::kTiming:
+    return kTimingColumns;
+  case FeatureGroup::kFitParams:
+    return kFitColumns;
+  case FeatureGroup::kBaseline:
+  default:
+    return kBaselineColumns;
+  }
+}
+
+// 64-bit FNV-1a
+uint64_t HashText(const std::string &text, uint64_t seed = 1469598103934665603ULL) {
+  uint64_t hash = seed;
+  for (unsigned char c : text) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+std::string HexKey(uint64_t hash) {
+  char buf[17];
+  std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(hash));
+  return buf;
+}
+
+template <typename T>
+std::string JoinFirst(const std::vector<T> &values, size_t count) {
+  std::ostringstream oss;
+  oss.precision(9);
+  for (size_t i = 0; i < values.size() && i < count; ++i) {
+    if (i > 0) {
+      oss << ',';
+    }
+    oss << values[i];
+  }
+  return oss.str();
+}
+
+template <typename T>
+std::string JoinAll(const std::vector<T> &values) {
+  return JoinFirst(values, values.size());
+}
+
+std::string FloatText(float value) {
+  std::ostringstream oss;
+  oss.precision(9);
+  oss << value;
+  return oss.str();
+}
+
+// Current value of one dependency field, as hashed into the group key.
+std::string ConfigFieldText(const AnalysisConfig &cfg, const std::string &field) {
+  const size_t nCh = static_cast<size_t>(std::max(0, cfg.n_channels()));
+  if (field == "n_channels") return std::to_string(cfg.n_channels());
+  if (field == "nsamples_policy") return cfg.common.nsamples_policy;
+  if (field == "analysis_region_min") return JoinFirst(cfg.analysis_region_min, nCh);
+  if (field == "analysis_region_max") return JoinFirst(cfg.analysis_region_max, nCh);
+  if (field == "baseline_region_min") return JoinFirst(cfg.baseline_region_min, nCh);
+  if (field == "baseline_region_max") return JoinFirst(cfg.baseline_region_max, nCh);
+  if (field == "signal_region_min") return JoinFirst(cfg.signal_region_min, nCh);
+  if (field == "signal_region_max") return JoinFirst(cfg.signal_region_max, nCh);
+  if (field == "charge_region_min") return JoinFirst(cfg.charge_region_min, nCh);
+  if (field == "charge_region_max") return JoinFirst(cfg.charge_region_max, nCh);
+  if (field == "signal_polarity") return JoinFirst(cfg.signal_polarity, nCh);
+  if (field == "impedance") return FloatText(cfg.impedance);
+  if (field == "cfd_thresholds") return JoinAll(cfg.cfd_thresholds);
+  if (field == "le_thresholds") return JoinAll(cfg.le_thresholds);
+  if (field == "charge_thresholds") return JoinAll(cfg.charge_thresholds);
+  if (field == "rise_time_low") return FloatText(cfg.rise_time_low);
+  if (field == "rise_time_high") return FloatText(cfg.rise_time_high);
+  if (field == "sensor_ids") return JoinFirst(cfg.sensor_ids, nCh);
+  if (field == "early_reject_threshold") {
+    // Rejected channels keep only the baseline features; the threshold is
+    // meant to stay below the amplitude cut, so both are part of the key
+    if (cfg.early_reject_threshold <= 0.0f) return "off";
+    return FloatText(cfg.early_reject_threshold) + ';' + JoinFirst(cfg.cut_amp_max, nCh);
+  }
+  if (field == "prefilter") {
+    return cfg.prefilter + ';' + JoinAll(cfg.prefilter_fir_taps) + ';' +
+           JoinAll(cfg.prefilter_biquad) + ';' + JoinFirst(cfg.prefilter_channels, nCh);
+  }
+  std::cerr << "WARNING: feature cache: unknown dependency field " << field << std::endl;
+  return std::string();
+}
+
+bool FileExists(const std::string &path) {
+  struct stat info;
+  return stat(path.c_str(), &info) == 0;
+}
+
+} // namespace
+
+const char *FeatureGroupName(FeatureGroup group) {
+  switch (group) {
+  case FeatureGroup::kPulse:
+    return "pulse";
+  case FeatureGroup::kTiming:
+    return "timing";
+  case FeatureGroup::kFitParams:
+    return "fit";
+  case FeatureGroup::kBaseline:
+  default:
+    return "baseline";
+  }
+}
+
+const std::vector<std::string> &FeatureGroupConfigFields(FeatureGroup group) {
+  static const std::vector<std::string> kBaselineFields = {
+      "n_channels", "nsamples_policy",
+      "analysis_region_min", "analysis_region_max",
+      "baseline_region_min", "baseline_region_max"};
+  static const std::vector<std::string> kPulseFields = {
+      "signal_region_min", "signal_region_max", "signal_polarity",
+      "charge_region_min", "charge_region_max", "impedance", "prefilter",
+      "early_reject_threshold"};
+  static const std::vector<std::string> kTimingFields = {
+      "cfd_thresholds", "le_thresholds", "charge_thresholds",
+      "rise_time_low", "rise_time_high"};
+  static const std::vector<std::string> kFitFields = {
+      "signal_polarity", "sensor_ids"};
+  switch (group) {
+  case FeatureGroup::kPulse:
+    return kPulseFields;
+  case FeatureGroup::kTiming:
+    return kTimingFields;
+  case FeatureGroup::kFitParams:
+    return kFitFields;
+  case FeatureGroup::kBaseline:
+  default:
+    return kBaselineFields;
+  }
+}
+
+struct FeatureCache::Group {
+  FeatureGroup id = FeatureGroup::kBaseline;
+  std::string key;
+  std::string fieldsText;
+  std::string path;
+  std::string tmpPath;
+  std::vector<size_t> widths;
+  std::vector<std::vector<float>> values;       // current row
+  std::vector<std::vector<float> *> readPtrs;
+  bool rowValid = false;
+  bool hit = false;      // read from an existing cache file
+  bool rebuild = false;  // a new cache file is being written
+  bool dirty = false;    // the new file differs from the cached one
+  TFile *inFile = nullptr;
+  TTree *inTree = nullptr;
+  TFile *outFile = nullptr;
+  TTree *outTree = nullptr;
+
+  void ResetRow() {
+    for (auto &column : values) {
+      std::fill(column.begin(), column.end(), 0.0f);
+    }
+    rowValid = false;
+  }
+};
+
+FeatureCache::FeatureCache() = default;
+
+FeatureCache::~FeatureCache() {
+  if (enabled_ && !finished_) {
+    Abort();
+  }
+}
+
+FeatureCache::Group &FeatureCache::Get(FeatureGroup group) {
+  return *groups_[static_cast<size_t>(group)];
+}
+
+const FeatureCache::Group &FeatureCache::Get(FeatureGroup group) const {
+  return *groups_[static_cast<size_t>(group)];
+}
+
+bool FeatureCache::Open(const AnalysisConfig &cfg,
+                        const std::string &cacheDir,
+                        const std::string &inputPath,
+                        const std::string &inputTree,
+                        long long firstEntry,
+                        long long endEntry) {
+  if (!CreateDirectoryIfNeeded(cacheDir)) {
+    std::cerr << "WARNING: cannot create feature cache directory " << cacheDir
+              << ", continuing without cache" << std::endl;
+    return false;
+  }
+
+  struct stat info;
+  if (stat(inputPath.c_str(), &info) != 0) {
+    std::cerr << "WARNING: cannot stat " << inputPath << ", continuing without feature cache"
+              << std::endl;
+    return false;
+  }
+
+  nChannels_ = cfg.n_channels();
+  nCFD_ = cfg.cfd_thresholds.size();
+  nLE_ = cfg.le_thresholds.size();
+  nCharge_ = cfg.charge_thresholds.size();
+  nEntries_ = endEntry - firstEntry;
+
+  // Input identity: file, size, modification time, tree and entry range
+  std::ostringstream identity;
+  identity << kFeatureCacheFormat << '\n' << inputPath << '\n' << info.st_size << '\n'
+           << static_cast<long long>(info.st_mtime) << '\n' << inputTree << '\n'
+           << firstEntry << ':' << endEntry << '\n';
+  const uint64_t inputHash = HashText(identity.str());
+
+  TDirectory::TContext restoreDirectory;
+  groups_.clear();
+  std::vector<uint64_t> hashes(4, 0);
+  for (FeatureGroup id : kAllGroups) {
+    std::unique_ptr<Group> group(new Group());
+    group->id = id;
+
+    // Chain each group to the one it is computed from
+    uint64_t upstream = inputHash;
+    if (id == FeatureGroup::kPulse || id == FeatureGroup::kFitParams) {
+      upstream = hashes[static_cast<size_t>(FeatureGroup::kBaseline)];
+    } else if (id == FeatureGroup::kTiming) {
+      upstream = hashes[static_cast<size_t>(FeatureGroup::kPulse)];
+    }
+    std::ostringstream fields;
+    for (const std::string &field : FeatureGroupConfigFields(id)) {
+      fields << field << '=' << ConfigFieldText(cfg, field) << '\n';
+    }
+    group->fieldsText = fields.str();
+    hashes[static_cast<size_t>(id)] = HashText(group->fieldsText, upstream);
+    group->key = HexKey(hashes[static_cast<size_t>(id)]);
+    group->path = cacheDir + "/" + FeatureGroupName(id) + "_" + group->key + ".root";
+    group->tmpPath = group->path + ".tmp";
+
+    const std::vector<std::string> &columns = GroupColumns(id);
+    group->widths.assign(columns.size(), static_cast<size_t>(nChannels_));
+    if (id == FeatureGroup::kTiming) {
+      group->widths[kTimeCFD] = group->widths[kJitterCFD] = nChannels_ * nCFD_;
+      group->widths[kTimeLE] = group->widths[kJitterLE] = group->widths[kTotLE] = nChannels_ * nLE_;
+      group->widths[kTimeCharge] = nChannels_ * nCharge_;
+    }
+    group->values.resize(columns.size());
+    for (size_t c = 0; c < columns.size(); ++c) {
+      group->values[c].assign(group->widths[c], 0.0f);
+    }
+    group->readPtrs.assign(columns.size(), nullptr);
+
+    // Reuse an existing cache file if it matches the expected shape
+    if (FileExists(group->path)) {
+      group->inFile = TFile::Open(group->path.c_str(), "READ");
+      if (group->inFile && !group->inFile->IsZombie()) {
+        group->inTree = dynamic_cast<TTree *>(group->inFile->Get(kCacheTreeName));
+      }
+      bool usable = group->inTree && group->inTree->GetEntries() == nEntries_ &&
+                    group->inTree->GetBranch("valid");
+      for (size_t c = 0; usable && c < columns.size(); ++c) {
+        usable = group->inTree->GetBranch(columns[c].c_str()) != nullptr;
+      }
+      if (usable) {
+        group->inTree->SetBranchAddress("valid", &group->rowValid);
+        for (size_t c = 0; c < columns.size(); ++c) {
+          group->inTree->SetBranchAddress(columns[c].c_str(), &group->readPtrs[c]);
+        }
+        group->hit = true;
+      } else {
+        std::cerr << "WARNING: ignoring unusable feature cache file " << group->path << std::endl;
+        if (group->inFile) {
+          group->inFile->Close();
+          delete group->inFile;
+        }
+        group->inFile = nullptr;
+        group->inTree = nullptr;
+      }
+    }
+
+    // Rebuild missing groups; the fit group is always rewritten so that newly
+    // fitted channels are merged into it
+    if (!group->hit || id == FeatureGroup::kFitParams) {
+      group->outFile = TFile::Open(group->tmpPath.c_str(), "RECREATE");
+      if (!group->outFile || group->outFile->IsZombie()) {
+        std::cerr << "WARNING: cannot write feature cache file " << group->tmpPath << std::endl;
+        delete group->outFile;
+        group->outFile = nullptr;
+      } else {
+        group->outFile->cd();
+        group->outTree = new TTree(kCacheTreeName, FeatureGroupName(id));
+        group->outTree->Branch("valid", &group->rowValid);
+        for (size_t c = 0; c < columns.size(); ++c) {
+          group->outTree->Branch(columns[c].c_str(), &group->values[c]);
+        }
+        group->rebuild = true;
+        group->dirty = !group->hit;
+      }
+    }
+    groups_.push_back(std::move(group));
+  }
+
+  enabled_ = true;
+  finished_ = false;
+  newFits_ = 0;
+
+  std::cout << "Feature cache: " << cacheDir << std::endl;
+  for (const auto &group : groups_) {
+    std::cout << "  " << FeatureGroupName(group->id) << " [" << group->key << "] "
+              << (group->hit ? "cached" : "recompute") << std::endl;
+  }
+  return true;
+}
+
+bool FeatureCache::Hit(FeatureGroup group) const {
+  return enabled_ && Get(group).hit;
+}
+
+bool FeatureCache::WaveformGroupsHit() const {
+  return Hit(FeatureGroup::kBaseline) && Hit(FeatureGroup::kPulse) && Hit(FeatureGroup::kTiming);
+}
+
+WaveformStage FeatureCache::ResumeStage() const {
+  // Keys are chained, so a group can only be cached if its upstream is
+  if (!Hit(FeatureGroup::kBaseline)) {
+    return WaveformStage::kBaseline;
+  }
+  return Hit(FeatureGroup::kPulse) ? WaveformStage::kTiming : WaveformStage::kPulse;
+}
+
+void FeatureCache::StartEntry(long long index) {
+  if (!enabled_) {
+    return;
+  }
+  for (auto &group : groups_) {
+    if (!group->hit) {
+      group->ResetRow();
+      continue;
+    }
+    group->inTree->GetEntry(index);
+    for (size_t c = 0; c < group->values.size(); ++c) {
+      std::vector<float> &column = group->values[c];
+      const std::vector<float> *stored = group->readPtrs[c];
+      std::fill(column.begin(), column.end(), 0.0f);
+      if (stored) {
+        std::copy(stored->begin(),
+                  stored->begin() + std::min(stored->size(), column.size()),
+                  column.begin());
+      }
+    }
+  }
+}
+
+bool FeatureCache::EntryValid() const {
+  return enabled_ && Get(FeatureGroup::kBaseline).rowValid;
+}
+
+bool FeatureCache::ChannelPresent(int channel) const {
+  return enabled_ && Get(FeatureGroup::kBaseline).values[kPresent][channel] != 0.0f;
+}
+
+void FeatureCache::GetWaveformFeatures(int channel, WaveformFeatures &features) const {
+  const auto &base = Get(FeatureGroup::kBaseline).values;
+  const auto &pulse = Get(FeatureGroup::kPulse).values;
+  const auto &timing = Get(FeatureGroup::kTiming).values;
+
+  features.baseline = base[kBaselineValue][channel];
+  features.rmsNoise = base[kRmsNoise][channel];
+  features.noise1Point = base[kNoise1Point][channel];
+  features.ampMinBefore = base[kAmpMinBefore][channel];
+  features.ampMaxBefore = base[kAmpMaxBefore][channel];
+
+  features.ampMax = pulse[kAmpMax][channel];
+  features.peakTime = pulse[kPeakTime][channel];
+  features.charge = pulse[kCharge][channel];
+  features.signalOverNoise = pulse[kSignalOverNoise][channel];
+
+  features.riseTime = timing[kRiseTime][channel];
+  features.slewRate = timing[kSlewRate][channel];
+  features.jitterRMS = timing[kJitterRMS][channel];
+
+  auto unpack = [channel](const std::vector<float> &column, size_t n, std::vector<float> &out) {
+    out.assign(column.begin() + channel * n, column.begin() + (channel + 1) * n);
+  };
+  unpack(timing[kTimeCFD], nCFD_, features.timeCFD);
+  unpack(timing[kJitterCFD], nCFD_, features.jitterCFD);
+  unpack(timing[kTimeLE], nLE_, features.timeLE);
+  unpack(timing[kJitterLE], nLE_, features.jitterLE);
+  unpack(timing[kTotLE], nLE_, features.totLE);
+  unpack(timing[kTimeCharge], nCharge_, features.timeCharge);
+}
+
+bool FeatureCache::GetFitParams(int channel, FitParams &params) const {
+  if (!enabled_) {
+    return false;
+  }
+  const auto &fit = Get(FeatureGroup::kFitParams).values;
+  if (fit[kFitStatus][channel] == 0.0f) {
+    return false;
+  }
+  params.ampMax_Fit = fit[kAmpMaxFit][channel];
+  params.peakTime_Fit = fit[kPeakTimeFit][channel];
+  params.erfT0 = fit[kErfT0][channel];
+  params.erfSigma = fit[kErfSigma][channel];
+  return true;
+}
+
+void FeatureCache::PutWaveformFeatures(int channel, const WaveformFeatures &features) {
+  if (!enabled_) {
+    return;
+  }
+  auto &base = Get(FeatureGroup::kBaseline).values;
+  auto &pulse = Get(FeatureGroup::kPulse).values;
+  auto &timing = Get(FeatureGroup::kTiming).values;
+
+  base[kPresent][channel] = 1.0f;
+  base[kBaselineValue][channel] = features.baseline;
+  base[kRmsNoise][channel] = features.rmsNoise;
+  base[kNoise1Point][channel] = features.noise1Point;
+  base[kAmpMinBefore][channel] = features.ampMinBefore;
+  base[kAmpMaxBefore][channel] = features.ampMaxBefore;
+
+  pulse[kAmpMax][channel] = features.ampMax;
+  pulse[kPeakTime][channel] = features.peakTime;
+  pulse[kCharge][channel] = features.charge;
+  pulse[kSignalOverNoise][channel] = features.signalOverNoise;
+
+  timing[kRiseTime][channel] = features.riseTime;
+  timing[kSlewRate][channel] = features.slewRate;
+  timing[kJitterRMS][channel] = features.jitterRMS;
+
+  auto pack = [channel](const std::vector<float> &in, size_t n, std::vector<float> &column) {
+    for (size_t i = 0; i < n && i < in.size(); ++i) {
+      column[channel * n + i] = in[i];
+    }
+  };
+  pack(features.timeCFD, nCFD_, timing[kTimeCFD]);
+  pack(features.jitterCFD, nCFD_, timing[kJitterCFD]);
+  pack(features.timeLE, nLE_, timing[kTimeLE]);
+  pack(features.jitterLE, nLE_, timing[kJitterLE]);
+  pack(features.totLE, nLE_, timing[kTotLE]);
+  pack(features.timeCharge, nCharge_, timing[kTimeCharge]);
+}
+
+void FeatureCache::PutFitParams(int channel, const FitParams &params) {
+  if (!enabled_) {
+    return;
+  }
+  Group &group = Get(FeatureGroup::kFitParams);
+  group.values[kFitStatus][channel] = 1.0f;
+  group.values[kAmpMaxFit][channel] = params.ampMax_Fit;
+  group.values[kPeakTimeFit][channel] = params.peakTime_Fit;
+  group.values[kErfT0][channel] = params.erfT0;
+  group.values[kErfSigma][channel] = params.erfSigma;
+  group.dirty = true;
+  ++newFits_;
+}
+
+void FeatureCache::FinishEntry(bool valid) {
+  if (!enabled_) {
+    return;
+  }
+  for (auto &group : groups_) {
+    if (!group->rebuild) {
+      continue;
+    }
+    group->rowValid = valid;
+    group->outTree->Fill();
+  }
+}
+
+void FeatureCache::CloseInputs() {
+  for (auto &group : groups_) {
+    if (group->inFile) {
+      group->inFile->Close();
+      delete group->inFile;
+      group->inFile = nullptr;
+      group->inTree = nullptr;
+    }
+  }
+}
+
+bool FeatureCache::Commit() {
+  if (!enabled_ || finished_) {
+    return true;
+  }
+  TDirectory::TContext restoreDirectory;
+  // Inputs first: a rebuilt fit group replaces the file it was read from
+  CloseInputs();
+
+  bool ok = true;
+  std::ostringstream summary;
+  for (auto &group : groups_) {
+    const char *name = FeatureGroupName(group->id);
+    summary << ' ' << name << '=';
+    if (!group->rebuild) {
+      summary << "reused";
+      continue;
+    }
+    if (group->dirty) {
+      group->outFile->cd();
+      TList *info = group->outTree->GetUserInfo();
+      info->Add(new TNamed("cache_key", group->key.c_str()));
+      info->Add(new TNamed("cache_format", kFeatureCacheFormat));
+      info->Add(new TNamed("config_fields", group->fieldsText.c_str()));
+      group->outTree->Write();
+    }
+    group->outFile->Close();
+    delete group->outFile;
+    group->outFile = nullptr;
+    group->outTree = nullptr;
+
+    if (!group->dirty) {
+      std::remove(group->tmpPath.c_str());
+      summary << "reused";
+    } else if (std::rename(group->tmpPath.c_str(), group->path.c_str()) != 0) {
+      std::cerr << "WARNING: failed to store feature cache file " << group->path << std::endl;
+      std::remove(group->tmpPath.c_str());
+      ok = false;
+      summary << "failed";
+    } else {
+      summary << (group->hit ? "merged" : "stored");
+    }
+  }
+  finished_ = true;
+  std::cout << "Feature cache:" << summary.str() << " (" << newFits_ << " channel fits computed)"
+            << std::endl;
+  return ok;
+}
+
+void FeatureCache::Abort() {
+  if (!enabled_ || finished_) {
+    return;
+  }
+  TDirectory::TContext restoreDirectory;
+  CloseInputs();
+  for (auto &group : groups_) {
+    if (group->outFile) {
+      group->outFile->Close();
+      delete group->outFile;
+      group->outFile = nullptr;
+      group->outTree = nullptr;
+      std::remove(group->tmpPath.c_str());
+    }
+  }
+  finished_ = true;
+}
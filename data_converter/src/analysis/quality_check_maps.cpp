@@ -0,0 +1,108 @@
+#include "analysis/quality_check_maps.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "TDirectory.h"
+#include "TFile.h"
+#include "TH1D.h"
+#include "TH2F.h"
+
+#include "utils/filesystem_utils.h"
+
+std::string QualityCheckFilePath(const AnalysisConfig &cfg, const std::string &outnameBase) {
+  // Use same naming scheme as waveform_plots_dir for quality check
+  // If waveform_plots_dir is "waveform_plots", use "quality_check"
+  // If waveform_plots_dir is "waveform_plots_chunk_0", use "quality_check_chunk_0"
+  std::string qualityCheckBaseName = cfg.waveform_plots_dir;
+
+  // Replace "waveform_plots" with "quality_check" in the base name
+  size_t pos = qualityCheckBaseName.find("waveform_plots");
+  if (pos != std::string::npos) {
+    qualityCheckBaseName.replace(pos, std::string("waveform_plots").length(), "quality_check");
+  } else {
+    // Fallback: just use "quality_check" prefix
+    qualityCheckBaseName = "quality_check_" + qualityCheckBaseName;
+  }
+  return BuildOutputPath(outnameBase, "quality_check", qualityCheckBaseName + ".root");
+}
+
+bool CreateQualityCheckFile(const std::string &path) {
+  size_t lastSlash = path.find_last_of('/');
+  if (lastSlash != std::string::npos && !CreateDirectoryIfNeeded(path.substr(0, lastSlash))) {
+    std::cerr << "WARNING: Failed to create quality_check output directory for "
+              << path << std::endl;
+    return false;
+  }
+  TDirectory::TContext context;
+  TFile *file = TFile::Open(path.c_str(), "RECREATE");
+  if (!file || file->IsZombie()) {
+    std::cerr << "WARNING: Failed to create quality_check output file " << path << std::endl;
+    delete file;
+    return false;
+  }
+  file->Close();
+  delete file;
+  return true;
+}
+
+QualityCheckMaps::QualityCheckMaps(const SensorLayout &layout)
+    : layout_(layout),
+      nSignal_(layout.NumChannels(), 0),
+      sumAmp_(layout.NumChannels(), 0.0) {}
+
+void QualityCheckMaps::AddEvent(const std::vector<bool> &hasSignal,
+                                const std::vector<float> &ampMax) {
+  ++nEvents_;
+  const size_t n = std::min({nSignal_.size(), hasSignal.size(), ampMax.size()});
+  for (size_t ch = 0; ch < n; ++ch) {
+    if (hasSignal[ch]) {
+      ++nSignal_[ch];
+      sumAmp_[ch] += ampMax[ch];
+    }
+  }
+}
+
+bool QualityCheckMaps::Write(const std::string &path) const {
+  TDirectory::TContext context;
+  TFile *file = TFile::Open(path.c_str(), "UPDATE");
+  if (!file || file->IsZombie()) {
+    std::cerr << "WARNING: Failed to open quality_check output file " << path << std::endl;
+    delete file;
+    return false;
+  }
+  file->cd();
+
+  TH1D events("qc_events", "Analysed events;;Events", 1, 0, 1);
+  events.SetBinContent(1, static_cast<double>(nEvents_));
+  events.SetEntries(static_cast<double>(nEvents_));
+  events.Write(events.GetName(), TObject::kOverwrite);
+
+  for (const auto &sensor : layout_.sensors) {
+    const char *xTitle = sensor.horizontal ? "Strip" : "Column";
+    const char *yTitle = sensor.horizontal ? "Column" : "Strip";
+    const int nx = layout_.MapBinsX(sensor);
+    const int ny = layout_.MapBinsY(sensor);
+
+    TH2F occupancy(Form("sensor%02d_occupancy", sensor.id),
+                   Form("Sensor %02d Occupancy;%s;%s;Events with signal", sensor.id, xTitle, yTitle),
+                   nx, 0, nx, ny, 0, ny);
+    TH2F amplitude(Form("sensor%02d_amplitude_sum", sensor.id),
+                   Form("Sensor %02d Summed Amplitude;%s;%s;#Sigma ampMax (V)", sensor.id, xTitle, yTitle),
+                   nx, 0, nx, ny, 0, ny);
+    for (int ch : sensor.channels) {
+      float x = 0.f;
+      float y = 0.f;
+      layout_.MapPosition(ch, x, y);
+      occupancy.Fill(x, y, static_cast<double>(nSignal_[ch]));
+      amplitude.Fill(x, y, sumAmp_[ch]);
+    }
+    occupancy.Write(occupancy.GetName(), TObject::kOverwrite);
+    amplitude.Write(amplitude.GetName(), TObject::kOverwrite);
+  }
+
+  file->Close();
+  delete file;
+  std::cout << "Quality check maps (" << nEvents_ << " events) saved to " << path << std::endl;
+  return true;
+}
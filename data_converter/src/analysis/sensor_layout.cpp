@@ -0,0 +1,86 @@
+#include "analysis/sensor_layout.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+
+bool IsSensorHorizontal(int sensorID, const AnalysisConfig &cfg) {
+  // Find unique sensor IDs in current config and map to local index
+  std::set<int> uniqueSensors(cfg.sensor_ids.begin(), cfg.sensor_ids.end());
+  std::vector<int> sortedSensors(uniqueSensors.begin(), uniqueSensors.end());
+
+  // Find index of this sensorID in the sorted unique list
+  auto it = std::find(sortedSensors.begin(), sortedSensors.end(), sensorID);
+  if (it == sortedSensors.end()) {
+    return false;  // Sensor not found
+  }
+
+  int localIndex = static_cast<int>(std::distance(sortedSensors.begin(), it));
+  if (localIndex < 0 || localIndex >= static_cast<int>(cfg.sensor_orientations.size())) {
+    return false;  // Out of bounds, default to vertical
+  }
+
+  return cfg.sensor_orientations[localIndex] == "horizontal";
+}
+
+SensorLayout BuildSensorLayout(const AnalysisConfig &cfg) {
+  SensorLayout layout;
+  const int nChannels = cfg.n_channels();
+  layout.sensorIndex.assign(nChannels, -1);
+  layout.strip.assign(nChannels, 0);
+  layout.column.assign(nChannels, 0);
+
+  // sensor ID -> channels, ordered by sensor ID
+  std::map<int, std::vector<int>> sensorChannels;
+  for (int ch = 0; ch < nChannels; ++ch) {
+    if (ch >= static_cast<int>(cfg.sensor_ids.size())) {
+      continue;
+    }
+    layout.strip[ch] = (ch < static_cast<int>(cfg.sensor_cols.size())) ? cfg.sensor_cols[ch] : 0;
+    layout.column[ch] = (ch < static_cast<int>(cfg.sensor_rows.size())) ? cfg.sensor_rows[ch] : 0;
+    sensorChannels[cfg.sensor_ids[ch]].push_back(ch);
+  }
+
+  for (const auto &entry : sensorChannels) {
+    SensorLayout::Sensor sensor;
+    sensor.id = entry.first;
+    sensor.horizontal = IsSensorHorizontal(sensor.id, cfg);
+    sensor.channels = entry.second;
+    for (int ch : sensor.channels) {
+      sensor.nStrips = std::max(sensor.nStrips, layout.strip[ch] + 1);
+      sensor.nColumns = std::max(sensor.nColumns, layout.column[ch] + 1);
+      layout.sensorIndex[ch] = static_cast<int>(layout.sensors.size());
+    }
+    layout.maxSensorId = std::max(layout.maxSensorId, sensor.id);
+    layout.sensors.push_back(sensor);
+  }
+  return layout;
+}
+
+const SensorLayout::Sensor *SensorLayout::SensorOf(int channel) const {
+  if (channel < 0 || channel >= NumChannels() || sensorIndex[channel] < 0) {
+    return nullptr;
+  }
+  return &sensors[sensorIndex[channel]];
+}
+
+void SensorLayout::MapPosition(int channel, float &x, float &y) const {
+  const Sensor *sensor = SensorOf(channel);
+  if (sensor && sensor->horizontal) {
+    // Horizontal: X=Strip, Y=Column
+    x = strip[channel] + 0.5f;
+    y = column[channel] + 0.5f;
+  } else {
+    // Vertical: X=Column, Y=Strip
+    x = column[channel] + 0.5f;
+    y = strip[channel] + 0.5f;
+  }
+}
+
+int SensorLayout::MapBinsX(const Sensor &sensor) const {
+  return sensor.horizontal ? sensor.nStrips : sensor.nColumns;
+}
+
+int SensorLayout::MapBinsY(const Sensor &sensor) const {
+  return sensor.horizontal ? sensor.nColumns : sensor.nStrips;
+}
@@ -0,0 +1,78 @@
+#include "analysis/waveform_filter.h"
+
+#include <algorithm>
+
+void ApplyFirFilter(std::vector<float> &samples,
+                    const std::vector<float> &taps,
+                    std::vector<float> &scratch) {
+  const int nSamples = static_cast<int>(samples.size());
+  const int nTaps = static_cast<int>(taps.size());
+  if (nSamples == 0 || nTaps == 0) {
+    return;
+  }
+  const int half = (nTaps - 1) / 2;
+
+  scratch.resize(static_cast<size_t>(nSamples + nTaps - 1));
+  std::fill(scratch.begin(), scratch.begin() + half, samples.front());
+  std::copy(samples.begin(), samples.end(), scratch.begin() + half);
+  std::fill(scratch.begin() + half + nSamples, scratch.end(), samples.back());
+
+  // One multiply-add pass per tap over the whole buffer: every output sample
+  // is independent, so the inner loop vectorizes without reassociation
+  float *__restrict out = samples.data();
+  const float *__restrict in = scratch.data();
+  std::fill(out, out + nSamples, 0.0f);
+  for (int k = 0; k < nTaps; ++k) {
+    const float h = taps[k];
+    const float *__restrict src = in + k;
+#pragma omp simd
+    for (int i = 0; i < nSamples; ++i) {
+      out[i] += h * src[i];
+    }
+  }
+}
+
+void ApplyBiquadFilter(std::vector<float> &samples,
+                       const std::vector<float> &coeffs) {
+  if (coeffs.size() < 5) {
+    return;
+  }
+  const float b0 = coeffs[0];
+  const float b1 = coeffs[1];
+  const float b2 = coeffs[2];
+  const float a1 = coeffs[3];
+  const float a2 = coeffs[4];
+
+  float z1 = 0.0f;
+  float z2 = 0.0f;
+  for (float &x : samples) {
+    const float y = b0 * x + z1;
+    z1 = b1 * x - a1 * y + z2;
+    z2 = b2 * x - a2 * y;
+    x = y;
+  }
+}
+
+bool PrefilterApplies(const AnalysisConfig &cfg, int channel) {
+  return (cfg.prefilter == "fir" || cfg.prefilter == "biquad") &&
+         channel >= 0 && channel < static_cast<int>(cfg.prefilter_channels.size()) &&
+         cfg.prefilter_channels[channel] != 0;
+}
+
+bool ApplyPrefilter(std::vector<float> &samples,
+                    const AnalysisConfig &cfg,
+                    int channel) {
+  if (!PrefilterApplies(cfg, channel)) {
+    return false;
+  }
+  if (cfg.prefilter == "fir") {
+    static thread_local std::vector<float> scratch;
+    ApplyFirFilter(samples, cfg.prefilter_fir_taps, scratch);
+    return true;
+  }
+  if (cfg.prefilter == "biquad") {
+    ApplyBiquadFilter(samples, cfg.prefilter_biquad);
+    return true;
+  }
+  return false;
+}
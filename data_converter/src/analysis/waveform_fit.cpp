@@ -0,0 +1,207 @@
+#include "analysis/waveform_fit.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "TF1.h"
+#include "TGraph.h"
+#include "TMath.h"
+
+bool FitPol2Analytical(const double* x, const double* y, int n,
+                       double& a0, double& a1, double& a2) {
+    double S0=n, Sx=0, Sx2=0, Sx3=0, Sx4=0, Sy=0, Sxy=0, Sx2y=0;
+    for (int i = 0; i < n; ++i) {
+        double xi=x[i], yi=y[i], xi2=xi*xi;
+        Sx   += xi;  Sx2 += xi2;  Sx3 += xi2*xi;  Sx4 += xi2*xi2;
+        Sy   += yi;  Sxy += xi*yi; Sx2y += xi2*yi;
+    }
+    double M[3][4] = {
+        {S0,  Sx,  Sx2, Sy},
+        {Sx,  Sx2, Sx3, Sxy},
+        {Sx2, Sx3, Sx4, Sx2y}
+    };
+    for (int col = 0; col < 3; ++col) {
+        int pivot = col;
+        for (int r = col+1; r < 3; ++r)
+            if (std::abs(M[r][col]) > std::abs(M[pivot][col])) pivot = r;
+        if (pivot != col) std::swap(M[col], M[pivot]);
+        if (std::abs(M[col][col]) < 1e-12) return false;
+        double inv = 1.0 / M[col][col];
+        for (int r = col+1; r < 3; ++r) {
+            double f = M[r][col] * inv;
+            for (int k = col; k <= 3; ++k) M[r][k] -= f * M[col][k];
+        }
+    }
+    a2 = M[2][3] / M[2][2];
+    a1 = (M[1][3] - M[1][2]*a2) / M[1][1];
+    a0 = (M[0][3] - M[0][2]*a2 - M[0][1]*a1) / M[0][0];
+    return true;
+}
+
+FitParams FitWaveformEdge(const std::vector<float> &amp_raw,
+                          const std::vector<float> &time,
+                          float baseline,
+                          int polarity,
+                          int sensor_id) {
+    FitParams res;
+
+    int n = static_cast<int>(std::min(amp_raw.size(), time.size()));
+    if (n < 5) return res;
+
+    // Build polarity-corrected waveform (peak is always positive)
+    std::vector<double> gx(n), gy(n);
+    for (int i = 0; i < n; ++i) {
+        gx[i] = time[i];
+        gy[i] = static_cast<double>((amp_raw[i] - baseline) * polarity);
+    }
+
+    // Peak of corrected signal (maximum value)
+    int    peak_idx  = static_cast<int>(
+                           std::max_element(gy.begin(), gy.end()) - gy.begin());
+    double peak_amp  = gy[peak_idx];
+    double peak_time = gx[peak_idx];
+
+    if (peak_amp < 10.0) return res;   // no signal
+
+    // amp_ref: reference amplitude for the erf fit range (may be updated by pol2)
+    double amp_ref = peak_amp;
+
+    // ── DUT0-2: pol2 fit around peak ─────────────────────────────────────────
+    if (sensor_id != 3) {
+        const double kHalfWin = 0.4;
+        double t_lo_p2 = peak_time - kHalfWin;
+        double t_hi_p2 = peak_time + kHalfWin;
+
+        std::vector<double> px, py;
+        px.reserve(16); py.reserve(16);
+        for (int i = 0; i < n; ++i) {
+            if (gx[i] >= t_lo_p2 && gx[i] <= t_hi_p2) {
+                px.push_back(gx[i]);
+                py.push_back(gy[i]);
+            }
+        }
+
+        if (static_cast<int>(px.size()) >= 3) {
+            double a0, a1, a2;
+            if (FitPol2Analytical(px.data(), py.data(), static_cast<int>(px.size()), a0, a1, a2)) {
+                if (a2 < 0.) {  // concave down = local maximum
+                    double t_pk = -a1 / (2. * a2);
+                    double v_pk =  a0 - a1 * a1 / (4. * a2);
+                    if (v_pk > 0.) {
+                        res.peakTime_Fit = static_cast<float>(t_pk);
+                        res.ampMax_Fit   = static_cast<float>(v_pk);
+                        amp_ref          = v_pk;
+                    }
+                }
+            }
+        }
+    } else {
+        // DUT3: peak from data
+        res.peakTime_Fit = static_cast<float>(peak_time);
+    }
+
+    // ── erf fit on the rising edge (polarity-corrected space) ────────────────
+    // V(t) = A · Freq((t − t₀) / σ),  A > 0,  σ > 0
+    //
+    // Find t_5%: last time before peak where corrected signal crosses 5% of amp_ref
+    const double kFracLo    = 0.05;
+    double       thresh_5   = kFracLo * amp_ref;
+    double       t_lo_erf   = gx[0];
+
+    for (int i = peak_idx; i >= 1; --i) {
+        if (gy[i] >= thresh_5 && gy[i - 1] < thresh_5) {
+            double dx = gx[i] - gx[i - 1];
+            double dy = gy[i] - gy[i - 1];
+            t_lo_erf = (std::abs(dy) > 1e-9)
+                       ? gx[i - 1] + dx / dy * (thresh_5 - gy[i - 1])
+                       : gx[i - 1];
+            break;
+        }
+    }
+
+    // Upper bound of erf window
+    double t_hi_erf = (sensor_id != 3) ? peak_time : t_lo_erf + 5.0;
+    if (t_hi_erf > gx[n - 1]) t_hi_erf = gx[n - 1];
+
+    double dt_erf = t_hi_erf - t_lo_erf;
+    if (dt_erf <= 0.) return res;
+
+    // Collect samples within the erf window
+    std::vector<double> ex, ey;
+    ex.reserve(64); ey.reserve(64);
+    for (int i = 0; i < n; ++i) {
+        if (gx[i] >= t_lo_erf && gx[i] <= t_hi_erf) {
+            ex.push_back(gx[i]);
+            ey.push_back(gy[i]);
+        }
+    }
+    if (static_cast<int>(ex.size()) < 4) return res;
+
+    // Initial parameter estimates
+    //   σ ≈ dt / 5.1  (5% ≈ t₀−1.64σ, 100% ≈ t₀+3.5σ → Δ ≈ 5.1σ)
+    //   t₀ ≈ t_lo + 1.64·σ
+    double sigma_init = dt_erf / 5.1;
+    double t0_init    = t_lo_erf + 1.64 * sigma_init;
+
+    static TF1* s_ferf = nullptr;
+    if (!s_ferf)
+        s_ferf = new TF1("_s_ferf_reuse", "[0]*TMath::Freq((x-[1])/[2])", 0., 1.);
+    s_ferf->SetRange(t_lo_erf, t_hi_erf);
+    s_ferf->SetParameter(0, amp_ref);
+    s_ferf->SetParameter(1, t0_init);
+    s_ferf->SetParameter(2, sigma_init);
+    s_ferf->SetParLimits(0, 0.05 * amp_ref, 20. * amp_ref);
+    s_ferf->SetParLimits(1, t_lo_erf - dt_erf, t_hi_erf);
+    s_ferf->SetParLimits(2, 0.02, dt_erf * 3.);
+    TGraph gerf(static_cast<int>(ex.size()), ex.data(), ey.data());
+    gerf.Fit(s_ferf, "RQN");
+
+    double A_fit     = s_ferf->GetParameter(0);
+    double t0_fit    = s_ferf->GetParameter(1);
+    double sigma_fit = std::abs(s_ferf->GetParameter(2));
+
+    if (A_fit <= 0. || sigma_fit <= 0.) return res;
+
+    // DUT3: ampMax_Fit = erf flat level |A|
+    if (sensor_id == 3)
+        res.ampMax_Fit = static_cast<float>(A_fit);
+
+    res.erfT0    = static_cast<float>(t0_fit);
+    res.erfSigma = static_cast<float>(sigma_fit);
+    return res;
+}
+
+FitFeatures DeriveFitFeatures(const FitParams &params,
+                              const std::vector<int> &cfd_thresholds,
+                              double rt_low,
+                              double rt_high) {
+    FitFeatures res;
+    res.ampMax_Fit   = params.ampMax_Fit;
+    res.peakTime_Fit = params.peakTime_Fit;
+    res.timeCFD_Fit.assign(cfd_thresholds.size(), FitFeatures::kBad);
+
+    if (params.erfSigma == FitFeatures::kBad) return res;
+
+    const double t0_fit    = params.erfT0;
+    const double sigma_fit = params.erfSigma;
+
+    // RT using configured thresholds (rt_low to rt_high)
+    res.riseTime_Fit = static_cast<float>(
+        TMath::Sqrt2() * sigma_fit *
+        (TMath::ErfInverse(2.*rt_high - 1.) - TMath::ErfInverse(2.*rt_low - 1.)));
+
+    // Leading edge: time at rt_low fraction of amplitude
+    res.leadingEdge_Fit = static_cast<float>(
+        t0_fit + TMath::Sqrt2() * sigma_fit * TMath::ErfInverse(2.*rt_low - 1.));
+
+    // CFD at each configured threshold
+    for (size_t k = 0; k < cfd_thresholds.size(); ++k) {
+        double f   = cfd_thresholds[k] / 100.0;
+        double arg = 2. * f - 1.;
+        if (arg <= -1. || arg >= 1.) continue;
+        res.timeCFD_Fit[k] = static_cast<float>(
+            t0_fit + TMath::Sqrt2() * sigma_fit * TMath::ErfInverse(arg));
+    }
+
+    return res;
+}
@@ -3,6 +3,8 @@
 #include <algorithm>
 #include <cmath>
 
+#include "analysis/waveform_filter.h"
+
 using namespace std;
 
 namespace {
@@ -269,10 +271,74 @@ ThresholdCrossing FindTrailingEdgeForward(const std::vector<float> &amp_corr,
   return crossing;
 }
 
+float MaxDeviationInWindow(const std::vector<float> &amp,
+                           const WindowIndices &window,
+                           float baseline,
+                           int polarity) {
+  const int nSamples = static_cast<int>(amp.size());
+  const int start = std::max(0, window.start);
+  const int end = std::min(window.end, nSamples - 1);
+  if (end < start) {
+    return 0.0f;
+  }
+
+  const float *data = amp.data();
+  float hi = data[start];
+  float lo = data[start];
+#pragma omp simd reduction(max:hi) reduction(min:lo)
+  for (int i = start; i <= end; ++i) {
+    const float v = data[i];
+    hi = (v > hi) ? v : hi;
+    lo = (v < lo) ? v : lo;
+  }
+  return (polarity >= 0) ? (hi - baseline) : (baseline - lo);
+}
+
+WaveformFeatures MakeRejectedFeatures(const WaveformFeatures &baselineFeatures,
+                                      float maxDeviation,
+                                      float timingNoise,
+                                      const AnalysisConfig &cfg) {
+  WaveformFeatures features = baselineFeatures;
+  features.hasSignal = false;
+  features.ampMax = std::max(0.0f, maxDeviation);
+  if (timingNoise > 0.0f) {
+    features.signalOverNoise = features.ampMax / timingNoise;
+  }
+  // Same values as a crossing that is not found in the full analysis
+  features.timeCFD.assign(cfg.cfd_thresholds.size(), 0.0f);
+  features.jitterCFD.assign(cfg.cfd_thresholds.size(), 0.0f);
+  features.timeLE.assign(cfg.le_thresholds.size(), 20.0f);
+  features.jitterLE.assign(cfg.le_thresholds.size(), -5.0f);
+  features.totLE.assign(cfg.le_thresholds.size(), -5.0f);
+  features.timeCharge.assign(cfg.charge_thresholds.size(), 10.0f);
+  return features;
+}
+
+bool PassesSignalCuts(const WaveformFeatures &features,
+                      const AnalysisConfig &cfg,
+                      int channel) {
+  // ampMax of an early-rejected channel is below early_reject_threshold,
+  // that of every other channel at or above it
+  return features.rmsNoise > 0.0f &&
+         features.signalOverNoise >= cfg.snr_threshold &&
+         features.ampMax >= cfg.cut_amp_max[channel] &&
+         (cfg.early_reject_threshold <= 0.0f || features.ampMax >= cfg.early_reject_threshold);
+}
+
 WaveformFeatures AnalyzeWaveform(const std::vector<float> &amp,
                                  const std::vector<float> &time,
                                  const AnalysisConfig &cfg,
                                  int channel) {
+  return ResumeWaveformAnalysis(amp, time, cfg, channel, WaveformFeatures(),
+                                WaveformStage::kBaseline);
+}
+
+WaveformFeatures ResumeWaveformAnalysis(const std::vector<float> &amp,
+                                        const std::vector<float> &time,
+                                        const AnalysisConfig &cfg,
+                                        int channel,
+                                        const WaveformFeatures &cached,
+                                        WaveformStage from) {
   WaveformFeatures features;
   const int nSamples = static_cast<int>(amp.size());
 
@@ -311,32 +377,84 @@ WaveformFeatures AnalyzeWaveform(const std::vector<float> &amp,
   WindowIndices baseline_window = BuildWindowIndices(time, baselineMin, baselineMax,
                                                      analysis_window.start, analysis_window.end);
   
-  BaselineNoiseMetrics baseline_metrics = ComputeBaselineAndNoise(amp, baseline_window);
-  features.baseline = baseline_metrics.baseline;
-  features.rmsNoise = baseline_metrics.rms_noise;
-  features.noise1Point = baseline_metrics.noise1_point;
-  features.ampMinBefore = baseline_metrics.amp_min;
-  features.ampMaxBefore = baseline_metrics.amp_max;
-  
-  std::vector<float> ampCorr = ApplyBaselineAndPolarity(amp, features.baseline, polarity);
+  if (from == WaveformStage::kBaseline) {
+    BaselineNoiseMetrics baseline_metrics = ComputeBaselineAndNoise(amp, baseline_window);
+    features.baseline = baseline_metrics.baseline;
+    features.rmsNoise = baseline_metrics.rms_noise;
+    features.noise1Point = baseline_metrics.noise1_point;
+    features.ampMinBefore = baseline_metrics.amp_min;
+    features.ampMaxBefore = baseline_metrics.amp_max;
+  } else {
+    features.baseline = cached.baseline;
+    features.rmsNoise = cached.rmsNoise;
+    features.noise1Point = cached.noise1Point;
+    features.ampMinBefore = cached.ampMinBefore;
+    features.ampMaxBefore = cached.ampMaxBefore;
+  }
   
   WindowIndices signal_window = BuildWindowIndices(time, signalMin, signalMax,
                                                    analysis_window.start, analysis_window.end);
-  
-  PeakMetrics peak = FindPeakInWindow(ampCorr, time, signal_window);
-  features.ampMax = peak.amplitude;
-  features.peakTime = peak.time;
-  int posampmax = peak.index;
-  
-  if (features.rmsNoise > 0.0f) {
-    features.signalOverNoise = features.ampMax / features.rmsNoise;
-    features.hasSignal = (features.signalOverNoise >= cfg.snr_threshold) &&
-                         (features.ampMax >= cfg.cut_amp_max[channel]);
+
+  // Early reject: a channel whose corrected (and filtered) waveform stays
+  // below early_reject_threshold in the signal window keeps only the
+  // baseline/noise features; ampMax and SNR are those of the full analysis.
+  // Unfiltered channels are checked on the raw samples, which gives the
+  // same maximum as the corrected copy without making it
+  const bool earlyReject = cfg.early_reject_threshold > 0.0f;
+  const bool filtered = PrefilterApplies(cfg, channel);
+  const bool pulseCached = (from == WaveformStage::kTiming);
+  if (earlyReject && pulseCached) {
+    // The cached pulse stage rejected exactly the channels below threshold
+    if (cached.ampMax < cfg.early_reject_threshold) {
+      WaveformFeatures rejected = MakeRejectedFeatures(features, cached.ampMax, 0.0f, cfg);
+      rejected.signalOverNoise = cached.signalOverNoise;
+      return rejected;
+    }
+  } else if (earlyReject && !filtered) {
+    const float maxDeviation = MaxDeviationInWindow(amp, signal_window,
+                                                    features.baseline, polarity);
+    if (maxDeviation < cfg.early_reject_threshold) {
+      return MakeRejectedFeatures(features, maxDeviation, features.rmsNoise, cfg);
+    }
   }
 
+  std::vector<float> ampCorr = ApplyBaselineAndPolarity(amp, features.baseline, polarity);
+
+  // Noise seen by the SNR cut and the jitter estimates: with the pre-filter
+  // on, that of the filtered baseline region (rmsNoise stays the raw noise)
+  float timingNoise = features.rmsNoise;
+  if (ApplyPrefilter(ampCorr, cfg, channel)) {
+    timingNoise = ComputeBaselineAndNoise(ampCorr, baseline_window).rms_noise;
+  }
+
+  if (earlyReject && filtered && !pulseCached) {
+    const float maxDeviation = MaxDeviationInWindow(ampCorr, signal_window, 0.0f, 1);
+    if (maxDeviation < cfg.early_reject_threshold) {
+      return MakeRejectedFeatures(features, maxDeviation, timingNoise, cfg);
+    }
+  }
+
+  // The peak index anchors the crossings below, so the peak search also runs
+  // when the pulse features come from the cache
+  PeakMetrics peak = FindPeakInWindow(ampCorr, time, signal_window);
+  int posampmax = peak.index;
   WindowIndices charge_window = BuildWindowIndices(time, chargeMin, chargeMax,
                                                    analysis_window.start, analysis_window.end);
-  features.charge = IntegrateChargeWindow(ampCorr, charge_window, dT, cfg.impedance);
+  if (pulseCached) {
+    features.ampMax = cached.ampMax;
+    features.peakTime = cached.peakTime;
+    features.charge = cached.charge;
+    features.signalOverNoise = cached.signalOverNoise;
+  } else {
+    features.ampMax = peak.amplitude;
+    features.peakTime = peak.time;
+    if (timingNoise > 0.0f) {
+      features.signalOverNoise = features.ampMax / timingNoise;
+    }
+    features.charge = IntegrateChargeWindow(ampCorr, charge_window, dT, cfg.impedance);
+  }
+  features.hasSignal = PassesSignalCuts(features, cfg, channel);
+
   features.timeCharge = ComputeChargeFractionTimes(ampCorr, time, charge_window, dT,
                                                    cfg.impedance, features.charge,
                                                    cfg.charge_thresholds, chargeMin, chargeMax);
@@ -349,7 +467,7 @@ WaveformFeatures AnalyzeWaveform(const std::vector<float> &amp,
     float threshold = features.ampMax * (cfg.cfd_thresholds[b] / 100.0f);
     ThresholdCrossing crossing = FindThresholdCrossingBackward(ampCorr, time,
                                                                posampmax, signal_window.start,
-                                                               threshold, features.rmsNoise);
+                                                               threshold, timingNoise);
     if (crossing.found) {
       features.timeCFD[b] = crossing.time;
       features.jitterCFD[b] = crossing.jitter;
@@ -369,7 +487,7 @@ WaveformFeatures AnalyzeWaveform(const std::vector<float> &amp,
 
     ThresholdCrossing leading = FindThresholdCrossingBackward(ampCorr, time,
                                                               posampmax, signal_window.start,
-                                                              threshold, features.rmsNoise);
+                                                              threshold, timingNoise);
     if (leading.found) {
       features.timeLE[b] = leading.time;
       features.jitterLE[b] = leading.jitter;
@@ -388,10 +506,10 @@ WaveformFeatures AnalyzeWaveform(const std::vector<float> &amp,
 
   ThresholdCrossing crossing90 = FindThresholdCrossingBackward(ampCorr, time,
                                                                posampmax, signal_window.start,
-                                                               amp90, features.rmsNoise);
+                                                               amp90, timingNoise);
   ThresholdCrossing crossing10 = FindThresholdCrossingBackward(ampCorr, time,
                                                                posampmax, signal_window.start,
-                                                               amp10, features.rmsNoise);
+                                                               amp10, timingNoise);
 
   float time90 = crossing90.found ? crossing90.time : 0.0f;
   float time10 = crossing10.found ? crossing10.time : 0.0f;
@@ -401,7 +519,7 @@ WaveformFeatures AnalyzeWaveform(const std::vector<float> &amp,
     features.slewRate = (amp90 - amp10) / features.riseTime;
   }
 
-  features.jitterRMS = features.rmsNoise / features.slewRate;
+  features.jitterRMS = timingNoise / features.slewRate;
   
   return features;
 }
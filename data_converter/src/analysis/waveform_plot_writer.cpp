@@ -0,0 +1,314 @@
+#include "analysis/waveform_plot_writer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+#include "TFile.h"
+#include "TROOT.h"
+
+#include "analysis/quality_check_maps.h"
+#include "analysis/waveform_plotting.h"
+#include "utils/filesystem_utils.h"
+#include "utils/perf_timer.h"
+
+namespace {
+
+// Maximum file size for waveform plots: 4 GB
+const Long64_t kMaxPlotsFileSize = 4LL * 1024 * 1024 * 1024;
+
+bool EnsureParentDirectory(const std::string &path) {
+  size_t lastSlash = path.find_last_of('/');
+  if (lastSlash != std::string::npos) {
+    std::string dirPath = path.substr(0, lastSlash);
+    if (!CreateDirectoryIfNeeded(dirPath)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void CloseFile(TFile *&file) {
+  if (!file) {
+    return;
+  }
+  file->cd();
+  file->Close();
+  delete file;
+  file = nullptr;
+}
+
+}  // namespace
+
+WaveformPlotWriter::WaveformPlotWriter(const AnalysisConfig &cfg,
+                                       const std::string &outnameBase)
+    : cfg_(cfg), outnameBase_(outnameBase), layout_(BuildSensorLayout(cfg)) {
+  capacity_ = static_cast<size_t>(std::max(1, cfg.waveform_plots_queue_depth));
+  storeOutput_ = (cfg.waveform_plots_format != "graphs");
+}
+
+WaveformPlotWriter::~WaveformPlotWriter() { Finish(); }
+
+bool WaveformPlotWriter::OpenPlotsFile(int fileNum) {
+  std::string baseFileName = cfg_.waveform_plots_dir;
+  std::string waveformPlotsFileName;
+
+  if (fileNum == 0) {
+    waveformPlotsFileName = BuildOutputPath(outnameBase_, "waveform_plots",
+                                             baseFileName + ".root");
+  } else {
+    char suffix[32];
+    std::snprintf(suffix, sizeof(suffix), "_%03d.root", fileNum);
+    waveformPlotsFileName = BuildOutputPath(outnameBase_, "waveform_plots",
+                                             baseFileName + suffix);
+  }
+
+  if (!EnsureParentDirectory(waveformPlotsFileName)) {
+    std::cerr << "WARNING: Failed to create waveform plots output directory for "
+              << waveformPlotsFileName << std::endl;
+    return false;
+  }
+  plotsFile_ = TFile::Open(waveformPlotsFileName.c_str(), "RECREATE");
+  if (!plotsFile_ || plotsFile_->IsZombie()) {
+    std::cerr << "WARNING: Failed to create waveform plots output file "
+              << waveformPlotsFileName << std::endl;
+    std::cerr << "         Continuing without waveform plots output..." << std::endl;
+    delete plotsFile_;
+    plotsFile_ = nullptr;
+    return false;
+  }
+  std::cout << "Waveform plots output enabled. Saving to: " << waveformPlotsFileName << std::endl;
+  if (cfg_.waveform_plots_only_signal && fileNum == 0) {
+    std::cout << "  Only saving waveforms with detected signals (SNR > "
+              << cfg_.snr_threshold << ")" << std::endl;
+  }
+  return true;
+}
+
+bool WaveformPlotWriter::OpenQualityCheckFile() {
+  // Added to the file that holds the run-level maps, so UPDATE, not RECREATE,
+  // unless the canvases have a file of their own
+  const bool ownFile = !qualityCheckPath_.empty();
+  std::string qualityCheckFileName = ownFile ? qualityCheckPath_ : QualityCheckFilePath(cfg_, outnameBase_);
+  if (!EnsureParentDirectory(qualityCheckFileName)) {
+    std::cerr << "WARNING: Failed to create quality_check output directory for "
+              << qualityCheckFileName << std::endl;
+    return false;
+  }
+  qualityCheckFile_ = TFile::Open(qualityCheckFileName.c_str(), ownFile ? "RECREATE" : "UPDATE");
+  if (!qualityCheckFile_ || qualityCheckFile_->IsZombie()) {
+    std::cerr << "WARNING: Failed to open quality_check output file "
+              << qualityCheckFileName << std::endl;
+    std::cerr << "         Continuing without per-event quality_check canvases..." << std::endl;
+    delete qualityCheckFile_;
+    qualityCheckFile_ = nullptr;
+    return false;
+  }
+  std::cout << "Per-event quality check canvases (every " << cfg_.quality_check_event_every_n
+            << " events) saved to: " << qualityCheckFileName << std::endl;
+  return true;
+}
+
+bool WaveformPlotWriter::OpenStore() {
+  std::string storeFileName = BuildOutputPath(outnameBase_, "waveform_store",
+                                              cfg_.waveform_plots_dir + ".root");
+  if (!EnsureParentDirectory(storeFileName)) {
+    std::cerr << "WARNING: Failed to create waveform store output directory for "
+              << storeFileName << std::endl;
+    return false;
+  }
+  if (!store_.Open(storeFileName)) {
+    std::cerr << "         Continuing without waveform plots output..." << std::endl;
+    return false;
+  }
+  std::cout << "Waveform store output enabled. Saving to: " << storeFileName << std::endl;
+  std::cout << "  Render plots with: render_waveforms --config <config> --event-range A:B" << std::endl;
+  return true;
+}
+
+bool WaveformPlotWriter::Start() {
+  if (!cfg_.waveform_plots_enabled || running_) {
+    return running_;
+  }
+
+  // The writer thread owns its files from here on; gDirectory and the ROOT
+  // object lists must be per-thread for the analysis thread to keep going.
+  ROOT::EnableThreadSafety();
+
+  if (storeOutput_) {
+    if (!OpenStore()) {
+      return false;
+    }
+  } else {
+    OpenPlotsFile(plotsFileCounter_);
+    if (cfg_.quality_check_event_every_n > 0) {
+      OpenQualityCheckFile();
+    }
+    if (!plotsFile_ && !qualityCheckFile_) {
+      return false;
+    }
+  }
+
+  if (cfg_.waveform_plots_every_n > 1) {
+    std::cout << "  Plotting every " << cfg_.waveform_plots_every_n << "th event" << std::endl;
+  }
+  if (cfg_.waveform_plots_signal_events_only) {
+    std::cout << "  Skipping events without any signal channel" << std::endl;
+  }
+
+  stopping_ = false;
+  running_ = true;
+  thread_ = std::thread(&WaveformPlotWriter::Run, this);
+  return true;
+}
+
+bool WaveformPlotWriter::SampleEvent(long long index) const {
+  if (!running_) {
+    return false;
+  }
+  const int everyN = std::max(1, cfg_.waveform_plots_every_n);
+  return index % everyN == 0;
+}
+
+bool WaveformPlotWriter::WantsChannel(const WaveformFeatures &features) const {
+  return !cfg_.waveform_plots_only_signal || features.hasSignal;
+}
+
+bool WaveformPlotWriter::WantsEvent(const EventPlotRecord &record) const {
+  if (!cfg_.waveform_plots_signal_events_only) {
+    return true;
+  }
+  for (const auto &channel : record.channels) {
+    if (channel.features.hasSignal) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void WaveformPlotWriter::Push(EventPlotRecord &&record) {
+  if (!running_) {
+    return;
+  }
+  static const PerfSection kPushSection("plot_queue_push");
+  PerfScope scope(kPushSection);
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (queue_.size() >= capacity_) {
+    ++pushStalls_;
+    notFull_.wait(lock, [this] { return queue_.size() < capacity_; });
+  }
+  queue_.push_back(std::move(record));
+  lock.unlock();
+  notEmpty_.notify_one();
+}
+
+void WaveformPlotWriter::Run() {
+  while (true) {
+    EventPlotRecord record;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      notEmpty_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        break;  // stopping and drained
+      }
+      record = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    notFull_.notify_one();
+
+    Write(record);
+    ++eventsWritten_;
+  }
+}
+
+void WaveformPlotWriter::Write(const EventPlotRecord &record) {
+  static const PerfSection kStoreSection("plot_store_fill");
+  static const PerfSection kPlotsSection("SaveWaveformPlots");
+  static const PerfSection kMapsSection("SaveEventAmplitudeMaps");
+
+  if (storeOutput_) {
+    PerfScope scope(kStoreSection);
+    store_.Fill(record);
+    return;
+  }
+
+  if (plotsFile_) {
+    PerfScope scope(kPlotsSection);
+    for (const auto &channel : record.channels) {
+      SaveWaveformPlots(plotsFile_, record.event, channel.channel,
+                        channel.amp, channel.time, channel.features, cfg_);
+    }
+  }
+
+  const bool sampleCanvas = qualityCheckFile_ &&
+                            record.event % cfg_.quality_check_event_every_n == 0;
+  {
+    PerfScope scope(kMapsSection);
+    SaveEventAmplitudeMaps(plotsFile_, sampleCanvas ? qualityCheckFile_ : nullptr,
+                           record.event, record.ampMax, layout_);
+  }
+
+  // Rotate after all plots of the event are written
+  RotatePlotsFileIfNeeded();
+}
+
+void WaveformPlotWriter::RotatePlotsFileIfNeeded() {
+  if (!plotsFile_ || plotsFile_->IsZombie()) {
+    return;
+  }
+
+  Long64_t currentSize = plotsFile_->GetSize();
+  if (currentSize < kMaxPlotsFileSize) {
+    return;
+  }
+  std::cout << "Waveform plots file size reached " << (currentSize / (1024.0 * 1024.0 * 1024.0))
+            << " GB. Rotating to new file..." << std::endl;
+
+  std::string currentFileName = plotsFile_->GetName();
+  CloseFile(plotsFile_);
+  std::cout << "Saved waveform plots to: " << currentFileName << std::endl;
+
+  // Open new file with incremented counter
+  plotsFileCounter_++;
+  OpenPlotsFile(plotsFileCounter_);
+}
+
+void WaveformPlotWriter::Finish() {
+  if (!running_) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  notEmpty_.notify_one();
+  thread_.join();
+  running_ = false;
+
+  if (store_.IsOpen()) {
+    std::string storeFileName = store_.Path();
+    store_.Close();
+    std::cout << "Waveform store saved to " << storeFileName << std::endl;
+  }
+  if (plotsFile_) {
+    std::string finalFileName = plotsFile_->GetName();
+    CloseFile(plotsFile_);
+    std::cout << "Waveform plots output saved to " << finalFileName << std::endl;
+    if (plotsFileCounter_ > 0) {
+      std::cout << "  Total files created: " << (plotsFileCounter_ + 1)
+                << " (split due to 4GB size limit)" << std::endl;
+    }
+  }
+  if (qualityCheckFile_) {
+    std::string finalFileName = qualityCheckFile_->GetName();
+    CloseFile(qualityCheckFile_);
+    std::cout << "Per-event quality check canvases saved to " << finalFileName << std::endl;
+  }
+
+  std::cout << "Plot writer: " << eventsWritten_ << " events written";
+  if (pushStalls_ > 0) {
+    std::cout << ", analysis waited for the writer " << pushStalls_
+              << " times (queue depth " << capacity_ << ")";
+  }
+  std::cout << std::endl;
+}
@@ -1,11 +1,14 @@
 #include "analysis/waveform_plotting.h"
 
+#include <algorithm>
 #include <cstdio>
+#include <iostream>
 
 #include "TCanvas.h"
 #include "TDirectory.h"
 #include "TFile.h"
 #include "TGraph.h"
+#include "TH2F.h"
 #include "TLegend.h"
 #include "TLine.h"
 #include "TMarker.h"
@@ -206,3 +209,100 @@ void SaveWaveformPlots(TFile *waveformPlotsFile, int event, int channel,
 
   waveformPlotsFile->cd();
 }
+
+void SaveEventAmplitudeMaps(TFile *waveformPlotsFile, TFile *qualityCheckFile,
+                            int event, const std::vector<float> &ampMax,
+                            const SensorLayout &layout) {
+  if (!waveformPlotsFile && !qualityCheckFile) {
+    return;
+  }
+
+  // Create event directory if not exists (for waveformPlotsFile)
+  char eventDirName[64];
+  std::snprintf(eventDirName, sizeof(eventDirName), "event_%06d", event);
+  TDirectory *eventDir = nullptr;
+  if (waveformPlotsFile) {
+    eventDir = waveformPlotsFile->GetDirectory(eventDirName);
+    if (!eventDir) {
+      eventDir = waveformPlotsFile->mkdir(eventDirName);
+    }
+  }
+
+  // Store histograms for quality check canvas
+  std::vector<TH2F*> sensorHistograms;
+
+  // Create histogram for each sensor
+  for (const auto &sensor : layout.sensors) {
+    const int nx = layout.MapBinsX(sensor);
+    const int ny = layout.MapBinsY(sensor);
+    TH2F *hist = new TH2F(Form("sensor%02d_amplitude_map", sensor.id),
+                          Form("Event %d - Sensor %02d Amplitude Map;%s;%s;Amplitude (V)",
+                               event, sensor.id,
+                               sensor.horizontal ? "Strip" : "Column",
+                               sensor.horizontal ? "Column" : "Strip"),
+                          nx, 0, nx, ny, 0, ny);
+
+    // Fill histogram with amplitude values
+    for (int ch : sensor.channels) {
+      float x = 0.f;
+      float y = 0.f;
+      layout.MapPosition(ch, x, y);
+      hist->Fill(x, y, ampMax[ch]);
+    }
+
+    // Save to sensor directory within event (for waveformPlotsFile)
+    if (eventDir) {
+      TDirectory *sensorDir = eventDir->GetDirectory(Form("sensor%02d", sensor.id));
+      if (!sensorDir) {
+        sensorDir = eventDir->mkdir(Form("sensor%02d", sensor.id));
+      }
+      sensorDir->cd();
+      hist->Write(hist->GetName(), TObject::kOverwrite);
+    }
+    sensorHistograms.push_back(hist);
+  }
+
+  // Create quality check canvas with all sensors
+  if (qualityCheckFile) {
+    qualityCheckFile->cd();
+
+    // Canvas needs maxSensorId+1 pads to accommodate sensor IDs 0 through maxSensorId
+    // This ensures sensors from different DAQs align correctly when merged with hadd
+    // Use a minimum of 4 to support typical dual-DAQ setups (sensors 0,1,2,3)
+    int numPads = std::max(4, layout.maxSensorId + 1);
+
+    // Create canvas with enough columns for all potential sensors
+    char canvasName[64];
+    std::snprintf(canvasName, sizeof(canvasName), "event_%06d_quality_check", event);
+    TCanvas *canvas = new TCanvas(canvasName,
+                                  Form("Event %d - All Sensors Quality Check", event),
+                                  600 * numPads, 800);  // Width scales with pad count
+    canvas->Divide(numPads, 1);  // Enough pads for all sensors
+
+    // Draw each sensor in the pad corresponding to its sensor ID
+    // This ensures sensor 0 goes to pad 1, sensor 1 to pad 2, etc.
+    for (size_t k = 0; k < sensorHistograms.size(); ++k) {
+      int sensorID = layout.sensors[k].id;
+      canvas->cd(sensorID + 1);  // Sensor ID 0 -> pad 1, sensor ID 1 -> pad 2, etc.
+
+      // Clone the histogram to avoid deletion issues
+      TH2F *histClone = (TH2F*)sensorHistograms[k]->Clone(Form("sensor%02d_qc_clone", sensorID));
+      histClone->SetStats(0);  // Hide statistics box
+      histClone->SetMaximum(5000);  // Fix z-axis maximum to 5000 for consistent comparison
+      histClone->Draw("COLZ TEXT");  // Draw with color scale and text values
+    }
+
+    // Save canvas to quality check file
+    canvas->Write(canvasName, TObject::kOverwrite);
+    delete canvas;  // Canvas deletion will handle cloned histograms
+  }
+
+  // Clean up sensor histograms
+  for (TH2F *hist : sensorHistograms) {
+    delete hist;
+  }
+
+  if (waveformPlotsFile) {
+    waveformPlotsFile->cd();
+  }
+}
@@ -0,0 +1,272 @@
+#include "analysis/waveform_store.h"
+
+#include <iostream>
+
+#include "TDirectory.h"
+#include "TFile.h"
+#include "TTree.h"
+
+namespace {
+
+const char *kStoreTreeName = "WaveformStore";
+
+}  // namespace
+
+struct WaveformStoreWriter::Columns {
+  int event = 0;
+  std::vector<float> eventAmpMax;
+  std::vector<int> channel;
+  std::vector<int> nSamples;
+  std::vector<float> time;
+  std::vector<float> amp;
+  std::vector<char> hasSignal;
+  std::vector<float> baseline;
+  std::vector<float> rmsNoise;
+  std::vector<float> ampMax;
+  std::vector<float> peakTime;
+  std::vector<float> riseTime;
+  std::vector<float> charge;
+  std::vector<float> signalOverNoise;
+  std::vector<float> timeCFD;
+  std::vector<float> timeLE;
+  std::vector<float> timeCharge;
+};
+
+WaveformStoreWriter::WaveformStoreWriter() = default;
+
+WaveformStoreWriter::~WaveformStoreWriter() { Close(); }
+
+bool WaveformStoreWriter::Open(const std::string &path) {
+  Close();
+
+  TDirectory::TContext context;
+  file_ = TFile::Open(path.c_str(), "RECREATE");
+  if (!file_ || file_->IsZombie()) {
+    std::cerr << "WARNING: Failed to create waveform store " << path << std::endl;
+    delete file_;
+    file_ = nullptr;
+    return false;
+  }
+  path_ = path;
+  entries_ = 0;
+  columns_.reset(new Columns());
+
+  tree_ = new TTree(kStoreTreeName, "Sampled waveforms and features for render_waveforms");
+  tree_->SetDirectory(file_);
+  Columns &c = *columns_;
+  tree_->Branch("event", &c.event, "event/I");
+  tree_->Branch("eventAmpMax", &c.eventAmpMax);
+  tree_->Branch("channel", &c.channel);
+  tree_->Branch("nSamples", &c.nSamples);
+  tree_->Branch("time", &c.time);
+  tree_->Branch("amp", &c.amp);
+  tree_->Branch("hasSignal", &c.hasSignal);
+  tree_->Branch("baseline", &c.baseline);
+  tree_->Branch("rmsNoise", &c.rmsNoise);
+  tree_->Branch("ampMax", &c.ampMax);
+  tree_->Branch("peakTime", &c.peakTime);
+  tree_->Branch("riseTime", &c.riseTime);
+  tree_->Branch("charge", &c.charge);
+  tree_->Branch("signalOverNoise", &c.signalOverNoise);
+  tree_->Branch("timeCFD", &c.timeCFD);
+  tree_->Branch("timeLE", &c.timeLE);
+  tree_->Branch("timeCharge", &c.timeCharge);
+  return true;
+}
+
+void WaveformStoreWriter::Fill(const EventPlotRecord &record) {
+  if (!tree_) {
+    return;
+  }
+  Columns &c = *columns_;
+  c.event = record.event;
+  c.eventAmpMax = record.ampMax;
+  c.channel.clear();
+  c.nSamples.clear();
+  c.amp.clear();
+  c.hasSignal.clear();
+  c.baseline.clear();
+  c.rmsNoise.clear();
+  c.ampMax.clear();
+  c.peakTime.clear();
+  c.riseTime.clear();
+  c.charge.clear();
+  c.signalOverNoise.clear();
+  c.timeCFD.clear();
+  c.timeLE.clear();
+  c.timeCharge.clear();
+  c.time.clear();
+
+  for (const auto &ch : record.channels) {
+    // All channels of an event share the time axis; keep the longest one
+    if (ch.time.size() > c.time.size()) {
+      c.time = ch.time;
+    }
+    c.channel.push_back(ch.channel);
+    c.nSamples.push_back(static_cast<int>(ch.amp.size()));
+    c.amp.insert(c.amp.end(), ch.amp.begin(), ch.amp.end());
+
+    const WaveformFeatures &f = ch.features;
+    c.hasSignal.push_back(f.hasSignal ? 1 : 0);
+    c.baseline.push_back(f.baseline);
+    c.rmsNoise.push_back(f.rmsNoise);
+    c.ampMax.push_back(f.ampMax);
+    c.peakTime.push_back(f.peakTime);
+    c.riseTime.push_back(f.riseTime);
+    c.charge.push_back(f.charge);
+    c.signalOverNoise.push_back(f.signalOverNoise);
+    c.timeCFD.insert(c.timeCFD.end(), f.timeCFD.begin(), f.timeCFD.end());
+    c.timeLE.insert(c.timeLE.end(), f.timeLE.begin(), f.timeLE.end());
+    c.timeCharge.insert(c.timeCharge.end(), f.timeCharge.begin(), f.timeCharge.end());
+  }
+
+  tree_->Fill();
+  ++entries_;
+}
+
+void WaveformStoreWriter::Close() {
+  if (!file_) {
+    return;
+  }
+  TDirectory::TContext context(file_);
+  if (tree_) {
+    if (entries_ > 0) {
+      tree_->BuildIndex("event");
+    }
+    tree_->Write();
+  }
+  file_->Close();
+  delete file_;  // also deletes the tree
+  file_ = nullptr;
+  tree_ = nullptr;
+  columns_.reset();
+}
+
+struct WaveformStoreReader::Columns {
+  int event = 0;
+  std::vector<float> *eventAmpMax = nullptr;
+  std::vector<int> *channel = nullptr;
+  std::vector<int> *nSamples = nullptr;
+  std::vector<float> *time = nullptr;
+  std::vector<float> *amp = nullptr;
+  std::vector<char> *hasSignal = nullptr;
+  std::vector<float> *baseline = nullptr;
+  std::vector<float> *rmsNoise = nullptr;
+  std::vector<float> *ampMax = nullptr;
+  std::vector<float> *peakTime = nullptr;
+  std::vector<float> *riseTime = nullptr;
+  std::vector<float> *charge = nullptr;
+  std::vector<float> *signalOverNoise = nullptr;
+  std::vector<float> *timeCFD = nullptr;
+  std::vector<float> *timeLE = nullptr;
+  std::vector<float> *timeCharge = nullptr;
+};
+
+WaveformStoreReader::WaveformStoreReader() = default;
+
+WaveformStoreReader::~WaveformStoreReader() { Close(); }
+
+bool WaveformStoreReader::Open(const std::string &path) {
+  Close();
+
+  TDirectory::TContext context;
+  file_ = TFile::Open(path.c_str(), "READ");
+  if (!file_ || file_->IsZombie()) {
+    std::cerr << "ERROR: cannot open waveform store " << path << std::endl;
+    delete file_;
+    file_ = nullptr;
+    return false;
+  }
+  tree_ = dynamic_cast<TTree *>(file_->Get(kStoreTreeName));
+  if (!tree_) {
+    std::cerr << "ERROR: " << path << " has no " << kStoreTreeName << " tree" << std::endl;
+    Close();
+    return false;
+  }
+
+  columns_.reset(new Columns());
+  Columns &c = *columns_;
+  tree_->SetBranchAddress("event", &c.event);
+  tree_->SetBranchAddress("eventAmpMax", &c.eventAmpMax);
+  tree_->SetBranchAddress("channel", &c.channel);
+  tree_->SetBranchAddress("nSamples", &c.nSamples);
+  tree_->SetBranchAddress("time", &c.time);
+  tree_->SetBranchAddress("amp", &c.amp);
+  tree_->SetBranchAddress("hasSignal", &c.hasSignal);
+  tree_->SetBranchAddress("baseline", &c.baseline);
+  tree_->SetBranchAddress("rmsNoise", &c.rmsNoise);
+  tree_->SetBranchAddress("ampMax", &c.ampMax);
+  tree_->SetBranchAddress("peakTime", &c.peakTime);
+  tree_->SetBranchAddress("riseTime", &c.riseTime);
+  tree_->SetBranchAddress("charge", &c.charge);
+  tree_->SetBranchAddress("signalOverNoise", &c.signalOverNoise);
+  tree_->SetBranchAddress("timeCFD", &c.timeCFD);
+  tree_->SetBranchAddress("timeLE", &c.timeLE);
+  tree_->SetBranchAddress("timeCharge", &c.timeCharge);
+  if (!tree_->GetTreeIndex() && tree_->GetEntries() > 0) {
+    tree_->BuildIndex("event");  // stores written without one
+  }
+  return true;
+}
+
+long long WaveformStoreReader::Entries() const {
+  return tree_ ? tree_->GetEntries() : 0;
+}
+
+long long WaveformStoreReader::EntryOf(int event) const {
+  return tree_ ? tree_->GetEntryNumberWithIndex(event) : -1;
+}
+
+bool WaveformStoreReader::Read(long long entry, EventPlotRecord &record) {
+  if (!tree_ || tree_->GetEntry(entry) <= 0) {
+    return false;
+  }
+  const Columns &c = *columns_;
+  const size_t nStored = c.channel ? c.channel->size() : 0;
+  const size_t nCFD = nStored ? c.timeCFD->size() / nStored : 0;
+  const size_t nLE = nStored ? c.timeLE->size() / nStored : 0;
+  const size_t nCharge = nStored ? c.timeCharge->size() / nStored : 0;
+
+  record.event = c.event;
+  record.ampMax = *c.eventAmpMax;
+  record.channels.resize(nStored);
+
+  size_t offset = 0;
+  for (size_t k = 0; k < nStored; ++k) {
+    ChannelPlotRecord &ch = record.channels[k];
+    const size_t n = static_cast<size_t>((*c.nSamples)[k]);
+    if (offset + n > c.amp->size()) {
+      std::cerr << "ERROR: truncated waveform store entry " << entry << std::endl;
+      return false;
+    }
+    ch.channel = (*c.channel)[k];
+    ch.amp.assign(c.amp->begin() + offset, c.amp->begin() + offset + n);
+    ch.time = *c.time;
+    offset += n;
+
+    WaveformFeatures &f = ch.features;
+    f.hasSignal = (*c.hasSignal)[k] != 0;
+    f.baseline = (*c.baseline)[k];
+    f.rmsNoise = (*c.rmsNoise)[k];
+    f.ampMax = (*c.ampMax)[k];
+    f.peakTime = (*c.peakTime)[k];
+    f.riseTime = (*c.riseTime)[k];
+    f.charge = (*c.charge)[k];
+    f.signalOverNoise = (*c.signalOverNoise)[k];
+    f.timeCFD.assign(c.timeCFD->begin() + k * nCFD, c.timeCFD->begin() + (k + 1) * nCFD);
+    f.timeLE.assign(c.timeLE->begin() + k * nLE, c.timeLE->begin() + (k + 1) * nLE);
+    f.timeCharge.assign(c.timeCharge->begin() + k * nCharge,
+                        c.timeCharge->begin() + (k + 1) * nCharge);
+  }
+  return true;
+}
+
+void WaveformStoreReader::Close() {
+  if (file_) {
+    file_->Close();
+    delete file_;
+  }
+  file_ = nullptr;
+  tree_ = nullptr;
+  columns_.reset();
+}
@@ -0,0 +1,350 @@
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "analysis/waveform_filter.h"
+#include "analysis/waveform_fit.h"
+#include "analysis/waveform_math.h"
+#include "config/analysis_config.h"
+
+// Microbenchmark of the per-channel waveform kernels (waveform_math,
+// waveform_filter, waveform_fit) on synthetic LGAD pulses.
+//
+// Each case generates a pool of distinct noisy pulses with a given record
+// length and SNR; every kernel is run over the pool until --min-time has
+// passed and the mean cost is reported as ns/waveform and waveforms/s.
+// Inputs a kernel depends on (baseline, corrected samples, peak index, ...)
+// are precomputed so each line measures the kernel alone.
+
+namespace {
+
+// DT5742 at 5 GS/s
+constexpr float kSamplePeriodNs = 0.2f;
+// Amplitudes in ADC counts, like the ped-subtracted chXX_ped branches
+constexpr float kNoiseRms = 3.0f;
+constexpr float kBaselineOffset = 5.0f;
+constexpr float kRiseSigmaNs = 0.35f;  // Gaussian leading edge (~0.8 ns 10-90%)
+constexpr float kFallTauNs = 1.2f;     // exponential trailing edge
+constexpr int kChannel = 0;
+
+volatile float gSink = 0.0f;
+
+struct BenchWaveform {
+  std::vector<float> amp;      // raw samples (baseline offset + pulse + noise)
+  std::vector<float> ampCorr;  // baseline-subtracted
+  float baseline = 0.0f;
+  float rmsNoise = 0.0f;
+  float ampMax = 0.0f;
+  int peakIndex = 0;
+  float charge = 0.0f;
+  std::vector<double> peakX;   // samples within +-0.4 ns of the peak (pol2 fit input)
+  std::vector<double> peakY;
+};
+
+struct BenchCase {
+  int nSamples = 0;
+  float snr = 0.0f;
+  std::vector<float> time;
+  std::vector<BenchWaveform> pool;
+  AnalysisConfig cfg;
+  AnalysisConfig rejectCfg;  // early reject threshold above every pulse
+  WindowIndices baselineWindow;
+  WindowIndices signalWindow;
+  WindowIndices chargeWindow;
+};
+
+struct BenchKernel {
+  std::string name;
+  std::function<float(BenchCase &, BenchWaveform &)> run;
+};
+
+void PrintUsage(const char *prog) {
+  std::cout << "Benchmark of the waveform analysis kernels on synthetic LGAD pulses\n"
+            << "Usage: " << prog << " [options]\n"
+            << "Options:\n"
+            << "  --lengths L1,L2,...  Record lengths in samples (default: 256,512,1024)\n"
+            << "  --snr S1,S2,...      Pulse amplitude over noise RMS (default: 5,20,100)\n"
+            << "  --kernel NAME        Run only kernels whose name contains NAME\n"
+            << "  --min-time SEC       Minimum run time per kernel and case (default: 0.2)\n"
+            << "  --pool N             Distinct waveforms per case (default: 256)\n"
+            << "  -h, --help           Show this help message\n";
+}
+
+template <typename T>
+bool ParseList(const std::string &text, std::vector<T> &values) {
+  values.clear();
+  std::stringstream ss(text);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    try {
+      values.push_back(static_cast<T>(std::stod(item)));
+    } catch (...) {
+      return false;
+    }
+  }
+  return !values.empty();
+}
+
+BenchCase MakeCase(int nSamples, float snr, int poolSize, std::mt19937 &rng) {
+  BenchCase bc;
+  bc.nSamples = nSamples;
+  bc.snr = snr;
+  bc.time.resize(nSamples);
+  for (int i = 0; i < nSamples; ++i) {
+    bc.time[i] = i * kSamplePeriodNs;
+  }
+  const float recordNs = nSamples * kSamplePeriodNs;
+
+  // Baseline in the first quarter of the record, signal and charge after it
+  AnalysisConfig &cfg = bc.cfg;
+  cfg.analysis_region_min[kChannel] = 0.0f;
+  cfg.analysis_region_max[kChannel] = recordNs;
+  cfg.baseline_region_min[kChannel] = 0.0f;
+  cfg.baseline_region_max[kChannel] = 0.25f * recordNs;
+  cfg.signal_region_min[kChannel] = 0.25f * recordNs;
+  cfg.signal_region_max[kChannel] = recordNs;
+  cfg.charge_region_min[kChannel] = 0.25f * recordNs;
+  cfg.charge_region_max[kChannel] = recordNs;
+  cfg.signal_polarity[kChannel] = 1;
+  cfg.cut_amp_max[kChannel] = 2.0f * kNoiseRms;
+  bc.rejectCfg = cfg;
+  bc.rejectCfg.early_reject_threshold = 1e9f;
+
+  bc.baselineWindow = BuildWindowIndices(bc.time, cfg.baseline_region_min[kChannel],
+                                         cfg.baseline_region_max[kChannel], 0, nSamples - 1);
+  bc.signalWindow = BuildWindowIndices(bc.time, cfg.signal_region_min[kChannel],
+                                       cfg.signal_region_max[kChannel], 0, nSamples - 1);
+  bc.chargeWindow = BuildWindowIndices(bc.time, cfg.charge_region_min[kChannel],
+                                       cfg.charge_region_max[kChannel], 0, nSamples - 1);
+
+  std::normal_distribution<float> noise(0.0f, kNoiseRms);
+  std::uniform_real_distribution<float> peakJitter(-0.5f, 0.5f);
+  const float amplitude = snr * kNoiseRms;
+  const float dt = kSamplePeriodNs;
+
+  bc.pool.resize(poolSize);
+  for (BenchWaveform &wf : bc.pool) {
+    const float peakTime = 0.4f * recordNs + peakJitter(rng);
+    wf.amp.resize(nSamples);
+    for (int i = 0; i < nSamples; ++i) {
+      const float t = bc.time[i] - peakTime;
+      const float pulse = (t < 0.0f)
+                              ? std::exp(-0.5f * (t / kRiseSigmaNs) * (t / kRiseSigmaNs))
+                              : std::exp(-t / kFallTauNs);
+      wf.amp[i] = kBaselineOffset + amplitude * pulse + noise(rng);
+    }
+
+    BaselineNoiseMetrics metrics = ComputeBaselineAndNoise(wf.amp, bc.baselineWindow);
+    wf.baseline = metrics.baseline;
+    wf.rmsNoise = metrics.rms_noise;
+    wf.ampCorr = ApplyBaselineAndPolarity(wf.amp, wf.baseline, 1);
+    PeakMetrics peak = FindPeakInWindow(wf.ampCorr, bc.time, bc.signalWindow);
+    wf.ampMax = peak.amplitude;
+    wf.peakIndex = peak.index;
+    wf.charge = IntegrateChargeWindow(wf.ampCorr, bc.chargeWindow, dt, cfg.impedance);
+    for (int i = 0; i < nSamples; ++i) {
+      if (std::abs(bc.time[i] - peak.time) <= 0.4f) {
+        wf.peakX.push_back(bc.time[i]);
+        wf.peakY.push_back(wf.ampCorr[i]);
+      }
+    }
+  }
+  return bc;
+}
+
+std::vector<BenchKernel> MakeKernels() {
+  std::vector<BenchKernel> kernels;
+  const float dt = kSamplePeriodNs;
+
+  kernels.push_back({"ComputeBaselineAndNoise", [](BenchCase &bc, BenchWaveform &wf) {
+    return ComputeBaselineAndNoise(wf.amp, bc.baselineWindow).rms_noise;
+  }});
+  kernels.push_back({"ApplyBaselineAndPolarity", [](BenchCase &, BenchWaveform &wf) {
+    return ApplyBaselineAndPolarity(wf.amp, wf.baseline, 1).back();
+  }});
+  kernels.push_back({"FindPeakInWindow", [](BenchCase &bc, BenchWaveform &wf) {
+    return FindPeakInWindow(wf.ampCorr, bc.time, bc.signalWindow).amplitude;
+  }});
+  kernels.push_back({"IntegrateChargeWindow", [dt](BenchCase &bc, BenchWaveform &wf) {
+    return IntegrateChargeWindow(wf.ampCorr, bc.chargeWindow, dt, bc.cfg.impedance);
+  }});
+  kernels.push_back({"ComputeChargeFractionTimes", [dt](BenchCase &bc, BenchWaveform &wf) {
+    return ComputeChargeFractionTimes(wf.ampCorr, bc.time, bc.chargeWindow, dt,
+                                      bc.cfg.impedance, wf.charge, bc.cfg.charge_thresholds,
+                                      bc.cfg.charge_region_min[kChannel],
+                                      bc.cfg.charge_region_max[kChannel]).front();
+  }});
+  kernels.push_back({"FindThresholdCrossingBackward", [](BenchCase &bc, BenchWaveform &wf) {
+    return FindThresholdCrossingBackward(wf.ampCorr, bc.time, wf.peakIndex,
+                                         bc.signalWindow.start, 0.5f * wf.ampMax,
+                                         wf.rmsNoise).time;
+  }});
+  kernels.push_back({"FindTrailingEdgeForward", [](BenchCase &bc, BenchWaveform &wf) {
+    return FindTrailingEdgeForward(wf.ampCorr, bc.time, wf.peakIndex,
+                                   bc.signalWindow.end, 0.5f * wf.ampMax).time;
+  }});
+  kernels.push_back({"MaxDeviationInWindow", [](BenchCase &bc, BenchWaveform &wf) {
+    return MaxDeviationInWindow(wf.amp, bc.signalWindow, wf.baseline, 1);
+  }});
+
+  // The filters work in place: both lines include copying the corrected
+  // samples into a preallocated buffer
+  kernels.push_back({"ApplyFirFilter (7 taps)", [](BenchCase &, BenchWaveform &wf) {
+    static const std::vector<float> taps = {1.f / 64, 6.f / 64, 15.f / 64, 20.f / 64,
+                                            15.f / 64, 6.f / 64, 1.f / 64};
+    static thread_local std::vector<float> samples;
+    static thread_local std::vector<float> scratch;
+    samples.assign(wf.ampCorr.begin(), wf.ampCorr.end());
+    ApplyFirFilter(samples, taps, scratch);
+    return samples[wf.peakIndex];
+  }});
+  kernels.push_back({"ApplyBiquadFilter", [](BenchCase &, BenchWaveform &wf) {
+    // 2nd-order Butterworth low-pass at 0.1 fs
+    static const std::vector<float> coeffs = {0.0675f, 0.1349f, 0.0675f, -1.1430f, 0.4128f};
+    static thread_local std::vector<float> samples;
+    samples.assign(wf.ampCorr.begin(), wf.ampCorr.end());
+    ApplyBiquadFilter(samples, coeffs);
+    return samples[wf.peakIndex];
+  }});
+
+  kernels.push_back({"AnalyzeWaveform", [](BenchCase &bc, BenchWaveform &wf) {
+    return AnalyzeWaveform(wf.amp, bc.time, bc.cfg, kChannel).ampMax;
+  }});
+  kernels.push_back({"AnalyzeWaveform (early reject)", [](BenchCase &bc, BenchWaveform &wf) {
+    // The cost of a channel that is rejected
+    return AnalyzeWaveform(wf.amp, bc.time, bc.rejectCfg, kChannel).ampMax;
+  }});
+
+  kernels.push_back({"FitPol2Analytical", [](BenchCase &, BenchWaveform &wf) {
+    double a0 = 0.0;
+    double a1 = 0.0;
+    double a2 = 0.0;
+    FitPol2Analytical(wf.peakX.data(), wf.peakY.data(), static_cast<int>(wf.peakX.size()),
+                      a0, a1, a2);
+    return static_cast<float>(a0);
+  }});
+  kernels.push_back({"ComputeFitFeatures", [](BenchCase &bc, BenchWaveform &wf) {
+    return ComputeFitFeatures(wf.amp, bc.time, wf.baseline, 1, 1, bc.cfg.cfd_thresholds,
+                              bc.cfg.rise_time_low, bc.cfg.rise_time_high).ampMax_Fit;
+  }});
+  return kernels;
+}
+
+// Mean ns per waveform of one kernel over whole passes of the pool
+double TimeKernel(const BenchKernel &kernel, BenchCase &bc, double minSeconds) {
+  using Clock = std::chrono::steady_clock;
+  // Warm-up pass (caches, thread_local buffers)
+  float sink = 0.0f;
+  for (BenchWaveform &wf : bc.pool) {
+    sink += kernel.run(bc, wf);
+  }
+
+  long long calls = 0;
+  double elapsed = 0.0;
+  const auto start = Clock::now();
+  do {
+    for (BenchWaveform &wf : bc.pool) {
+      sink += kernel.run(bc, wf);
+    }
+    calls += static_cast<long long>(bc.pool.size());
+    elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  } while (elapsed < minSeconds);
+  gSink = gSink + sink;
+  return elapsed * 1e9 / static_cast<double>(calls);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<int> lengths = {256, 512, 1024};
+  std::vector<float> snrs = {5.0f, 20.0f, 100.0f};
+  std::string kernelFilter;
+  double minSeconds = 0.2;
+  int poolSize = 256;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--help" || arg == "-h") {
+      PrintUsage(argv[0]);
+      return 0;
+    } else if (arg == "--lengths" || arg == "--snr" || arg == "--kernel" ||
+               arg == "--min-time" || arg == "--pool") {
+      if (i + 1 >= argc) {
+        std::cerr << "ERROR: " << arg << " requires a value" << std::endl;
+        return 1;
+      }
+      const std::string value = argv[++i];
+      bool ok = true;
+      if (arg == "--lengths") {
+        ok = ParseList(value, lengths);
+      } else if (arg == "--snr") {
+        ok = ParseList(value, snrs);
+      } else if (arg == "--kernel") {
+        kernelFilter = value;
+      } else {
+        try {
+          if (arg == "--min-time") {
+            minSeconds = std::stod(value);
+          } else {
+            poolSize = std::stoi(value);
+          }
+        } catch (...) {
+          ok = false;
+        }
+      }
+      if (!ok) {
+        std::cerr << "ERROR: invalid value for " << arg << ": " << value << std::endl;
+        return 1;
+      }
+    } else {
+      std::cerr << "ERROR: unknown option " << arg << std::endl;
+      PrintUsage(argv[0]);
+      return 1;
+    }
+  }
+
+  for (int n : lengths) {
+    if (n < 16) {
+      std::cerr << "ERROR: record length must be at least 16 samples" << std::endl;
+      return 1;
+    }
+  }
+  if (poolSize < 1) {
+    std::cerr << "ERROR: --pool must be positive" << std::endl;
+    return 1;
+  }
+
+  const std::vector<BenchKernel> kernels = MakeKernels();
+  std::mt19937 rng(42);
+
+  std::cout << std::left << std::setw(32) << "kernel"
+            << std::right << std::setw(9) << "samples"
+            << std::setw(7) << "snr"
+            << std::setw(14) << "ns/waveform"
+            << std::setw(16) << "waveforms/s" << "\n";
+  std::cout << std::fixed;
+  for (int nSamples : lengths) {
+    for (float snr : snrs) {
+      BenchCase bc = MakeCase(nSamples, snr, poolSize, rng);
+      for (const BenchKernel &kernel : kernels) {
+        if (!kernelFilter.empty() && kernel.name.find(kernelFilter) == std::string::npos) {
+          continue;
+        }
+        const double nsPerWaveform = TimeKernel(kernel, bc, minSeconds);
+        std::cout << std::left << std::setw(32) << kernel.name
+                  << std::right << std::setw(9) << nSamples
+                  << std::setw(7) << std::setprecision(0) << snr
+                  << std::setw(14) << std::setprecision(1) << nsPerWaveform
+                  << std::setw(16) << std::setprecision(0) << 1e9 / nsPerWaveform
+                  << std::endl;
+      }
+    }
+  }
+  return 0;
+}
@@ -16,6 +16,7 @@
 
 #include "config/wave_converter_config.h"
 #include "utils/file_io.h"
+#include "utils/perf_timer.h"
 
 using namespace std;
 
@@ -32,6 +33,27 @@ std::string to6digits(int n) {
   
 bool kSetEventLimit = false;
 
+// Sections of the performance report (--perf)
+const PerfSection kPerfRead("read");
+const PerfSection kPerfPedestal("pedestal");
+const PerfSection kPerfFill("Fill");
+const PerfSection kPerfWrite("write");
+
+// Bytes consumed from the channel inputs
+long long BytesConsumed(std::vector<std::ifstream> &fins) {
+  long long total = 0;
+  for (auto &fin : fins) {
+    if (fin.is_open()) {
+      fin.clear();
+      const std::streamoff pos = fin.tellg();
+      if (pos > 0) {
+        total += pos;
+      }
+    }
+  }
+  return total;
+}
+
 void CheckEventLimit(const WaveConverterConfig &cfg){
   if ( cfg.max_events() < 0) {
     kSetEventLimit = false;
@@ -219,10 +241,13 @@ bool ConvertBinaryToRoot(const WaveConverterConfig &cfg) {
     std::vector<int> samplesThisEvent(cfg.n_channels(), 0);
     bool anyEof = false;
 
-    for (int ch = 0; ch < cfg.n_channels(); ++ch) {
-      if (!ReadHeader(fins[ch], headers[ch])) {
-        channelEof[ch] = true;
-        anyEof = true;
+    {
+      PerfScope scope(kPerfRead);
+      for (int ch = 0; ch < cfg.n_channels(); ++ch) {
+        if (!ReadHeader(fins[ch], headers[ch])) {
+          channelEof[ch] = true;
+          anyEof = true;
+        }
       }
     }
 
@@ -375,19 +400,22 @@ bool ConvertBinaryToRoot(const WaveConverterConfig &cfg) {
     std::vector<bool> readFailed(cfg.n_channels(), false);
     bool anyReadFailed = false;
 
-    for (int ch = 0; ch < cfg.n_channels(); ++ch) {
-      const int nsampCh = samplesThisEvent[ch];
-
-      auto &buffer = readBuffers[ch];
-      buffer.resize(nsampCh);
-      fins[ch].read(reinterpret_cast<char *>(buffer.data()),
-                    nsampCh * sizeof(float));
-      if (!fins[ch].good()) {
-        readFailed[ch] = true;
-        anyReadFailed = true;
-      } else {
-        raw[ch] = std::move(buffer);
-        buffer.clear();
+    {
+      PerfScope scope(kPerfRead);
+      for (int ch = 0; ch < cfg.n_channels(); ++ch) {
+        const int nsampCh = samplesThisEvent[ch];
+
+        auto &buffer = readBuffers[ch];
+        buffer.resize(nsampCh);
+        fins[ch].read(reinterpret_cast<char *>(buffer.data()),
+                      nsampCh * sizeof(float));
+        if (!fins[ch].good()) {
+          readFailed[ch] = true;
+          anyReadFailed = true;
+        } else {
+          raw[ch] = std::move(buffer);
+          buffer.clear();
+        }
       }
     }
 
@@ -404,34 +432,39 @@ bool ConvertBinaryToRoot(const WaveConverterConfig &cfg) {
     }
 
     // Calculate pedestals and pedestal-subtracted waveforms
-    for (int ch = 0; ch < cfg.n_channels(); ++ch) {
-      const int nsampCh = samplesThisEvent[ch];
-      const int pedWindow = std::max(1, cfg.pedestal_window);
-      const int nPed = std::min(nsampCh, pedWindow);
-      double pedVal = 0.0;
-      for (int i = 0; i < nPed; ++i) {
-        pedVal += raw[ch][i];
-      }
-      pedVal /= static_cast<double>(nPed);
-      pedestals[ch] = static_cast<float>(pedVal);
+    {
+      PerfScope scope(kPerfPedestal);
+      for (int ch = 0; ch < cfg.n_channels(); ++ch) {
+        const int nsampCh = samplesThisEvent[ch];
+        const int pedWindow = std::max(1, cfg.pedestal_window);
+        const int nPed = std::min(nsampCh, pedWindow);
+        double pedVal = 0.0;
+        for (int i = 0; i < nPed; ++i) {
+          pedVal += raw[ch][i];
+        }
+        pedVal /= static_cast<double>(nPed);
+        pedestals[ch] = static_cast<float>(pedVal);
 
-      raw[ch].resize(maxSamples, pedestals[ch]);
-      ped[ch].resize(maxSamples);
-      for (int i = 0; i < nsampCh; ++i) {
-        ped[ch][i] = raw[ch][i] - pedestals[ch] + pedTarget;
-      }
-      for (int i = nsampCh; i < maxSamples; ++i) {
-        ped[ch][i] = pedTarget;
+        raw[ch].resize(maxSamples, pedestals[ch]);
+        ped[ch].resize(maxSamples);
+        for (int i = 0; i < nsampCh; ++i) {
+          ped[ch][i] = raw[ch][i] - pedestals[ch] + pedTarget;
+        }
+        for (int i = nsampCh; i < maxSamples; ++i) {
+          ped[ch][i] = pedTarget;
+        }
       }
     }
 
     eventIdx = eventCount;
     if (!skipEvent) {
+      PerfScope scope(kPerfFill);
       tree->Fill();
     }
     ++eventCount;
   }
 
+  PerfAddBytesRead(BytesConsumed(fins));
   for (auto &fin : fins) {
     if (fin.is_open()) {
       fin.close();
@@ -452,12 +485,18 @@ bool ConvertBinaryToRoot(const WaveConverterConfig &cfg) {
     return false;
   }
 
-  file->cd();
-  tree->Write();
-  file->Close();
+  {
+    PerfScope scope(kPerfWrite);
+    file->cd();
+    tree->Write();
+    file->Close();
+  }
   delete file;
 
   std::cout << "Stage 1: ROOT file written with " << eventCount << " events." << std::endl;
+  PerfAddEvents(eventCount);
+  PerfAddBytesWritten(FileSizeBytes(outputPath));
+  WritePerfReport(PerfReportPath(outputPath), "convert_to_root");
   return true;
 }
 
@@ -569,19 +608,22 @@ bool ConvertBinaryToRootParallel(const WaveConverterConfig &cfg) {
     std::vector<std::vector<BinaryEventData>> chunkData(cfg.n_channels());
 
     int maxThreads = std::min(cfg.max_cores(), cfg.n_channels());
-    for (int ch = 0; ch < cfg.n_channels(); ch += maxThreads) {
-      threads.clear();
-      for (int t = 0; t < maxThreads && (ch + t) < cfg.n_channels(); ++t) {
-        int chIdx = ch + t;
-        threads.emplace_back([&, chIdx]() {
-          if (!channelEof[chIdx]) {
-            ReadChannelChunk(fins[chIdx], fileMutexes[chIdx], cfg.chunk_size(),
-                           chunkData[chIdx], channelEof[chIdx]);
-          }
-        });
-      }
-      for (auto &thread : threads) {
-        thread.join();
+    {
+      PerfScope scope(kPerfRead);
+      for (int ch = 0; ch < cfg.n_channels(); ch += maxThreads) {
+        threads.clear();
+        for (int t = 0; t < maxThreads && (ch + t) < cfg.n_channels(); ++t) {
+          int chIdx = ch + t;
+          threads.emplace_back([&, chIdx]() {
+            if (!channelEof[chIdx]) {
+              ReadChannelChunk(fins[chIdx], fileMutexes[chIdx], cfg.chunk_size(),
+                             chunkData[chIdx], channelEof[chIdx]);
+            }
+          });
+        }
+        for (auto &thread : threads) {
+          thread.join();
+        }
       }
     }
 
@@ -748,37 +790,41 @@ bool ConvertBinaryToRootParallel(const WaveConverterConfig &cfg) {
         }
       }
 
-      for (int ch = 0; ch < cfg.n_channels(); ++ch) {
-        auto &evtData = chunkData[ch][evt];
-        const int nsampCh = samplesThisEvent[ch];
-
-        boardIds[ch] = evtData.boardId;
-        channelIds[ch] = evtData.channelId;
-        eventCounters[ch] = evtData.eventCounter;
-	raw[ch] = std::move(evtData.samples);
-	evtData.samples.clear();
-
-        // Calculate pedestal
-        const int nPed = std::min<int>(raw[ch].size(), pedWindow);
-        double pedVal = 0.0;
-        for (int i = 0; i < nPed; ++i) {
-	  pedVal += raw[ch][i];
-        }
-        pedVal /= static_cast<double>(std::max(1, nPed));
-        pedestals[ch] = static_cast<float>(pedVal);
-
-        // Pedestal-subtracted waveform
-        raw[ch].resize(maxSamples, pedestals[ch]);
-        ped[ch].resize(maxSamples);
-        for (int i = 0; i < nsampCh; ++i) {
-          ped[ch][i] = raw[ch][i] - pedestals[ch] + pedTarget;
-        }
-        for (int i = nsampCh; i < maxSamples; ++i) {
-          ped[ch][i] = pedTarget;
+      {
+        PerfScope scope(kPerfPedestal);
+        for (int ch = 0; ch < cfg.n_channels(); ++ch) {
+          auto &evtData = chunkData[ch][evt];
+          const int nsampCh = samplesThisEvent[ch];
+
+          boardIds[ch] = evtData.boardId;
+          channelIds[ch] = evtData.channelId;
+          eventCounters[ch] = evtData.eventCounter;
+          raw[ch] = std::move(evtData.samples);
+          evtData.samples.clear();
+
+          // Calculate pedestal
+          const int nPed = std::min<int>(raw[ch].size(), pedWindow);
+          double pedVal = 0.0;
+          for (int i = 0; i < nPed; ++i) {
+            pedVal += raw[ch][i];
+          }
+          pedVal /= static_cast<double>(std::max(1, nPed));
+          pedestals[ch] = static_cast<float>(pedVal);
+
+          // Pedestal-subtracted waveform
+          raw[ch].resize(maxSamples, pedestals[ch]);
+          ped[ch].resize(maxSamples);
+          for (int i = 0; i < nsampCh; ++i) {
+            ped[ch][i] = raw[ch][i] - pedestals[ch] + pedTarget;
+          }
+          for (int i = nsampCh; i < maxSamples; ++i) {
+            ped[ch][i] = pedTarget;
+          }
         }
       }
 
       if (!skipEvent) {
+        PerfScope scope(kPerfFill);
         eventIdx = totalEventsProcessed;
         tree->Fill();
         ++totalEventsProcessed;
@@ -790,6 +836,7 @@ bool ConvertBinaryToRootParallel(const WaveConverterConfig &cfg) {
               << " events (total: " << totalEventsProcessed << ")" << std::endl;
   }
 
+  PerfAddBytesRead(BytesConsumed(fins));
   for (auto &fin : fins) {
     if (fin.is_open()) {
       fin.close();
@@ -803,13 +850,19 @@ bool ConvertBinaryToRootParallel(const WaveConverterConfig &cfg) {
     return false;
   }
 
-  file->cd();
-  tree->Write();
-  file->Close();
+  {
+    PerfScope scope(kPerfWrite);
+    file->cd();
+    tree->Write();
+    file->Close();
+  }
   delete file;
 
   std::cout << "Stage 1: ROOT file written with " << totalEventsProcessed
             << " events (parallel mode)." << std::endl;
+  PerfAddEvents(totalEventsProcessed);
+  PerfAddBytesWritten(FileSizeBytes(outputPath));
+  WritePerfReport(PerfReportPath(outputPath), "convert_to_root");
   return true;
 }
 
@@ -887,11 +940,13 @@ bool ConvertAsciiToRoot(const WaveConverterConfig &cfg) {
 
   for (int ch = 0; ch < cfg.n_channels(); ++ch) {
     const std::string fname = BuildFileName(cfg, ch);
+    PerfScope scope(kPerfRead);
     if (!LoadAsciiChannelFile(fname, channelEvents[ch])) {
       file->Close();
       delete file;
       return false;
     }
+    PerfAddBytesRead(FileSizeBytes(fname));
     std::cout << "Loaded ASCII input " << fname << " with "
               << channelEvents[ch].size() << " event(s)." << std::endl;
 
@@ -1028,45 +1083,55 @@ bool ConvertAsciiToRoot(const WaveConverterConfig &cfg) {
       }
     }
 
-    for (int ch = 0; ch < cfg.n_channels(); ++ch) {
-      const auto &block = channelEvents[ch][evt];
-      const int nsampCh = samplesThisEvent[ch];
-      boardIds[ch] = block.boardId;
-      channelIds[ch] = block.channelId;
-      eventCounters[ch] = block.eventCounter;
-      raw[ch] = std::move(block.samples);
-
-      const int nPed = std::min<int>(raw[ch].size(), pedWindow);
-      double pedVal = 0.0;
-      for (int i = 0; i < nPed; ++i) {
-        pedVal += raw[ch][i];
-      }
-      pedVal /= static_cast<double>(std::max(1, nPed));
-      pedestals[ch] = static_cast<float>(pedVal);
+    {
+      PerfScope scope(kPerfPedestal);
+      for (int ch = 0; ch < cfg.n_channels(); ++ch) {
+        const auto &block = channelEvents[ch][evt];
+        const int nsampCh = samplesThisEvent[ch];
+        boardIds[ch] = block.boardId;
+        channelIds[ch] = block.channelId;
+        eventCounters[ch] = block.eventCounter;
+        raw[ch] = std::move(block.samples);
 
-      raw[ch].resize(maxSamples, pedestals[ch]);
-      ped[ch].resize(maxSamples);
-      for (int i = 0; i < nsampCh; ++i) {
-        ped[ch][i] = raw[ch][i] - pedestals[ch] + pedTarget;
-      }
-      for (int i = nsampCh; i < maxSamples; ++i) {
-        ped[ch][i] = pedTarget;
+        const int nPed = std::min<int>(raw[ch].size(), pedWindow);
+        double pedVal = 0.0;
+        for (int i = 0; i < nPed; ++i) {
+          pedVal += raw[ch][i];
+        }
+        pedVal /= static_cast<double>(std::max(1, nPed));
+        pedestals[ch] = static_cast<float>(pedVal);
+
+        raw[ch].resize(maxSamples, pedestals[ch]);
+        ped[ch].resize(maxSamples);
+        for (int i = 0; i < nsampCh; ++i) {
+          ped[ch][i] = raw[ch][i] - pedestals[ch] + pedTarget;
+        }
+        for (int i = nsampCh; i < maxSamples; ++i) {
+          ped[ch][i] = pedTarget;
+        }
       }
     }
 
     if (!skipEvent) {
+      PerfScope scope(kPerfFill);
       eventIdx = static_cast<int>(evt);
       tree->Fill();
     }
   }
 
-  file->cd();
-  tree->Write();
-  file->Close();
+  {
+    PerfScope scope(kPerfWrite);
+    file->cd();
+    tree->Write();
+    file->Close();
+  }
   delete file;
 
   std::cout << "Stage 1: ROOT file written with " << expectedEvents
             << " events (ASCII input)." << std::endl;
+  PerfAddEvents(static_cast<long long>(expectedEvents));
+  PerfAddBytesWritten(FileSizeBytes(outputPath));
+  WritePerfReport(PerfReportPath(outputPath), "convert_to_root");
   return true;
 }
 
@@ -1086,6 +1151,7 @@ void PrintUsage(const char *prog) {
             << "  --parallel          Enable parallel loading (binary mode only)\n"
             << "  --chunk-size N      Set chunk size for parallel loading (default: 1000)\n"
             << "  --max-threads N     Set maximum threads for parallel loading\n"
+            << "  --perf              Time the conversion stages and write <output>.perf.json\n"
             << "  -h, --help          Show this help message\n";
 }
 
@@ -1121,6 +1187,8 @@ CliOutcome ApplyCommandLineArgs(int argc, char **argv, WaveConverterConfig &cfg)
         return CliOutcome::kError;
       }
       cfg.input_pattern = val;
+    } else if (arg == "--perf") {
+      EnablePerf();
     } else if (arg == "--channels") {
       const char *val = requireValue("--channels");
       if (!val) {
@@ -1,5 +1,7 @@
 
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <algorithm>
 #include <iostream>
 #include <string>
@@ -7,28 +9,179 @@
 #include <set>
 #include <map>
 #include <fstream>
+#include <functional>
+#include <limits>
+#include <memory>
 #include <regex>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "TBranch.h"
 #include "TFile.h"
+#include "TLeaf.h"
+#include "TObjArray.h"
+#include "TROOT.h"
 #include "TTree.h"
 
+#include "TList.h"
+
+#include "analysis/analysis_tree_layout.h"
+#include "config/calibration_table.h"
 #include "utils/filesystem_utils.h"
 #include "hdf5.h"
+#include "utils/hdf5_chunk_encoder.h"
+#include "utils/hdf5_feature_rows.h"
+#include "utils/hdf5_utils.h"
+#include "utils/hdf5_write_queue.h"
 #include "utils/json_utils.h"
+#include "utils/npy_writer.h"
+#include "utils/perf_timer.h"
 
 using namespace std;
 
 namespace {
 
+// Sections of the performance report (--perf)
+const PerfSection kPerfGetEntry("GetEntry");
+const PerfSection kPerfWrite("H5Dwrite");
+
+// ADC-to-mV calibration applied at export time. When inactive (no table
+// loaded) the _mV branches written by Stage 2 are exported as stored.
+struct ExportCalibration {
+  std::string version;
+  std::vector<CalibPol1> channels;
+  bool override = false;  // true: recompute even where _mV branches are stored
+
+  bool Active() const { return !channels.empty(); }
+};
+
+inline bool LoadExportCalibration(const std::string &file,
+                                  const std::string &daqName,
+                                  int nChannels,
+                                  bool override,
+                                  ExportCalibration &calib) {
+  CalibrationTable table;
+  std::string err;
+  if (!LoadCalibrationTableFromJson(file, table, &err)) {
+    std::cerr << "ERROR: " << err << std::endl;
+    return false;
+  }
+  // Without the DAQ entry the _mV columns would hold raw values
+  if (daqName.empty()) {
+    std::cerr << "ERROR: no DAQ name for calibration table " << file
+              << " (use --daq-name or --sensor-mapping)" << std::endl;
+    return false;
+  }
+  if (table.daqs.find(daqName) == table.daqs.end()) {
+    std::cerr << "ERROR: calibration table " << table.version << " has no entry for '"
+              << daqName << "'" << std::endl;
+    return false;
+  }
+  calib.version = table.version;
+  calib.channels = table.ChannelsFor(daqName, nChannels);
+  calib.override = override;
+  std::cout << "Calibration table " << table.version << " (" << daqName << ") loaded from "
+            << file << std::endl;
+  return true;
+}
+
+// One _mV feature column of the Analysis tree. Trees produced with
+// calibration_mode = "deferred" carry only the raw-unit branch; the _mV values
+// are then computed per entry from the external calibration table.
+class MilliVoltColumn {
+public:
+  // rawSlot: caller-owned pointer already bound to the raw branch, if any.
+  bool Bind(TTree *tree, const std::string &rawName, CalibRule rule,
+            const ExportCalibration *calib, std::vector<float> **rawSlot = nullptr) {
+    const std::string storedName = rawName + "_mV";
+    rule_ = rule;
+    calib_ = nullptr;
+    stored_ = nullptr;
+    raw_ = nullptr;
+    rawSlot_ = rawSlot ? rawSlot : &raw_;
+    branchNames_.clear();
+
+    const bool hasStored = tree->GetBranch(storedName.c_str()) != nullptr;
+    if (calib && calib->Active() && (calib->override || !hasStored)) {
+      if (!tree->GetBranch(rawName.c_str())) {
+        std::cerr << "WARNING: branch " << rawName << " not found, cannot compute "
+                  << storedName << std::endl;
+        return false;
+      }
+      if (!rawSlot) {
+        tree->SetBranchAddress(rawName.c_str(), &raw_);
+      }
+      calib_ = calib;
+      branchNames_.push_back(rawName);
+      return true;
+    }
+    if (hasStored) {
+      tree->SetBranchAddress(storedName.c_str(), &stored_);
+      branchNames_.push_back(storedName);
+      return true;
+    }
+    std::cerr << "WARNING: " << storedName << " is not stored in the tree and no calibration "
+              << "table was given (--calibration), exporting zeros" << std::endl;
+    return false;
+  }
+
+  bool Computed() const { return calib_ != nullptr; }
+
+  // Branch read by this column (for ReadOnlyBranches)
+  const std::vector<std::string> &BranchNames() const { return branchNames_; }
+
+  // Values of the current entry (after tree->GetEntry()), nullptr if unavailable.
+  const std::vector<float> *Values() {
+    if (!calib_) {
+      return stored_;
+    }
+    if (!*rawSlot_) {
+      return nullptr;
+    }
+    ApplyCalibration(rule_, **rawSlot_, calib_->channels, computed_);
+    return &computed_;
+  }
+
+private:
+  CalibRule rule_ = CalibRule::kScaleOrRaw;
+  const ExportCalibration *calib_ = nullptr;
+  std::vector<float> *stored_ = nullptr;
+  std::vector<float> *raw_ = nullptr;
+  std::vector<float> **rawSlot_ = &raw_;
+  std::vector<float> computed_;
+  std::vector<std::string> branchNames_;
+};
+
+// Calibration version recorded by Stage 2 in the tree's UserInfo list.
+inline std::string TreeCalibrationVersion(TTree *tree) {
+  TObject *obj = tree->GetUserInfo()->FindObject("calibration_version");
+  return obj ? obj->GetTitle() : "unknown";
+}
+
+// Disable every branch the exporter does not read (see ReadOnlyBranches)
+inline void PruneTreeBranches(TTree *tree, const std::vector<std::string> &names) {
+  TObjArray *branches = tree->GetListOfBranches();
+  const int total = branches ? branches->GetEntries() : 0;
+  const int enabled = ReadOnlyBranches(tree, names);
+  std::cout << "Reading " << enabled << " of " << total << " branches" << std::endl;
+}
+
 // Structure to hold DAQ configuration and paths
 struct DaqConfig {
   std::string configPath;
   std::string rootFilePath;
   std::string daqName;
+  std::string calibrationFile;  // common.calibration_file, resolved against configPath
   int nChannels;
   std::vector<int> sensorIds;
   std::vector<int> columnIds;
   std::vector<int> stripIds;
+  ExportCalibration calibration;
 };
 
 // Helper function to extract paths and sensor mapping from config JSON
@@ -72,6 +225,10 @@ inline bool ExtractDaqConfig(const std::string &configPath,
 
   daqConfig.daqName = daqName;
 
+  std::string calibrationFile;
+  GetString(common, "calibration_file", calibrationFile);
+  daqConfig.calibrationFile = ResolvePathRelativeTo(configPath, calibrationFile);
+
   // Build ROOT file path: outputDir/runnumber/daqName/output/root/rootFileName
   char runDirBuf[32];
   std::snprintf(runDirBuf, sizeof(runDirBuf), "%06d", static_cast<int>(runnumber));
@@ -144,39 +301,169 @@ struct WaveformMeta {
   uint32_t event_counter;
   float pedestal;
 };
+#pragma pack(pop)
 
-struct AnalysisFeatureMeta {
-  uint32_t event;
-  uint16_t channel;
-  uint16_t sensor_id;
-  uint16_t column_id;
-  uint16_t strip_id;
-  float baseline;
-  float rmsNoise;
-  float rmsNoise_mV;
-  float noise1Point;
-  float ampMinBefore;
-  float ampMaxBefore;
-  float ampMax;
-  float ampMax_Fit_mV;
-  float charge;
-  float signalOverNoise;
-  float peakTime;
-  float riseTime;
-  float riseTime_Fit;
-  float slewRate;
-  float slewRate_Fit_mV;
-  float timeCFD_50pc;
-  float timeCFD_Fit_50pc;
+// Raw waveform export (ExportRawWaveforms), one Waveforms chunk per batch
+constexpr size_t kRawQueueDepth = 2;
+
+// Rows of one Waveforms chunk: the samples buffer has the chunk shape
+// (chunkRows x width) and the first metadata.size() rows are filled.
+struct RawBatch {
+  std::vector<WaveformMeta> metadata;
+  std::vector<float> samples;  // chunkRows x width, short rows padded
+  size_t width = 0;
+  float padValue = 0.0f;       // ped_target of the batch
 };
-#pragma pack(pop)
+
+// Chunk buffers handed to the writer thread and returned after the write,
+// so the export reuses at most kRawQueueDepth + 2 of them for the whole run
+class RawBatchPool {
+public:
+  // A batch with room for chunkRows rows of width samples
+  std::shared_ptr<RawBatch> Acquire(size_t chunkRows, size_t width, float padValue) {
+    std::shared_ptr<RawBatch> batch;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!free_.empty()) {
+        batch = std::move(free_.back());
+        free_.pop_back();
+      }
+    }
+    if (!batch) {
+      batch = std::make_shared<RawBatch>();
+      batch->metadata.reserve(chunkRows);
+    }
+    batch->metadata.clear();
+    batch->samples.resize(chunkRows * width);
+    batch->width = width;
+    batch->padValue = padValue;
+    return batch;
+  }
+
+  void Release(std::shared_ptr<RawBatch> batch) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.push_back(std::move(batch));
+  }
+
+private:
+  std::mutex mutex_;
+  std::vector<std::shared_ptr<RawBatch>> free_;
+};
+
+// Output file and datasets, owned by the writer thread until it finishes
+struct RawSink {
+  const Hdf5StorageOptions *storage = nullptr;
+  hsize_t rowsPerEvent = 1;  // exported channels per event (chunk alignment)
+  hsize_t chunkRows = 1;     // Waveforms rows per chunk (= rows per RawBatch)
+  hid_t file = -1;
+  hid_t metaType = -1;
+  hid_t metaSet = -1;
+  hid_t waveSet = -1;
+  size_t rows = 0;
+  size_t width = 0;
+};
+
+hid_t CreateWaveformMetaType() {
+  hid_t metaType = H5Tcreate(H5T_COMPOUND, sizeof(WaveformMeta));
+  H5Tinsert(metaType, "event", HOFFSET(WaveformMeta, event), H5T_NATIVE_UINT32);
+  H5Tinsert(metaType, "channel", HOFFSET(WaveformMeta, channel),
+            H5T_NATIVE_UINT16);
+  H5Tinsert(metaType, "nsamples", HOFFSET(WaveformMeta, nsamples),
+            H5T_NATIVE_UINT16);
+  H5Tinsert(metaType, "board_id", HOFFSET(WaveformMeta, board_id),
+            H5T_NATIVE_UINT32);
+  H5Tinsert(metaType, "event_counter",
+            HOFFSET(WaveformMeta, event_counter), H5T_NATIVE_UINT32);
+  H5Tinsert(metaType, "pedestal", HOFFSET(WaveformMeta, pedestal),
+            H5T_NATIVE_FLOAT);
+  return metaType;
+}
+
+// Copy one row of n samples into the next row of the chunk buffer and pad
+// it with padValue to the batch width in place. A longer row re-strides the
+// rows already in the buffer (last row first, so nothing is overwritten).
+void AppendPaddedRow(RawBatch &batch, size_t chunkRows, const float *row, size_t n,
+                     float padValue) {
+  const size_t rows = batch.metadata.size();
+  if (n > batch.width) {
+    const size_t oldWidth = batch.width;
+    batch.samples.resize(chunkRows * n);
+    for (size_t r = rows; r-- > 0;) {
+      float *dst = batch.samples.data() + r * n;
+      std::memmove(dst, batch.samples.data() + r * oldWidth, oldWidth * sizeof(float));
+      std::fill(dst + oldWidth, dst + n, batch.padValue);
+    }
+    batch.width = n;
+  }
+  float *dst = batch.samples.data() + rows * batch.width;
+  std::copy(row, row + n, dst);
+  std::fill(dst + n, dst + batch.width, padValue);
+}
+
+void CloseRawSink(RawSink &sink) {
+  if (sink.waveSet >= 0) H5Dclose(sink.waveSet);
+  if (sink.metaSet >= 0) H5Dclose(sink.metaSet);
+  if (sink.metaType >= 0) H5Tclose(sink.metaType);
+  if (sink.file >= 0) H5Fclose(sink.file);
+  sink = RawSink{};
+}
+
+// Number of the nChannels channels that pass the sensor filter
+int ExportedChannelCount(int nChannels, int sensorFilter, const std::vector<int> *sensorIds) {
+  if (sensorFilter < 0 || !sensorIds) {
+    return nChannels;
+  }
+  int count = 0;
+  for (int ch = 0; ch < nChannels; ++ch) {
+    if (ch >= static_cast<int>(sensorIds->size()) || (*sensorIds)[ch] == sensorFilter) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+// Writer-thread job: create the file with the first batch, then append.
+// Waveforms is as wide as the longest row so far; cells of shorter rows
+// read back as ped_target (the fill value).
+bool WriteRawBatch(RawSink &sink, const std::string &hdf5File, const RawBatch &batch) {
+  PerfScope scope(kPerfWrite);
+  if (sink.file < 0) {
+    sink.file = H5Fcreate(hdf5File.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    if (sink.file < 0) {
+      std::cerr << "ERROR: cannot create HDF5 file " << hdf5File << std::endl;
+      return false;
+    }
+    sink.metaType = CreateWaveformMetaType();
+    const Hdf5StorageOptions &storage = *sink.storage;
+    sink.metaSet = CreateAppendableDataset(
+        sink.file, "Metadata", sink.metaType, 0,
+        ChunkRowsFor(storage, sizeof(WaveformMeta), sink.rowsPerEvent), nullptr, &storage);
+    sink.waveSet = CreateAppendableDataset(sink.file, "Waveforms", H5T_NATIVE_FLOAT,
+                                           batch.width, sink.chunkRows, &batch.padValue, &storage);
+    if (sink.metaSet < 0 || sink.waveSet < 0) {
+      return false;
+    }
+  }
+
+  const hsize_t rows = batch.metadata.size();
+  if (!AppendRows(sink.metaSet, sink.metaType, rows, 0, batch.metadata.data()) ||
+      !AppendRows(sink.waveSet, H5T_NATIVE_FLOAT, rows, batch.width, batch.samples.data())) {
+    return false;
+  }
+  sink.rows += rows;
+  sink.width = std::max(sink.width, batch.width);
+  return true;
+}
 
 bool ExportRawWaveforms(const std::string &rootFile,
                        const std::string &treeName,
                        const std::string &hdf5File,
                        int nChannels,
                        int sensorFilter = -1,
-                       const std::vector<int> *sensorIds = nullptr) {
+                       const std::vector<int> *sensorIds = nullptr,
+                       const Hdf5StorageOptions &storage = Hdf5StorageOptions(),
+                       Long64_t firstEntry = 0,
+                       Long64_t endEntry = -1) {
   TFile *fin = TFile::Open(rootFile.c_str(), "READ");
   if (!fin || fin->IsZombie()) {
     std::cerr << "ERROR: cannot open ROOT file " << rootFile << std::endl;
@@ -226,28 +513,59 @@ bool ExportRawWaveforms(const std::string &rootFile,
     }
   }
 
-  const Long64_t nEntries = tree->GetEntries();
-  if (nEntries <= 0) {
+  // Entries [firstEntry, endEntry) (one shard of --shards), or all
+  const Long64_t nEntries = (endEntry < 0) ? tree->GetEntries() : std::min(endEntry, tree->GetEntries());
+  if (nEntries <= firstEntry) {
     std::cerr << "WARNING: tree contains no entries, skipping HDF5 export"
               << std::endl;
     fin->Close();
     return false;
   }
 
-  std::vector<WaveformMeta> metadata;
-  metadata.reserve(static_cast<size_t>(nEntries) * maxChannels);
+  // Each entry's channels are copied from the ROOT vectors straight into a
+  // buffer shaped like one Waveforms chunk; a full buffer goes to the writer
+  // thread as one chunk-aligned write while the next is filled, and comes
+  // back to the pool afterwards.
+  RawSink sink;
+  sink.storage = &storage;
+  sink.rowsPerEvent = std::max(1, ExportedChannelCount(maxChannels, sensorFilter, sensorIds));
+  RawBatchPool pool;
+  Hdf5WriteQueue writer(kRawQueueDepth);
+  writer.Start();
+
+  std::shared_ptr<RawBatch> batch;
+  size_t width = 0;  // widest row so far: width of the next buffer
+  hsize_t chunkRows = 0;
+  // Returns false once a write has failed: the queue then drops the
+  // remaining jobs, so there is no point reading further entries
+  auto flushBatch = [&]() {
+    if (batch && !batch->metadata.empty()) {
+      width = std::max(width, batch->width);
+      std::shared_ptr<RawBatch> pending = std::move(batch);
+      writer.Push([&sink, &hdf5File, &pool, pending]() {
+        const bool ok = WriteRawBatch(sink, hdf5File, *pending);
+        pool.Release(pending);
+        return ok;
+      });
+    }
+    return !writer.Failed();
+  };
+  auto abortExport = [&]() {
+    writer.Finish();
+    CloseRawSink(sink);
+    fin->Close();
+    std::remove(hdf5File.c_str());
+  };
 
-  std::vector<std::vector<float>> waveformRows;
-  waveformRows.reserve(static_cast<size_t>(nEntries) * maxChannels);
-  std::vector<float> rowPadValues;
-  rowPadValues.reserve(static_cast<size_t>(nEntries) * maxChannels);
-  size_t maxSamplesPerRow = 0;
   bool loggedNsamplesTrim = false;
-
   std::vector<float> timeAxisCopy;
 
-  for (Long64_t entry = 0; entry < nEntries; ++entry) {
-    tree->GetEntry(entry);
+  for (Long64_t entry = firstEntry; entry < nEntries; ++entry) {
+    {
+      PerfScope scope(kPerfGetEntry);
+      tree->GetEntry(entry);
+    }
+    PerfAddEvents(1);
 
     if (!timeAxisCopy.size() && timeAxis) {
       timeAxisCopy.assign(timeAxis->begin(), timeAxis->end());
@@ -256,10 +574,21 @@ bool ExportRawWaveforms(const std::string &rootFile,
     if (!pedestals || !boardIds || !eventCounters) {
       std::cerr << "ERROR: missing per-channel vectors in tree entry "
                 << entry << std::endl;
-      fin->Close();
+      abortExport();
       return false;
     }
 
+    if (chunkRows == 0) {
+      // Chunk shape from the first entry's record length; longer rows widen it
+      width = static_cast<size_t>(std::max(nsamples, 1));
+      if (nsamplesPerChannel && !nsamplesPerChannel->empty()) {
+        width = std::max(width, static_cast<size_t>(std::max(
+            *std::max_element(nsamplesPerChannel->begin(), nsamplesPerChannel->end()), 1)));
+      }
+      chunkRows = ChunkRowsFor(storage, width * sizeof(float), sink.rowsPerEvent);
+      sink.chunkRows = chunkRows;
+    }
+
     for (int ch = 0; ch < maxChannels; ++ch) {
       // Filter by sensor if requested
       if (sensorFilter >= 0 && sensorIds && ch < static_cast<int>(sensorIds->size())) {
@@ -311,113 +640,38 @@ bool ExportRawWaveforms(const std::string &rootFile,
       meta.pedestal =
           (ch < static_cast<int>(pedestals->size())) ? (*pedestals)[ch] : 0.0f;
 
-      metadata.push_back(meta);
-      maxSamplesPerRow =
-          std::max(maxSamplesPerRow, static_cast<size_t>(chSamples));
-
-      std::vector<float> row(vecPtr->begin(),
-                             vecPtr->begin() + chSamples);
-      waveformRows.push_back(std::move(row));
-      rowPadValues.push_back(pedTarget);
+      if (!batch) {
+        batch = pool.Acquire(chunkRows, width, pedTarget);
+      }
+      AppendPaddedRow(*batch, chunkRows, vecPtr->data(), static_cast<size_t>(chSamples), pedTarget);
+      batch->metadata.push_back(meta);
+      if (batch->metadata.size() == chunkRows && !flushBatch()) {
+        std::cerr << "ERROR: writing " << hdf5File << " failed at entry " << entry
+                  << ", aborting raw export" << std::endl;
+        abortExport();
+        return false;
+      }
     }
   }
+  flushBatch();
 
+  const bool written = writer.Finish();
   fin->Close();
 
-  if (metadata.empty()) {
-    std::cerr << "WARNING: no waveform metadata filled, aborting HDF5 export"
-              << std::endl;
-    return false;
-  }
-
-  if (maxSamplesPerRow == 0) {
-    std::cerr << "ERROR: no waveform samples found to export" << std::endl;
+  if (!written) {
+    CloseRawSink(sink);
+    std::remove(hdf5File.c_str());
     return false;
   }
 
-  if (waveformRows.size() != metadata.size()) {
-    std::cerr << "ERROR: internal mismatch between metadata rows and waveforms ("
-              << metadata.size() << " vs " << waveformRows.size() << ")"
+  if (sink.rows == 0) {
+    std::cerr << "WARNING: no waveform metadata filled, aborting HDF5 export"
               << std::endl;
     return false;
   }
 
-  const size_t rows = metadata.size();
-  const size_t samplesPerRow = maxSamplesPerRow;
-
-  std::vector<float> waveforms;
-  waveforms.reserve(rows * samplesPerRow);
-  for (size_t i = 0; i < waveformRows.size(); ++i) {
-    const auto &row = waveformRows[i];
-    const float padValue =
-        (i < rowPadValues.size()) ? rowPadValues[i] : pedTarget;
-    waveforms.insert(waveforms.end(), row.begin(), row.end());
-    if (row.size() < samplesPerRow) {
-      waveforms.insert(waveforms.end(), samplesPerRow - row.size(),
-                       padValue);
-    }
-  }
-
-  if (waveforms.size() != rows * samplesPerRow) {
-    std::cerr << "ERROR: waveform buffer size mismatch (" << waveforms.size()
-              << " vs " << rows * samplesPerRow << ")" << std::endl;
-    return false;
-  }
-
-  hid_t file =
-      H5Fcreate(hdf5File.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
-  if (file < 0) {
-    std::cerr << "ERROR: cannot create HDF5 file " << hdf5File << std::endl;
-    return false;
-  }
-
-  // Metadata dataset
-  hsize_t metaDim = rows;
-  hid_t metaSpace = H5Screate_simple(1, &metaDim, nullptr);
-  hid_t metaType = H5Tcreate(H5T_COMPOUND, sizeof(WaveformMeta));
-  H5Tinsert(metaType, "event", HOFFSET(WaveformMeta, event), H5T_NATIVE_UINT32);
-  H5Tinsert(metaType, "channel", HOFFSET(WaveformMeta, channel),
-            H5T_NATIVE_UINT16);
-  H5Tinsert(metaType, "nsamples", HOFFSET(WaveformMeta, nsamples),
-            H5T_NATIVE_UINT16);
-  H5Tinsert(metaType, "board_id", HOFFSET(WaveformMeta, board_id),
-            H5T_NATIVE_UINT32);
-  H5Tinsert(metaType, "event_counter",
-            HOFFSET(WaveformMeta, event_counter), H5T_NATIVE_UINT32);
-  H5Tinsert(metaType, "pedestal", HOFFSET(WaveformMeta, pedestal),
-            H5T_NATIVE_FLOAT);
-
-  hid_t metaSet =
-      H5Dcreate(file, "Metadata", metaType, metaSpace, H5P_DEFAULT, H5P_DEFAULT,
-                H5P_DEFAULT);
-  if (metaSet < 0) {
-    std::cerr << "ERROR: cannot create Metadata dataset" << std::endl;
-    H5Tclose(metaType);
-    H5Sclose(metaSpace);
-    H5Fclose(file);
-    return false;
-  }
-
-  H5Dwrite(metaSet, metaType, H5S_ALL, H5S_ALL, H5P_DEFAULT, metadata.data());
-
-  // Waveform dataset (rows x samples)
-  hsize_t waveDims[2] = {rows, samplesPerRow};
-  hid_t waveSpace = H5Screate_simple(2, waveDims, nullptr);
-  hid_t waveSet =
-      H5Dcreate(file, "Waveforms", H5T_NATIVE_FLOAT, waveSpace, H5P_DEFAULT,
-                H5P_DEFAULT, H5P_DEFAULT);
-  if (waveSet < 0) {
-    std::cerr << "ERROR: cannot create Waveforms dataset" << std::endl;
-    H5Dclose(metaSet);
-    H5Tclose(metaType);
-    H5Sclose(metaSpace);
-    H5Sclose(waveSpace);
-    H5Fclose(file);
-    return false;
-  }
-
-  H5Dwrite(waveSet, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
-           waveforms.data());
+  // The writer thread has finished; the remaining writes happen here
+  hid_t file = sink.file;
 
   // Time axis dataset
   if (!timeAxisCopy.empty()) {
@@ -427,8 +681,11 @@ bool ExportRawWaveforms(const std::string &rootFile,
         H5Dcreate(file, "TimeAxis_ns", H5T_NATIVE_FLOAT, timeSpace, H5P_DEFAULT,
                   H5P_DEFAULT, H5P_DEFAULT);
     if (timeSet >= 0) {
-      H5Dwrite(timeSet, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
-               timeAxisCopy.data());
+      {
+        PerfScope scope(kPerfWrite);
+        H5Dwrite(timeSet, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
+                 timeAxisCopy.data());
+      }
       H5Dclose(timeSet);
     } else {
       std::cerr << "WARNING: failed to create TimeAxis_ns dataset" << std::endl;
@@ -457,14 +714,219 @@ bool ExportRawWaveforms(const std::string &rootFile,
     H5Sclose(attrSpace);
   }
 
-  H5Dclose(waveSet);
-  H5Sclose(waveSpace);
-  H5Dclose(metaSet);
+  const size_t rows = sink.rows;
+  const size_t samplesPerRow = sink.width;
+  CloseRawSink(sink);
+
+  std::cout << "HDF5 raw waveforms written to " << hdf5File << " (" << rows
+            << " rows x " << samplesPerRow << " samples)" << std::endl;
+  return true;
+}
+
+// Shard file of a sharded raw export: out.h5 -> out.shard03.h5
+std::string RawShardPath(const std::string &hdf5File, int shard) {
+  const size_t slash = hdf5File.find_last_of('/');
+  size_t dot = hdf5File.find_last_of('.');
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+    dot = hdf5File.size();
+  }
+  char suffix[32];
+  std::snprintf(suffix, sizeof(suffix), ".shard%02d", shard);
+  return hdf5File.substr(0, dot) + suffix + hdf5File.substr(dot);
+}
+
+// Copy attribute `name` of src to dst (scalar or simple, fixed-size type)
+void CopyHdf5Attribute(hid_t src, hid_t dst, const char *name) {
+  if (H5Aexists(src, name) <= 0) {
+    return;
+  }
+  hid_t attr = H5Aopen(src, name, H5P_DEFAULT);
+  hid_t type = H5Aget_type(attr);
+  hid_t space = H5Aget_space(attr);
+  const hssize_t count = std::max<hssize_t>(1, H5Sget_simple_extent_npoints(space));
+  std::vector<unsigned char> value(static_cast<size_t>(count) * H5Tget_size(type));
+  if (H5Aread(attr, type, value.data()) >= 0) {
+    hid_t copy = H5Acreate2(dst, name, type, space, H5P_DEFAULT, H5P_DEFAULT);
+    if (copy >= 0) {
+      H5Awrite(copy, type, value.data());
+      H5Aclose(copy);
+    }
+  }
+  H5Sclose(space);
+  H5Tclose(type);
+  H5Aclose(attr);
+}
+
+// Raw export split into `shards` event ranges, each written to its own file
+// by a separate process (the HDF5 library is not thread-safe in general
+// builds). hdf5File then holds Metadata and Waveforms as virtual datasets
+// over the shard files, plus TimeAxis_ns and the file attributes, so readers
+// see one dataset. Shards narrower than the widest read ped_target in the
+// extra columns, like short rows of a single file.
+bool ExportRawWaveformShards(const std::string &rootFile,
+                             const std::string &treeName,
+                             const std::string &hdf5File,
+                             int nChannels,
+                             int shards,
+                             int sensorFilter = -1,
+                             const std::vector<int> *sensorIds = nullptr,
+                             const Hdf5StorageOptions &storage = Hdf5StorageOptions()) {
+  Long64_t nEntries = 0;
+  {
+    TFile *fin = TFile::Open(rootFile.c_str(), "READ");
+    if (!fin || fin->IsZombie()) {
+      std::cerr << "ERROR: cannot open ROOT file " << rootFile << std::endl;
+      return false;
+    }
+    TTree *tree = dynamic_cast<TTree *>(fin->Get(treeName.c_str()));
+    if (!tree) {
+      std::cerr << "ERROR: tree " << treeName << " not found" << std::endl;
+      fin->Close();
+      return false;
+    }
+    nEntries = tree->GetEntries();
+    fin->Close();
+  }
+  shards = static_cast<int>(std::max<Long64_t>(1, std::min<Long64_t>(shards, nEntries)));
+  const Long64_t perShard = (nEntries + shards - 1) / shards;
+  std::cout << "Writing " << nEntries << " events in " << shards << " shards of up to "
+            << perShard << " events" << std::endl;
+
+  // One child process per shard; the parent has not opened any HDF5 file yet
+  std::vector<std::string> shardFiles;
+  std::vector<pid_t> children;
+  std::cout.flush();
+  std::cerr.flush();
+  for (int shard = 0; shard < shards; ++shard) {
+    shardFiles.push_back(RawShardPath(hdf5File, shard));
+    const Long64_t first = shard * perShard;
+    const Long64_t end = std::min(nEntries, first + perShard);
+    const pid_t pid = fork();
+    if (pid < 0) {
+      std::cerr << "ERROR: cannot start the process of shard " << shard << std::endl;
+      break;
+    }
+    if (pid == 0) {
+      const bool ok = ExportRawWaveforms(rootFile, treeName, shardFiles.back(), nChannels,
+                                         sensorFilter, sensorIds, storage, first, end);
+      std::cout.flush();
+      _exit(ok ? 0 : 1);
+    }
+    children.push_back(pid);
+  }
+  bool ok = (children.size() == static_cast<size_t>(shards));
+  for (size_t shard = 0; shard < children.size(); ++shard) {
+    int status = 0;
+    if (waitpid(children[shard], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      std::cerr << "ERROR: raw export of shard " << shard << " failed" << std::endl;
+      ok = false;
+    }
+  }
+  if (!ok) {
+    return false;
+  }
+
+  // Shard shapes
+  std::vector<hsize_t> shardRows(shards, 0);
+  std::vector<hsize_t> shardWidth(shards, 0);
+  for (int shard = 0; shard < shards; ++shard) {
+    hid_t file = H5Fopen(shardFiles[shard].c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (file < 0) {
+      std::cerr << "ERROR: cannot open shard " << shardFiles[shard] << std::endl;
+      return false;
+    }
+    hid_t dset = H5Dopen2(file, "Waveforms", H5P_DEFAULT);
+    hid_t space = H5Dget_space(dset);
+    hsize_t dims[2] = {0, 0};
+    H5Sget_simple_extent_dims(space, dims, nullptr);
+    shardRows[shard] = dims[0];
+    shardWidth[shard] = dims[1];
+    H5Sclose(space);
+    H5Dclose(dset);
+    H5Fclose(file);
+  }
+  hsize_t totalRows = 0;
+  hsize_t width = 0;
+  for (int shard = 0; shard < shards; ++shard) {
+    totalRows += shardRows[shard];
+    width = std::max(width, shardWidth[shard]);
+  }
+
+  hid_t first = H5Fopen(shardFiles.front().c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+  hid_t file = H5Fcreate(hdf5File.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+  if (first < 0 || file < 0) {
+    std::cerr << "ERROR: cannot create HDF5 file " << hdf5File << std::endl;
+    if (first >= 0) H5Fclose(first);
+    return false;
+  }
+  float pedTarget = 0.0f;
+  if (H5Aexists(first, "ped_target") > 0) {
+    hid_t attr = H5Aopen(first, "ped_target", H5P_DEFAULT);
+    H5Aread(attr, H5T_NATIVE_FLOAT, &pedTarget);
+    H5Aclose(attr);
+  }
+
+  // Sources are named relative to hdf5File; keep the shards next to it
+  auto createVirtual = [&](const char *name, hid_t type, int rank, const void *fillValue) {
+    hsize_t dims[2] = {totalRows, width};
+    hid_t space = H5Screate_simple(rank, dims, nullptr);
+    hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+    if (fillValue) {
+      H5Pset_fill_value(dcpl, type, fillValue);
+    }
+    hsize_t offset = 0;
+    for (int shard = 0; shard < shards; ++shard) {
+      if (shardRows[shard] == 0) {
+        continue;
+      }
+      const hsize_t start[2] = {offset, 0};
+      const hsize_t count[2] = {shardRows[shard], shardWidth[shard]};
+      H5Sselect_hyperslab(space, H5S_SELECT_SET, start, nullptr, count, nullptr);
+      hid_t source = H5Screate_simple(rank, count, nullptr);
+      const std::string &path = shardFiles[shard];
+      const size_t slash = path.find_last_of('/');
+      const std::string sourceFile = (slash == std::string::npos) ? path : path.substr(slash + 1);
+      H5Pset_virtual(dcpl, space, sourceFile.c_str(), name, source);
+      H5Sclose(source);
+      offset += shardRows[shard];
+    }
+    H5Sselect_all(space);
+    hid_t dset = H5Dcreate(file, name, type, space, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+    H5Pclose(dcpl);
+    H5Sclose(space);
+    if (dset < 0) {
+      std::cerr << "ERROR: cannot create virtual dataset " << name << std::endl;
+      return false;
+    }
+    H5Dclose(dset);
+    return true;
+  };
+  hid_t metaType = CreateWaveformMetaType();
+  ok = createVirtual("Metadata", metaType, 1, nullptr) &&
+       createVirtual("Waveforms", H5T_NATIVE_FLOAT, 2, &pedTarget);
   H5Tclose(metaType);
-  H5Sclose(metaSpace);
+
+  if (ok && H5Lexists(first, "TimeAxis_ns", H5P_DEFAULT) > 0) {
+    H5Ocopy(first, "TimeAxis_ns", file, "TimeAxis_ns", H5P_DEFAULT, H5P_DEFAULT);
+  }
+  CopyHdf5Attribute(first, file, "sampling_ns");
+  CopyHdf5Attribute(first, file, "ped_target");
+  hid_t attrSpace = H5Screate(H5S_SCALAR);
+  hid_t attrShards = H5Acreate2(file, "shards", H5T_NATIVE_INT, attrSpace, H5P_DEFAULT, H5P_DEFAULT);
+  if (attrShards >= 0) {
+    H5Awrite(attrShards, H5T_NATIVE_INT, &shards);
+    H5Aclose(attrShards);
+  }
+  H5Sclose(attrSpace);
+  H5Fclose(first);
   H5Fclose(file);
+  if (!ok) {
+    std::remove(hdf5File.c_str());
+    return false;
+  }
 
-  std::cout << "HDF5 raw waveforms written to " << hdf5File << std::endl;
+  std::cout << "HDF5 raw waveforms written to " << hdf5File << " (" << totalRows << " rows x "
+            << width << " samples, virtual over " << shards << " shard files)" << std::endl;
   return true;
 }
 
@@ -476,7 +938,9 @@ bool ExportAnalysisFeatures(const std::string &rootFile,
                             const std::vector<int> *sensorIds = nullptr,
                             const std::vector<int> *columnIds = nullptr,
                             const std::vector<int> *stripIds = nullptr,
-                            bool append = false) {
+                            bool append = false,
+                            const ExportCalibration *calib = nullptr,
+                            const Hdf5StorageOptions &storage = Hdf5StorageOptions()) {
   TFile *fin = TFile::Open(rootFile.c_str(), "READ");
   if (!fin || fin->IsZombie()) {
     std::cerr << "ERROR: cannot open ROOT file " << rootFile << std::endl;
@@ -497,19 +961,20 @@ bool ExportAnalysisFeatures(const std::string &rootFile,
   std::vector<float> *ampMinBefore = nullptr;
   std::vector<float> *ampMaxBefore = nullptr;
   std::vector<float> *ampMax = nullptr;
-  std::vector<float> *ampMax_Fit_mV = nullptr;
-  std::vector<float> *charge = nullptr;
   std::vector<float> *signalOverNoise = nullptr;
   std::vector<float> *peakTime = nullptr;
   std::vector<float> *riseTime = nullptr;
   std::vector<float> *riseTime_Fit = nullptr;
   std::vector<float> *slewRate = nullptr;
-  std::vector<float> *slewRate_Fit_mV = nullptr;
-  std::vector<float> *rmsNoise_mV = nullptr;
+  MilliVoltColumn colRmsNoise_mV;
+  MilliVoltColumn colAmpMax_Fit_mV;
+  MilliVoltColumn colCharge_mV;
+  MilliVoltColumn colSlewRate_Fit_mV;
 
   const int kCFD = 50;
-  std::vector<float> chTimeCFD(nChannels, 0.0f);
-  std::vector<float> chTimeCFD_Fit(nChannels, 0.0f);
+  const AnalysisTreeLayout layout = ReadAnalysisTreeLayout(tree, nChannels);
+  TimingColumnReader chTimeCFD;
+  TimingColumnReader chTimeCFD_Fit;
 
   tree->SetBranchAddress("event", &event);
   tree->SetBranchAddress("baseline", &baseline);
@@ -518,22 +983,30 @@ bool ExportAnalysisFeatures(const std::string &rootFile,
   tree->SetBranchAddress("ampMinBefore", &ampMinBefore);
   tree->SetBranchAddress("ampMaxBefore", &ampMaxBefore);
   tree->SetBranchAddress("ampMax", &ampMax);
-  tree->SetBranchAddress("charge_mV", &charge);
   tree->SetBranchAddress("signalOverNoise", &signalOverNoise);
   tree->SetBranchAddress("peakTime", &peakTime);
   tree->SetBranchAddress("riseTime", &riseTime);
   tree->SetBranchAddress("slewRate", &slewRate);
-  if (tree->GetBranch("ampMax_Fit_mV"))   tree->SetBranchAddress("ampMax_Fit_mV",   &ampMax_Fit_mV);
   if (tree->GetBranch("riseTime_Fit"))    tree->SetBranchAddress("riseTime_Fit",    &riseTime_Fit);
-  if (tree->GetBranch("slewRate_Fit_mV")) tree->SetBranchAddress("slewRate_Fit_mV", &slewRate_Fit_mV);
-  if (tree->GetBranch("rmsNoise_mV"))     tree->SetBranchAddress("rmsNoise_mV",     &rmsNoise_mV);
-  for (int ch = 0; ch < nChannels; ++ch) {
-    char b[64];
-    std::snprintf(b, sizeof(b), "ch%02d_timeCFD_%dpc",      ch, kCFD);
-    if (tree->GetBranch(b)) tree->SetBranchAddress(b, &chTimeCFD[ch]);
-    std::snprintf(b, sizeof(b), "ch%02d_timeCFD_Fit_%dpc",  ch, kCFD);
-    if (tree->GetBranch(b)) tree->SetBranchAddress(b, &chTimeCFD_Fit[ch]);
+  colRmsNoise_mV.Bind(tree, "rmsNoise", CalibRule::kScaleOrRaw, calib, &rmsNoise);
+  colAmpMax_Fit_mV.Bind(tree, "ampMax_Fit", CalibRule::kFitScaleOrZero, calib);
+  colCharge_mV.Bind(tree, "charge", CalibRule::kScaleOrZero, calib);
+  colSlewRate_Fit_mV.Bind(tree, "slewRate_Fit", CalibRule::kFitScaleOrRaw, calib);
+  const bool calibrated = colRmsNoise_mV.Computed() || colAmpMax_Fit_mV.Computed() ||
+                          colCharge_mV.Computed() || colSlewRate_Fit_mV.Computed();
+  const std::string calibrationVersion = calibrated ? calib->version : TreeCalibrationVersion(tree);
+  chTimeCFD.Bind(tree, layout, "timeCFD", kCFD);
+  chTimeCFD_Fit.Bind(tree, layout, "timeCFD_Fit", kCFD);
+
+  std::vector<std::string> readBranches = {
+      "event", "baseline", "rmsNoise", "noise1Point", "ampMinBefore", "ampMaxBefore", "ampMax",
+      "signalOverNoise", "peakTime", "riseTime", "slewRate", "riseTime_Fit"};
+  for (const auto *names : {&colRmsNoise_mV.BranchNames(), &colAmpMax_Fit_mV.BranchNames(),
+                            &colCharge_mV.BranchNames(), &colSlewRate_Fit_mV.BranchNames(),
+                            &chTimeCFD.BranchNames(), &chTimeCFD_Fit.BranchNames()}) {
+    readBranches.insert(readBranches.end(), names->begin(), names->end());
   }
+  PruneTreeBranches(tree, readBranches);
 
   const Long64_t nEntries = tree->GetEntries();
   if (nEntries <= 0) {
@@ -546,12 +1019,21 @@ bool ExportAnalysisFeatures(const std::string &rootFile,
   features.reserve(static_cast<size_t>(nEntries) * nChannels);
 
   for (Long64_t entry = 0; entry < nEntries; ++entry) {
-    tree->GetEntry(entry);
+    {
+      PerfScope scope(kPerfGetEntry);
+      tree->GetEntry(entry);
+    }
+    PerfAddEvents(1);
 
     if (!baseline || !ampMax) {
       continue;
     }
 
+    const std::vector<float> *rmsNoise_mV     = colRmsNoise_mV.Values();
+    const std::vector<float> *ampMax_Fit_mV   = colAmpMax_Fit_mV.Values();
+    const std::vector<float> *charge          = colCharge_mV.Values();
+    const std::vector<float> *slewRate_Fit_mV = colSlewRate_Fit_mV.Values();
+
     for (int ch = 0; ch < nChannels; ++ch) {
       // Filter by sensor if requested
       if (sensorFilter >= 0 && sensorIds && ch < static_cast<int>(sensorIds->size())) {
@@ -598,80 +1080,965 @@ bool ExportAnalysisFeatures(const std::string &rootFile,
       meta.riseTime_Fit  = (riseTime_Fit  && ch < (int)riseTime_Fit->size())  ? (*riseTime_Fit)[ch]  : 0.0f;
       meta.slewRate      = (slewRate      && ch < (int)slewRate->size())      ? (*slewRate)[ch]      : 0.0f;
       meta.slewRate_Fit_mV = (slewRate_Fit_mV && ch < (int)slewRate_Fit_mV->size()) ? (*slewRate_Fit_mV)[ch] : 0.0f;
-      meta.timeCFD_50pc     = (ch < nChannels) ? chTimeCFD[ch]     : 0.0f;
-      meta.timeCFD_Fit_50pc = (ch < nChannels) ? chTimeCFD_Fit[ch] : 0.0f;
+      meta.timeCFD_50pc     = chTimeCFD.Value(ch);
+      meta.timeCFD_Fit_50pc = chTimeCFD_Fit.Value(ch);
 
       features.push_back(meta);
     }
   }
 
-  fin->Close();
-
-  if (features.empty()) {
-    std::cerr << "WARNING: no features extracted" << std::endl;
+  fin->Close();
+
+  if (features.empty()) {
+    std::cerr << "WARNING: no features extracted" << std::endl;
+    return false;
+  }
+
+  hid_t file = -1;
+  if (append) {
+    file = H5Fopen(hdf5File.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
+    if (file < 0) {
+      std::cerr << "ERROR: cannot open HDF5 file for appending " << hdf5File << std::endl;
+      return false;
+    }
+  } else {
+    file = H5Fcreate(hdf5File.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+  }
+  if (file < 0) {
+    std::cerr << "ERROR: cannot create HDF5 file " << hdf5File << std::endl;
+    return false;
+  }
+
+  hid_t type = CreateAnalysisFeatureType();
+
+  hid_t dset = CreateRowDataset(file, "AnalysisFeatures", type, features.size(), storage,
+                                ExportedChannelCount(nChannels, sensorFilter, sensorIds));
+  if (dset < 0) {
+    H5Tclose(type);
+    H5Fclose(file);
+    return false;
+  }
+
+  {
+    PerfScope scope(kPerfWrite);
+    H5Dwrite(dset, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, features.data());
+  }
+  WriteStringAttribute(file, "calibration_version", calibrationVersion);
+
+  H5Dclose(dset);
+  H5Tclose(type);
+  H5Fclose(file);
+
+  std::cout << "HDF5 analysis features written to " << hdf5File << std::endl;
+  return true;
+}
+
+// Columnar analysis export (--layout columnar): one dataset per Analysis
+// tree quantity under /Features, [events] for per-event scalars and
+// [events x exported channels] for per-channel values. Timing quantities get
+// one dataset per threshold (timeCFD_50pc, timeLE_20.0mV, ...) in either
+// timing branch layout.
+constexpr Long64_t kColumnBatchEvents = 4096;
+
+// Units of the Analysis tree quantities. Raw amplitudes are pedestal-
+// subtracted digitizer counts; the _mV columns are calibrated.
+inline const char *AnalysisColumnUnits(const std::string &quantity) {
+  static const std::set<std::string> kTimes = {
+      "peakTime", "riseTime", "jitterRMS", "peakTime_Fit", "riseTime_Fit", "jitterRMS_Fit",
+      "leadingEdge_Fit", "timeCFD", "jitterCFD", "timeCFD_Fit", "timeLE", "jitterLE", "totLE",
+      "timeCharge"};
+  static const std::set<std::string> kCounts = {
+      "baseline", "rmsNoise", "noise1Point", "ampMinBefore", "ampMaxBefore", "ampMax", "ampMax_Fit"};
+  if (kTimes.count(quantity)) return "ns";
+  if (kCounts.count(quantity)) return "ADC";
+  if (quantity == "slewRate" || quantity == "slewRate_Fit") return "ADC/ns";
+  if (quantity == "charge") return "ADC*ns/ohm";
+  if (quantity == "charge_mV") return "pC";
+  if (quantity == "slewRate_mV" || quantity == "slewRate_Fit_mV") return "mV/ns";
+  if (quantity.size() > 3 && quantity.compare(quantity.size() - 3, 3, "_mV") == 0) return "mV";
+  return nullptr;
+}
+
+inline void WriteIntArrayAttribute(hid_t loc, const char *name, const std::vector<int> &values) {
+  if (H5Aexists(loc, name) > 0) {
+    H5Adelete(loc, name);
+  }
+  const hsize_t n = values.size();
+  hid_t attrSpace = H5Screate_simple(1, &n, nullptr);
+  hid_t attr = H5Acreate2(loc, name, H5T_NATIVE_INT, attrSpace, H5P_DEFAULT, H5P_DEFAULT);
+  if (attr >= 0) {
+    H5Awrite(attr, H5T_NATIVE_INT, values.data());
+    H5Aclose(attr);
+  }
+  H5Sclose(attrSpace);
+}
+
+inline void WriteDoubleAttribute(hid_t loc, const char *name, double value) {
+  hid_t attrSpace = H5Screate(H5S_SCALAR);
+  hid_t attr = H5Acreate2(loc, name, H5T_NATIVE_DOUBLE, attrSpace, H5P_DEFAULT, H5P_DEFAULT);
+  if (attr >= 0) {
+    H5Awrite(attr, H5T_NATIVE_DOUBLE, &value);
+    H5Aclose(attr);
+  }
+  H5Sclose(attrSpace);
+}
+
+struct FeatureColumn {
+  std::string name;
+  std::string quantity;          // units lookup (timing: without threshold)
+  hid_t type = -1;               // H5T_NATIVE_* of the values
+  size_t valueBytes = 0;
+  bool perChannel = true;        // [events x channels], else [events]
+  bool hasThreshold = false;
+  double threshold = 0.0;
+  const char *thresholdUnit = "";
+  std::function<void(unsigned char *row)> fill;  // values of the current entry
+  std::vector<unsigned char> batch;
+  hid_t dset = -1;
+};
+
+// Copy the exported channels of a per-channel vector into one row
+template <typename Out, typename Vector>
+void FillChannelRow(const Vector *values, const std::vector<int> &channels, Out missing,
+                    unsigned char *row) {
+  Out *out = reinterpret_cast<Out *>(row);
+  for (size_t i = 0; i < channels.size(); ++i) {
+    const int ch = channels[i];
+    out[i] = (values && ch < static_cast<int>(values->size())) ? static_cast<Out>((*values)[ch])
+                                                                : missing;
+  }
+}
+
+// Exported channels, their sensor mapping and the feature columns bound to
+// an Analysis tree; shared by the columnar HDF5 and the .npy exports.
+struct FeatureColumnSet {
+  std::vector<int> channels;
+  std::vector<int> channelSensor, channelColumn, channelStrip;
+  std::vector<FeatureColumn> columns;
+  std::string calibrationVersion;
+
+  // Branch buffers (deques keep the addresses handed to ROOT stable)
+  std::deque<int> intSlots;
+  std::deque<float> floatSlots;
+  std::deque<std::vector<float> *> floatVectors;
+  std::deque<std::vector<int> *> intVectors;
+  std::deque<std::vector<bool> *> boolVectors;
+  std::deque<std::vector<float>> timingValues;  // [channel] or [channel][threshold]
+  std::deque<MilliVoltColumn> milliVoltColumns;
+  const int *event = nullptr;  // buffer of the "event" branch, if the tree has one
+
+  FeatureColumnSet() = default;
+  FeatureColumnSet(const FeatureColumnSet &) = delete;
+  FeatureColumnSet &operator=(const FeatureColumnSet &) = delete;
+};
+
+// Channels of nChannels that pass the sensor filter, with their mapping
+bool SelectFeatureChannels(int nChannels, int sensorFilter, const std::vector<int> *sensorIds,
+                           const std::vector<int> *columnIds, const std::vector<int> *stripIds,
+                           FeatureColumnSet &set) {
+  for (int ch = 0; ch < nChannels; ++ch) {
+    const bool mapped = sensorIds && ch < static_cast<int>(sensorIds->size());
+    if (sensorFilter >= 0 && mapped && (*sensorIds)[ch] != sensorFilter) {
+      continue;
+    }
+    set.channels.push_back(ch);
+    set.channelSensor.push_back(mapped ? (*sensorIds)[ch] : 0);
+    set.channelColumn.push_back((columnIds && ch < static_cast<int>(columnIds->size())) ? (*columnIds)[ch] : 1);
+    set.channelStrip.push_back((stripIds && ch < static_cast<int>(stripIds->size())) ? (*stripIds)[ch] : ch);
+  }
+  if (set.channels.empty()) {
+    std::cerr << "ERROR: no channels of sensor " << sensorFilter << " to export" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Bind every exportable branch of the Analysis tree to a column of set:
+// per-channel vectors, scalars, scalar or array timing branches (one column
+// per threshold) and the _mV columns, stored or computed with calib.
+// Branches that feed no column are not read.
+void BindFeatureColumns(TTree *tree, int nChannels, const ExportCalibration *calib,
+                        FeatureColumnSet &set) {
+  const std::vector<int> &channels = set.channels;
+  const float kMissing = std::numeric_limits<float>::quiet_NaN();
+  const AnalysisTreeLayout layout = ReadAnalysisTreeLayout(tree, nChannels);
+  const std::regex scalarTimingName(R"(ch(\d+)_(.+)_(-?[0-9.]+)(pc|mV))");
+
+  std::map<std::string, std::vector<float> **> rawSlots;
+  std::map<std::string, size_t> scalarTimingColumn;  // "timeCFD_50pc" -> column index
+
+  // Calibrated columns come from MilliVoltColumn (stored or computed here)
+  const std::vector<std::pair<std::string, CalibRule>> kMilliVolt = {
+      {"rmsNoise", CalibRule::kScaleOrRaw},      {"ampMax", CalibRule::kEvalPositive},
+      {"charge", CalibRule::kScaleOrZero},       {"slewRate", CalibRule::kScaleOrRaw},
+      {"ampMax_Fit", CalibRule::kFitScaleOrZero}, {"slewRate_Fit", CalibRule::kFitScaleOrRaw}};
+  std::set<std::string> milliVoltNames;
+  for (const auto &entry : kMilliVolt) {
+    milliVoltNames.insert(entry.first + "_mV");
+  }
+
+  auto addColumn = [&](const std::string &name, const std::string &quantity, hid_t type,
+                       size_t valueBytes, bool perChannel) -> FeatureColumn & {
+    set.columns.emplace_back();
+    FeatureColumn &column = set.columns.back();
+    column.name = name;
+    column.quantity = quantity;
+    column.type = type;
+    column.valueBytes = valueBytes;
+    column.perChannel = perChannel;
+    return column;
+  };
+
+  std::vector<std::string> readBranches;  // branches bound below, the rest is not read
+  TObjArray *branches = tree->GetListOfBranches();
+  const int nBranches = branches ? branches->GetEntries() : 0;
+  for (int b = 0; b < nBranches; ++b) {
+    TBranch *branch = dynamic_cast<TBranch *>(branches->At(b));
+    if (!branch) {
+      continue;
+    }
+    const std::string name = branch->GetName();
+    const std::string className = branch->GetClassName();
+    if (milliVoltNames.count(name)) {
+      continue;
+    }
+
+    if (className == "vector<float>") {
+      set.floatVectors.push_back(nullptr);
+      std::vector<float> **slot = &set.floatVectors.back();
+      tree->SetBranchAddress(name.c_str(), slot);
+      readBranches.push_back(name);
+      rawSlots[name] = slot;
+      addColumn(name, name, H5T_NATIVE_FLOAT, sizeof(float), true).fill =
+          [slot, &channels, kMissing](unsigned char *row) { FillChannelRow<float>(*slot, channels, kMissing, row); };
+    } else if (className == "vector<int>") {
+      set.intVectors.push_back(nullptr);
+      std::vector<int> **slot = &set.intVectors.back();
+      tree->SetBranchAddress(name.c_str(), slot);
+      readBranches.push_back(name);
+      addColumn(name, name, H5T_NATIVE_INT32, sizeof(int32_t), true).fill =
+          [slot, &channels](unsigned char *row) { FillChannelRow<int32_t>(*slot, channels, 0, row); };
+    } else if (className == "vector<bool>") {
+      set.boolVectors.push_back(nullptr);
+      std::vector<bool> **slot = &set.boolVectors.back();
+      tree->SetBranchAddress(name.c_str(), slot);
+      readBranches.push_back(name);
+      addColumn(name, name, H5T_NATIVE_UINT8, sizeof(uint8_t), true).fill =
+          [slot, &channels](unsigned char *row) { FillChannelRow<uint8_t>(*slot, channels, 0, row); };
+    } else if (className.empty()) {
+      TObjArray *leaves = branch->GetListOfLeaves();
+      TLeaf *leaf = leaves ? dynamic_cast<TLeaf *>(leaves->At(0)) : nullptr;
+      if (!leaf) {
+        continue;
+      }
+      const std::string typeName = leaf->GetTypeName();
+      const int length = leaf->GetLenStatic();
+      std::smatch match;
+
+      if (typeName == "Int_t" && length == 1) {
+        set.intSlots.push_back(0);
+        int *slot = &set.intSlots.back();
+        tree->SetBranchAddress(name.c_str(), slot);
+        readBranches.push_back(name);
+        const bool isEvent = (name == "event");
+        if (isEvent) {
+          set.event = slot;
+        }
+        addColumn(name, name, isEvent ? H5T_NATIVE_UINT32 : H5T_NATIVE_INT32, sizeof(int32_t), false).fill =
+            [slot](unsigned char *row) { std::memcpy(row, slot, sizeof(int32_t)); };
+      } else if (typeName == "Float_t" && length == 1 && std::regex_match(name, match, scalarTimingName)) {
+        // Scalar timing layout: chNN_<quantity>_<threshold>: one column per
+        // quantity and threshold, channels without a branch read NaN
+        const int ch = std::stoi(match[1].str());
+        const std::string key = name.substr(name.find('_') + 1);
+        auto it = scalarTimingColumn.find(key);
+        if (it == scalarTimingColumn.end()) {
+          set.timingValues.emplace_back(static_cast<size_t>(std::max(nChannels, ch + 1)), kMissing);
+          std::vector<float> *values = &set.timingValues.back();
+          FeatureColumn &column = addColumn(key, match[2].str(), H5T_NATIVE_FLOAT, sizeof(float), true);
+          column.hasThreshold = true;
+          column.threshold = std::stod(match[3].str());
+          column.thresholdUnit = (match[4].str() == "mV") ? "mV" : "%";
+          column.fill = [values, &channels, kMissing](unsigned char *row) {
+            FillChannelRow<float>(values, channels, kMissing, row);
+          };
+          it = scalarTimingColumn.emplace(key, set.timingValues.size() - 1).first;
+        }
+        std::vector<float> &values = set.timingValues[it->second];
+        if (ch < static_cast<int>(values.size())) {
+          tree->SetBranchAddress(name.c_str(), &values[ch]);
+          readBranches.push_back(name);
+        }
+      } else if (typeName == "Float_t" && length == 1) {
+        set.floatSlots.push_back(0.0f);
+        float *slot = &set.floatSlots.back();
+        tree->SetBranchAddress(name.c_str(), slot);
+        readBranches.push_back(name);
+        addColumn(name, name, H5T_NATIVE_FLOAT, sizeof(float), false).fill =
+            [slot](unsigned char *row) { std::memcpy(row, slot, sizeof(float)); };
+      } else if (typeName == "Float_t" && layout.layout == TimingBranchLayout::kArray) {
+        // Array timing layout: name[n_channels][n_thresholds], one column per threshold
+        const ThresholdFamily family = ThresholdFamilyOf(name);
+        const int nThresholds = static_cast<int>(layout.ThresholdCount(family));
+        if (nThresholds <= 0 || length % nThresholds != 0) {
+          std::cerr << "WARNING: thresholds of array branch " << name << " unknown, skipping" << std::endl;
+          continue;
+        }
+        set.timingValues.emplace_back(static_cast<size_t>(length), kMissing);
+        std::vector<float> *values = &set.timingValues.back();
+        tree->SetBranchAddress(name.c_str(), values->data());
+        readBranches.push_back(name);
+        const int arrayChannels = length / nThresholds;
+        for (int i = 0; i < nThresholds; ++i) {
+          char key[128];
+          double threshold = 0.0;
+          if (family == ThresholdFamily::kLE) {
+            threshold = layout.leThresholds[i];
+            std::snprintf(key, sizeof(key), "%s_%.1fmV", name.c_str(), threshold);
+          } else {
+            threshold = (family == ThresholdFamily::kCFD) ? layout.cfdThresholds[i] : layout.chargeThresholds[i];
+            std::snprintf(key, sizeof(key), "%s_%dpc", name.c_str(), static_cast<int>(threshold));
+          }
+          FeatureColumn &column = addColumn(key, name, H5T_NATIVE_FLOAT, sizeof(float), true);
+          column.hasThreshold = true;
+          column.threshold = threshold;
+          column.thresholdUnit = (family == ThresholdFamily::kLE) ? "mV" : "%";
+          column.fill = [values, i, nThresholds, arrayChannels, &channels, kMissing](unsigned char *row) {
+            float *out = reinterpret_cast<float *>(row);
+            for (size_t c = 0; c < channels.size(); ++c) {
+              out[c] = (channels[c] < arrayChannels) ? (*values)[channels[c] * nThresholds + i] : kMissing;
+            }
+          };
+        }
+      } else {
+        std::cout << "  Skipping branch " << name << " (" << typeName << "[" << length << "])" << std::endl;
+      }
+    } else {
+      std::cout << "  Skipping branch " << name << " (" << className << ")" << std::endl;
+    }
+  }
+
+  // _mV columns: stored by Stage 2, or computed with the export calibration
+  bool calibrated = false;
+  for (const auto &entry : kMilliVolt) {
+    const std::string name = entry.first + "_mV";
+    const bool canCompute = calib && calib->Active() && tree->GetBranch(entry.first.c_str());
+    if (!tree->GetBranch(name.c_str()) && !canCompute) {
+      continue;
+    }
+    auto raw = rawSlots.find(entry.first);
+    set.milliVoltColumns.emplace_back();
+    MilliVoltColumn *column = &set.milliVoltColumns.back();
+    if (!column->Bind(tree, entry.first, entry.second, calib,
+                      raw != rawSlots.end() ? raw->second : nullptr)) {
+      continue;
+    }
+    calibrated = calibrated || column->Computed();
+    readBranches.insert(readBranches.end(), column->BranchNames().begin(), column->BranchNames().end());
+    addColumn(name, name, H5T_NATIVE_FLOAT, sizeof(float), true).fill =
+        [column, &channels, kMissing](unsigned char *row) {
+          FillChannelRow<float>(column->Values(), channels, kMissing, row);
+        };
+  }
+  set.calibrationVersion = calibrated ? calib->version : TreeCalibrationVersion(tree);
+  PruneTreeBranches(tree, readBranches);
+}
+
+bool ExportAnalysisColumns(const std::string &rootFile,
+                           const std::string &treeName,
+                           const std::string &hdf5File,
+                           int nChannels,
+                           int sensorFilter = -1,
+                           const std::vector<int> *sensorIds = nullptr,
+                           const std::vector<int> *columnIds = nullptr,
+                           const std::vector<int> *stripIds = nullptr,
+                           const ExportCalibration *calib = nullptr,
+                           const Hdf5StorageOptions &storage = Hdf5StorageOptions()) {
+  TFile *fin = TFile::Open(rootFile.c_str(), "READ");
+  if (!fin || fin->IsZombie()) {
+    std::cerr << "ERROR: cannot open ROOT file " << rootFile << std::endl;
+    return false;
+  }
+
+  TTree *tree = dynamic_cast<TTree *>(fin->Get(treeName.c_str()));
+  if (!tree) {
+    std::cerr << "ERROR: tree " << treeName << " not found" << std::endl;
+    fin->Close();
+    return false;
+  }
+
+  const Long64_t nEntries = tree->GetEntries();
+  if (nEntries <= 0) {
+    std::cerr << "WARNING: tree contains no entries" << std::endl;
+    fin->Close();
+    return false;
+  }
+
+  FeatureColumnSet set;
+  if (!SelectFeatureChannels(nChannels, sensorFilter, sensorIds, columnIds, stripIds, set)) {
+    fin->Close();
+    return false;
+  }
+  BindFeatureColumns(tree, nChannels, calib, set);
+  const std::vector<int> &channels = set.channels;
+  std::vector<FeatureColumn> &columns = set.columns;
+
+  hid_t file = H5Fcreate(hdf5File.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+  if (file < 0) {
+    std::cerr << "ERROR: cannot create HDF5 file " << hdf5File << std::endl;
+    fin->Close();
+    return false;
+  }
+  hid_t group = H5Gcreate2(file, "Features", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+  WriteIntArrayAttribute(group, "channel", channels);
+  WriteIntArrayAttribute(group, "sensor_id", set.channelSensor);
+  WriteIntArrayAttribute(group, "column_id", set.channelColumn);
+  WriteIntArrayAttribute(group, "strip_id", set.channelStrip);
+
+  auto closeAll = [&]() {
+    for (auto &column : columns) {
+      if (column.dset >= 0) H5Dclose(column.dset);
+    }
+    H5Gclose(group);
+    H5Fclose(file);
+    fin->Close();
+  };
+
+  const hsize_t width = channels.size();
+  for (auto &column : columns) {
+    const hsize_t rowValues = column.perChannel ? width : 1;
+    column.dset = CreateAppendableDataset(group, column.name.c_str(), column.type,
+                                          column.perChannel ? width : 0,
+                                          ChunkRowsFor(storage, rowValues * column.valueBytes),
+                                          nullptr, &storage);
+    if (column.dset < 0) {
+      closeAll();
+      std::remove(hdf5File.c_str());
+      return false;
+    }
+    if (const char *units = AnalysisColumnUnits(column.quantity)) {
+      WriteStringAttribute(column.dset, "units", units);
+    }
+    if (column.hasThreshold) {
+      WriteDoubleAttribute(column.dset, "threshold", column.threshold);
+      WriteStringAttribute(column.dset, "threshold_units", column.thresholdUnit);
+    }
+    column.batch.reserve(static_cast<size_t>(kColumnBatchEvents * rowValues) * column.valueBytes);
+  }
+
+  auto flush = [&](hsize_t rows) {
+    PerfScope scope(kPerfWrite);
+    for (auto &column : columns) {
+      if (!AppendRows(column.dset, column.type, rows, column.perChannel ? width : 0,
+                      column.batch.data())) {
+        return false;
+      }
+      column.batch.clear();
+    }
+    return true;
+  };
+
+  hsize_t batchRows = 0;
+  for (Long64_t entry = 0; entry < nEntries; ++entry) {
+    {
+      PerfScope scope(kPerfGetEntry);
+      tree->GetEntry(entry);
+    }
+    PerfAddEvents(1);
+    for (auto &column : columns) {
+      const size_t rowBytes = (column.perChannel ? width : 1) * column.valueBytes;
+      column.batch.resize(column.batch.size() + rowBytes);
+      column.fill(column.batch.data() + column.batch.size() - rowBytes);
+    }
+    if (++batchRows == static_cast<hsize_t>(kColumnBatchEvents) || entry + 1 == nEntries) {
+      if (!flush(batchRows)) {
+        closeAll();
+        std::remove(hdf5File.c_str());
+        return false;
+      }
+      batchRows = 0;
+    }
+  }
+
+  WriteStringAttribute(file, "calibration_version", set.calibrationVersion);
+  closeAll();
+
+  std::cout << "HDF5 analysis columns written to " << hdf5File << " (" << columns.size()
+            << " datasets x " << nEntries << " events, " << width << " channels)" << std::endl;
+  return true;
+}
+
+// Event-wide analysis export (--layout wide): one AnalysisEvents row per
+// event with the columns of --layout columnar as compound fields, per-channel
+// quantities as [exported channels] array fields. The dataset carries the
+// channel mapping, and the units and thresholds of each field as
+// "<field>.units", "<field>.threshold" and "<field>.threshold_units".
+bool ExportAnalysisEvents(const std::string &rootFile,
+                          const std::string &treeName,
+                          const std::string &hdf5File,
+                          int nChannels,
+                          int sensorFilter = -1,
+                          const std::vector<int> *sensorIds = nullptr,
+                          const std::vector<int> *columnIds = nullptr,
+                          const std::vector<int> *stripIds = nullptr,
+                          const ExportCalibration *calib = nullptr,
+                          const Hdf5StorageOptions &storage = Hdf5StorageOptions()) {
+  TFile *fin = TFile::Open(rootFile.c_str(), "READ");
+  if (!fin || fin->IsZombie()) {
+    std::cerr << "ERROR: cannot open ROOT file " << rootFile << std::endl;
+    return false;
+  }
+
+  TTree *tree = dynamic_cast<TTree *>(fin->Get(treeName.c_str()));
+  if (!tree) {
+    std::cerr << "ERROR: tree " << treeName << " not found" << std::endl;
+    fin->Close();
+    return false;
+  }
+
+  const Long64_t nEntries = tree->GetEntries();
+  if (nEntries <= 0) {
+    std::cerr << "WARNING: tree contains no entries" << std::endl;
+    fin->Close();
+    return false;
+  }
+
+  FeatureColumnSet set;
+  if (!SelectFeatureChannels(nChannels, sensorFilter, sensorIds, columnIds, stripIds, set)) {
+    fin->Close();
+    return false;
+  }
+  BindFeatureColumns(tree, nChannels, calib, set);
+  const std::vector<FeatureColumn> &columns = set.columns;
+  if (columns.empty()) {
+    std::cerr << "ERROR: no exportable branches in tree " << treeName << std::endl;
+    fin->Close();
+    return false;
+  }
+
+  // Packed row: the fields in column order
+  const hsize_t width = set.channels.size();
+  std::vector<size_t> offsets;
+  size_t rowBytes = 0;
+  for (const auto &column : columns) {
+    offsets.push_back(rowBytes);
+    rowBytes += (column.perChannel ? width : 1) * column.valueBytes;
+  }
+  hid_t rowType = H5Tcreate(H5T_COMPOUND, rowBytes);
+  for (size_t i = 0; i < columns.size(); ++i) {
+    hid_t fieldType = columns[i].perChannel ? H5Tarray_create2(columns[i].type, 1, &width)
+                                            : H5Tcopy(columns[i].type);
+    H5Tinsert(rowType, columns[i].name.c_str(), offsets[i], fieldType);
+    H5Tclose(fieldType);
+  }
+
+  hid_t file = H5Fcreate(hdf5File.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+  if (file < 0) {
+    std::cerr << "ERROR: cannot create HDF5 file " << hdf5File << std::endl;
+    H5Tclose(rowType);
+    fin->Close();
+    return false;
+  }
+  hid_t dset = CreateAppendableDataset(file, "AnalysisEvents", rowType, 0,
+                                       ChunkRowsFor(storage, rowBytes), nullptr, &storage);
+  auto closeAll = [&]() {
+    if (dset >= 0) H5Dclose(dset);
+    H5Tclose(rowType);
+    H5Fclose(file);
+    fin->Close();
+  };
+  if (dset < 0) {
+    closeAll();
+    std::remove(hdf5File.c_str());
+    return false;
+  }
+
+  WriteIntArrayAttribute(dset, "channel", set.channels);
+  WriteIntArrayAttribute(dset, "sensor_id", set.channelSensor);
+  WriteIntArrayAttribute(dset, "column_id", set.channelColumn);
+  WriteIntArrayAttribute(dset, "strip_id", set.channelStrip);
+  for (const auto &column : columns) {
+    if (const char *units = AnalysisColumnUnits(column.quantity)) {
+      WriteStringAttribute(dset, (column.name + ".units").c_str(), units);
+    }
+    if (column.hasThreshold) {
+      WriteDoubleAttribute(dset, (column.name + ".threshold").c_str(), column.threshold);
+      WriteStringAttribute(dset, (column.name + ".threshold_units").c_str(), column.thresholdUnit);
+    }
+  }
+
+  std::vector<unsigned char> batch;
+  batch.reserve(static_cast<size_t>(kColumnBatchEvents) * rowBytes);
+  hsize_t batchRows = 0;
+  for (Long64_t entry = 0; entry < nEntries; ++entry) {
+    {
+      PerfScope scope(kPerfGetEntry);
+      tree->GetEntry(entry);
+    }
+    PerfAddEvents(1);
+    batch.resize(batch.size() + rowBytes);
+    unsigned char *row = batch.data() + batch.size() - rowBytes;
+    for (size_t i = 0; i < columns.size(); ++i) {
+      columns[i].fill(row + offsets[i]);
+    }
+    if (++batchRows == static_cast<hsize_t>(kColumnBatchEvents) || entry + 1 == nEntries) {
+      PerfScope scope(kPerfWrite);
+      if (!AppendRows(dset, rowType, batchRows, 0, batch.data())) {
+        closeAll();
+        std::remove(hdf5File.c_str());
+        return false;
+      }
+      batch.clear();
+      batchRows = 0;
+    }
+  }
+
+  WriteStringAttribute(file, "calibration_version", set.calibrationVersion);
+  closeAll();
+
+  std::cout << "HDF5 analysis events written to " << hdf5File << " (" << nEntries << " events x "
+            << columns.size() << " fields, " << width << " channels)" << std::endl;
+  return true;
+}
+
+// NumPy type string of an H5T_NATIVE_* column type
+std::string NpyDescrOf(hid_t type) {
+  const size_t bytes = H5Tget_size(type);
+  if (H5Tget_class(type) == H5T_FLOAT) {
+    return NpyDescr('f', bytes);
+  }
+  return NpyDescr(H5Tget_sign(type) == H5T_SGN_NONE ? 'u' : 'i', bytes);
+}
+
+std::string JsonQuote(const std::string &text) {
+  std::string out = "\"";
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+    }
+    out += c;
+  }
+  return out + "\"";
+}
+
+std::string JsonIntArray(const std::vector<int> &values) {
+  std::string out = "[";
+  for (size_t i = 0; i < values.size(); ++i) {
+    out += (i ? ", " : "") + std::to_string(values[i]);
+  }
+  return out + "]";
+}
+
+std::string JsonShape(const std::vector<size_t> &shape) {
+  std::string out = "[";
+  for (size_t i = 0; i < shape.size(); ++i) {
+    out += (i ? ", " : "") + std::to_string(shape[i]);
+  }
+  return out + "]";
+}
+
+// Buffered bytes of one .npy export between flushes (all files together)
+constexpr size_t kNpyBatchBytes = 64u << 20;
+
+// Analysis features as .npy files for np.load(..., mmap_mode='r'): one file
+// per column of the columnar layout (<name>.npy, [events] or [events,
+// channels]), all row-aligned by event, and manifest.json with the dtypes,
+// shapes, units, thresholds and the channel/sensor mapping. With rawFile the
+// waveforms of the exported channels go to waveforms.npy [events, channels,
+// samples] (padded with ped_target) and the time axis to time_ns.npy; the
+// raw tree must hold the same events in the same order as the Analysis tree,
+// which is checked on the event branch of every entry. Rows are buffered up
+// to kNpyBatchBytes per flush.
+bool ExportAnalysisNpy(const std::string &rootFile,
+                       const std::string &treeName,
+                       const std::string &outputDir,
+                       int nChannels,
+                       int sensorFilter = -1,
+                       const std::vector<int> *sensorIds = nullptr,
+                       const std::vector<int> *columnIds = nullptr,
+                       const std::vector<int> *stripIds = nullptr,
+                       const ExportCalibration *calib = nullptr,
+                       const std::string &rawFile = "",
+                       const std::string &rawTreeName = "Waveforms") {
+  TFile *fin = TFile::Open(rootFile.c_str(), "READ");
+  if (!fin || fin->IsZombie()) {
+    std::cerr << "ERROR: cannot open ROOT file " << rootFile << std::endl;
+    return false;
+  }
+
+  TTree *tree = dynamic_cast<TTree *>(fin->Get(treeName.c_str()));
+  if (!tree) {
+    std::cerr << "ERROR: tree " << treeName << " not found" << std::endl;
+    fin->Close();
+    return false;
+  }
+
+  const Long64_t nEntries = tree->GetEntries();
+  if (nEntries <= 0) {
+    std::cerr << "WARNING: tree contains no entries" << std::endl;
+    fin->Close();
+    return false;
+  }
+
+  FeatureColumnSet set;
+  if (!SelectFeatureChannels(nChannels, sensorFilter, sensorIds, columnIds, stripIds, set)) {
+    fin->Close();
+    return false;
+  }
+  BindFeatureColumns(tree, nChannels, calib, set);
+  const std::vector<int> &channels = set.channels;
+  std::vector<FeatureColumn> &columns = set.columns;
+  const size_t width = channels.size();
+
+  // Raw waveforms of the same events, read entry by entry alongside
+  TFile *rawIn = nullptr;
+  TTree *rawTree = nullptr;
+  size_t nSamples = 0;
+  int rawSamples = 0;
+  float samplingNs = 0.0f;
+  float pedTarget = 0.0f;
+  std::vector<float> *timeAxis = nullptr;
+  std::vector<int> *samplesPerChannel = nullptr;
+  int rawEvent = -1;
+  std::vector<std::vector<float> *> waveforms(width, nullptr);
+  if (!rawFile.empty()) {
+    rawIn = TFile::Open(rawFile.c_str(), "READ");
+    rawTree = (rawIn && !rawIn->IsZombie()) ? dynamic_cast<TTree *>(rawIn->Get(rawTreeName.c_str())) : nullptr;
+    if (!rawTree) {
+      std::cerr << "ERROR: cannot read tree " << rawTreeName << " of " << rawFile << std::endl;
+      if (rawIn) rawIn->Close();
+      fin->Close();
+      return false;
+    }
+    if (rawTree->GetEntries() != nEntries) {
+      std::cerr << "ERROR: " << rawFile << " holds " << rawTree->GetEntries() << " events, "
+                << rootFile << " " << nEntries << std::endl;
+      rawIn->Close();
+      fin->Close();
+      return false;
+    }
+    if (!set.event || !rawTree->GetBranch("event")) {
+      std::cerr << "ERROR: cannot align " << rawFile << " with " << rootFile
+                << ": both trees need an event branch" << std::endl;
+      rawIn->Close();
+      fin->Close();
+      return false;
+    }
+
+    // Fixed sample axis: the longest record of the run
+    const bool perChannelSamples = rawTree->GetBranch("nsamples_per_channel") != nullptr;
+    nSamples = static_cast<size_t>(std::max(
+        {rawTree->GetMaximum("nsamples"),
+         perChannelSamples ? rawTree->GetMaximum("nsamples_per_channel") : 0.0, 1.0}));
+
+    std::vector<std::string> rawBranches = {"event", "nsamples", "sampling_ns", "ped_target", "time_ns"};
+    rawTree->SetBranchAddress("event", &rawEvent);
+    rawTree->SetBranchAddress("nsamples", &rawSamples);
+    rawTree->SetBranchAddress("sampling_ns", &samplingNs);
+    rawTree->SetBranchAddress("ped_target", &pedTarget);
+    rawTree->SetBranchAddress("time_ns", &timeAxis);
+    if (perChannelSamples) {
+      rawTree->SetBranchAddress("nsamples_per_channel", &samplesPerChannel);
+      rawBranches.push_back("nsamples_per_channel");
+    }
+    for (size_t c = 0; c < width; ++c) {
+      char bname[32];
+      std::snprintf(bname, sizeof(bname), "ch%02d_ped", channels[c]);
+      if (rawTree->GetBranch(bname)) {
+        rawTree->SetBranchAddress(bname, &waveforms[c]);
+        rawBranches.push_back(bname);
+      }
+    }
+    PruneTreeBranches(rawTree, rawBranches);
+  }
+
+  if (!CreateDirectoryIfNeeded(outputDir)) {
+    if (rawIn) rawIn->Close();
+    fin->Close();
+    return false;
+  }
+
+  std::deque<NpyWriter> writers;
+  NpyWriter waveformWriter;
+  auto closeAll = [&]() {
+    writers.clear();
+    if (rawIn) rawIn->Close();
+    fin->Close();
+  };
+  auto abortExport = [&]() {
+    for (const auto &writer : writers) {
+      std::remove(writer.Path().c_str());
+    }
+    if (waveformWriter.IsOpen()) {
+      std::remove(waveformWriter.Path().c_str());
+    }
+    closeAll();
+  };
+
+  // Events per flush: as many rows of all files as fit in kNpyBatchBytes
+  size_t eventBytes = rawTree ? width * nSamples * sizeof(float) : 0;
+  for (const auto &column : columns) {
+    eventBytes += (column.perChannel ? width : 1) * column.valueBytes;
+  }
+  const size_t batchEvents = std::max<size_t>(1, kNpyBatchBytes / std::max<size_t>(eventBytes, 1));
+
+  for (auto &column : columns) {
+    writers.emplace_back();
+    const std::vector<size_t> rowShape =
+        column.perChannel ? std::vector<size_t>{width} : std::vector<size_t>{};
+    if (!writers.back().Open(outputDir + "/" + column.name + ".npy", NpyDescrOf(column.type),
+                             rowShape, column.valueBytes)) {
+      abortExport();
+      return false;
+    }
+    column.batch.reserve(batchEvents * (column.perChannel ? width : 1) * column.valueBytes);
+  }
+  std::vector<float> waveformBatch;
+  std::vector<float> timeAxisCopy;
+  if (rawTree) {
+    if (!waveformWriter.Open(outputDir + "/waveforms.npy", NpyDescr('f', sizeof(float)),
+                             {width, nSamples}, sizeof(float))) {
+      abortExport();
+      return false;
+    }
+    waveformBatch.reserve(batchEvents * width * nSamples);
+  }
+
+  auto flush = [&](size_t rows) {
+    PerfScope scope(kPerfWrite);
+    for (size_t i = 0; i < columns.size(); ++i) {
+      if (!writers[i].Append(columns[i].batch.data(), rows)) {
+        return false;
+      }
+      columns[i].batch.clear();
+    }
+    if (rawTree) {
+      if (!waveformWriter.Append(waveformBatch.data(), rows)) {
+        return false;
+      }
+      waveformBatch.clear();
+    }
+    return true;
+  };
+
+  size_t batchRows = 0;
+  for (Long64_t entry = 0; entry < nEntries; ++entry) {
+    {
+      PerfScope scope(kPerfGetEntry);
+      tree->GetEntry(entry);
+      if (rawTree) {
+        rawTree->GetEntry(entry);
+      }
+    }
+    if (rawTree && rawEvent != *set.event) {
+      std::cerr << "ERROR: entry " << entry << " is event " << rawEvent << " in " << rawFile
+                << " but event " << *set.event << " in " << rootFile << std::endl;
+      abortExport();
+      return false;
+    }
+    PerfAddEvents(1);
+    for (auto &column : columns) {
+      const size_t rowBytes = (column.perChannel ? width : 1) * column.valueBytes;
+      column.batch.resize(column.batch.size() + rowBytes);
+      column.fill(column.batch.data() + column.batch.size() - rowBytes);
+    }
+    if (rawTree) {
+      if (timeAxisCopy.empty() && timeAxis) {
+        timeAxisCopy.assign(timeAxis->begin(), timeAxis->end());
+      }
+      for (size_t c = 0; c < width; ++c) {
+        const std::vector<float> *samples = waveforms[c];
+        int n = rawSamples;
+        if (samplesPerChannel && channels[c] < static_cast<int>(samplesPerChannel->size())) {
+          n = (*samplesPerChannel)[channels[c]];
+        }
+        const size_t valid = samples ? std::min({static_cast<size_t>(std::max(n, 0)), samples->size(), nSamples}) : 0;
+        const size_t offset = waveformBatch.size();
+        waveformBatch.resize(offset + nSamples, pedTarget);
+        if (valid > 0) {
+          std::copy(samples->begin(), samples->begin() + valid, waveformBatch.begin() + offset);
+        }
+      }
+    }
+    if (++batchRows == batchEvents || entry + 1 == nEntries) {
+      if (!flush(batchRows)) {
+        abortExport();
+        return false;
+      }
+      batchRows = 0;
+    }
+  }
+
+  bool ok = true;
+  for (auto &writer : writers) {
+    ok = writer.Close() && ok;
+    PerfAddBytesWritten(FileSizeBytes(writer.Path()));
+  }
+  if (rawTree) {
+    ok = waveformWriter.Close() && ok;
+    PerfAddBytesWritten(FileSizeBytes(waveformWriter.Path()));
+    NpyWriter timeWriter;
+    ok = ok && timeWriter.Open(outputDir + "/time_ns.npy", NpyDescr('f', sizeof(float)), {},
+                               sizeof(float)) &&
+         timeWriter.Append(timeAxisCopy.data(), timeAxisCopy.size()) && timeWriter.Close();
+  }
+  closeAll();
+  if (!ok) {
     return false;
   }
 
-  hid_t file = -1;
-  if (append) {
-    file = H5Fopen(hdf5File.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
-    if (file < 0) {
-      std::cerr << "ERROR: cannot open HDF5 file for appending " << hdf5File << std::endl;
-      return false;
+  // Manifest: what each file holds and how the axes map to the detector
+  const std::string manifestPath = outputDir + "/manifest.json";
+  std::ofstream manifest(manifestPath);
+  if (!manifest) {
+    std::cerr << "ERROR: cannot create " << manifestPath << std::endl;
+    return false;
+  }
+  const size_t events = static_cast<size_t>(nEntries);
+  manifest << "{\n"
+           << "  \"format\": \"npy\",\n"
+           << "  \"source\": " << JsonQuote(rootFile) << ",\n"
+           << "  \"tree\": " << JsonQuote(treeName) << ",\n"
+           << "  \"events\": " << events << ",\n"
+           << "  \"calibration_version\": " << JsonQuote(set.calibrationVersion) << ",\n"
+           << "  \"channel\": " << JsonIntArray(channels) << ",\n"
+           << "  \"sensor_id\": " << JsonIntArray(set.channelSensor) << ",\n"
+           << "  \"column_id\": " << JsonIntArray(set.channelColumn) << ",\n"
+           << "  \"strip_id\": " << JsonIntArray(set.channelStrip) << ",\n"
+           << "  \"columns\": [";
+  for (size_t i = 0; i < columns.size(); ++i) {
+    const FeatureColumn &column = columns[i];
+    const std::vector<size_t> shape =
+        column.perChannel ? std::vector<size_t>{events, width} : std::vector<size_t>{events};
+    manifest << (i ? "," : "") << "\n    {\"name\": " << JsonQuote(column.name)
+             << ", \"file\": " << JsonQuote(column.name + ".npy")
+             << ", \"dtype\": " << JsonQuote(NpyDescrOf(column.type))
+             << ", \"shape\": " << JsonShape(shape);
+    if (const char *units = AnalysisColumnUnits(column.quantity)) {
+      manifest << ", \"units\": " << JsonQuote(units);
     }
-  } else {
-    file = H5Fcreate(hdf5File.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    if (column.hasThreshold) {
+      manifest << ", \"threshold\": " << column.threshold
+               << ", \"threshold_units\": " << JsonQuote(column.thresholdUnit);
+    }
+    manifest << "}";
   }
-  if (file < 0) {
-    std::cerr << "ERROR: cannot create HDF5 file " << hdf5File << std::endl;
-    return false;
+  manifest << "\n  ]";
+  if (rawTree) {
+    manifest << ",\n  \"waveforms\": {\"file\": \"waveforms.npy\", \"dtype\": \"<f4\", \"shape\": "
+             << JsonShape({events, width, nSamples}) << ", \"units\": \"ADC\""
+             << ", \"time_axis\": \"time_ns.npy\", \"sampling_ns\": " << samplingNs
+             << ", \"ped_target\": " << pedTarget << ", \"source\": " << JsonQuote(rawFile) << "}";
   }
-
-  hsize_t dim = features.size();
-  hid_t space = H5Screate_simple(1, &dim, nullptr);
-  hid_t type = H5Tcreate(H5T_COMPOUND, sizeof(AnalysisFeatureMeta));
-
-  H5Tinsert(type, "event", HOFFSET(AnalysisFeatureMeta, event), H5T_NATIVE_UINT32);
-  H5Tinsert(type, "channel", HOFFSET(AnalysisFeatureMeta, channel), H5T_NATIVE_UINT16);
-  H5Tinsert(type, "sensor_id", HOFFSET(AnalysisFeatureMeta, sensor_id), H5T_NATIVE_UINT16);
-  H5Tinsert(type, "column_id", HOFFSET(AnalysisFeatureMeta, column_id), H5T_NATIVE_UINT16);
-  H5Tinsert(type, "strip_id", HOFFSET(AnalysisFeatureMeta, strip_id), H5T_NATIVE_UINT16);
-  H5Tinsert(type, "baseline",         HOFFSET(AnalysisFeatureMeta, baseline),         H5T_NATIVE_FLOAT);
-  H5Tinsert(type, "rmsNoise",         HOFFSET(AnalysisFeatureMeta, rmsNoise),         H5T_NATIVE_FLOAT);
-  H5Tinsert(type, "rmsNoise_mV",      HOFFSET(AnalysisFeatureMeta, rmsNoise_mV),      H5T_NATIVE_FLOAT);
-  H5Tinsert(type, "noise1Point",      HOFFSET(AnalysisFeatureMeta, noise1Point),      H5T_NATIVE_FLOAT);
-  H5Tinsert(type, "ampMinBefore",     HOFFSET(AnalysisFeatureMeta, ampMinBefore),     H5T_NATIVE_FLOAT);
-  H5Tinsert(type, "ampMaxBefore",     HOFFSET(AnalysisFeatureMeta, ampMaxBefore),     H5T_NATIVE_FLOAT);
-  H5Tinsert(type, "ampMax_mV",        HOFFSET(AnalysisFeatureMeta, ampMax),           H5T_NATIVE_FLOAT);
-  H5Tinsert(type, "ampMax_Fit_mV",    HOFFSET(AnalysisFeatureMeta, ampMax_Fit_mV),    H5T_NATIVE_FLOAT);
-  H5Tinsert(type, "charge",           HOFFSET(AnalysisFeatureMeta, charge),           H5T_NATIVE_FLOAT);
-  H5Tinsert(type, "signalOverNoise",  HOFFSET(AnalysisFeatureMeta, signalOverNoise),  H5T_NATIVE_FLOAT);
-  H5Tinsert(type, "peakTime",         HOFFSET(AnalysisFeatureMeta, peakTime),         H5T_NATIVE_FLOAT);
-  H5Tinsert(type, "riseTime",         HOFFSET(AnalysisFeatureMeta, riseTime),         H5T_NATIVE_FLOAT);
-  H5Tinsert(type, "riseTime_Fit",     HOFFSET(AnalysisFeatureMeta, riseTime_Fit),     H5T_NATIVE_FLOAT);
-  H5Tinsert(type, "slewRate",         HOFFSET(AnalysisFeatureMeta, slewRate),         H5T_NATIVE_FLOAT);
-  H5Tinsert(type, "slewRate_Fit_mV",  HOFFSET(AnalysisFeatureMeta, slewRate_Fit_mV),  H5T_NATIVE_FLOAT);
-  H5Tinsert(type, "timeCFD_50pc",     HOFFSET(AnalysisFeatureMeta, timeCFD_50pc),     H5T_NATIVE_FLOAT);
-  H5Tinsert(type, "timeCFD_Fit_50pc", HOFFSET(AnalysisFeatureMeta, timeCFD_Fit_50pc), H5T_NATIVE_FLOAT);
-
-  hid_t dset = H5Dcreate(file, "AnalysisFeatures", type, space,
-                        H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-  if (dset < 0) {
-    std::cerr << "ERROR: cannot create dataset" << std::endl;
-    H5Tclose(type);
-    H5Sclose(space);
-    H5Fclose(file);
+  manifest << "\n}\n";
+  if (!manifest) {
+    std::cerr << "ERROR: write to " << manifestPath << " failed" << std::endl;
     return false;
   }
 
-  H5Dwrite(dset, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, features.data());
-
-  H5Dclose(dset);
-  H5Tclose(type);
-  H5Sclose(space);
-  H5Fclose(file);
-
-  std::cout << "HDF5 analysis features written to " << hdf5File << std::endl;
+  std::cout << "NumPy analysis columns written to " << outputDir << " (" << columns.size()
+            << " arrays x " << nEntries << " events, " << width << " channels"
+            << (rawTree ? ", waveforms.npy" : "") << ")" << std::endl;
   return true;
 }
 
@@ -684,7 +2051,9 @@ bool ExportCorryHits(const std::string &rootFile,
                      const std::vector<int> *columnIds = nullptr,
                      const std::vector<int> *stripIds = nullptr,
                      int defaultColumn = 1,
-                     bool onlyCorryFields = true) {
+                     bool onlyCorryFields = true,
+                     const ExportCalibration *calib = nullptr,
+                     const Hdf5StorageOptions &storage = Hdf5StorageOptions()) {
   TFile *fin = TFile::Open(rootFile.c_str(), "READ");
   if (!fin || fin->IsZombie()) {
     std::cerr << "ERROR: cannot open ROOT file " << rootFile << std::endl;
@@ -700,25 +2069,25 @@ bool ExportCorryHits(const std::string &rootFile,
 
   int event = 0;
   // ampMax_Fit_mV is used as Corryvreckan charge
-  std::vector<float> *ampMax        = nullptr;  // stored in Hits.raw
-  std::vector<float> *ampMax_Fit_mV = nullptr;  // stored in Hits.charge
+  std::vector<float> *ampMax = nullptr;  // stored in Hits.raw
+  MilliVoltColumn colAmpMax_Fit_mV;      // stored in Hits.charge
 
   tree->SetBranchAddress("event", &event);
   if (tree->GetBranch("ampMax"))        tree->SetBranchAddress("ampMax",        &ampMax);
-  if (tree->GetBranch("ampMax_Fit_mV")) tree->SetBranchAddress("ampMax_Fit_mV", &ampMax_Fit_mV);
+  colAmpMax_Fit_mV.Bind(tree, "ampMax_Fit", CalibRule::kFitScaleOrZero, calib);
+  const std::string calibrationVersion =
+      colAmpMax_Fit_mV.Computed() ? calib->version : TreeCalibrationVersion(tree);
 
   // timeCFD_Fit_50pc of sensor3 in the same DAQ is used as the reference time
   const int kCFD = 50;
-  std::vector<float> chTimeCFD_Fit(nChannels, 0.0f);
-  std::vector<bool>  chHasCFD_Fit(nChannels, false);
-  for (int ch = 0; ch < nChannels; ++ch) {
-    char b[64];
-    std::snprintf(b, sizeof(b), "ch%02d_timeCFD_Fit_%dpc", ch, kCFD);
-    if (tree->GetBranch(b)) {
-      tree->SetBranchAddress(b, &chTimeCFD_Fit[ch]);
-      chHasCFD_Fit[ch] = true;
-    }
+  TimingColumnReader chTimeCFD_Fit;
+  chTimeCFD_Fit.Bind(tree, ReadAnalysisTreeLayout(tree, nChannels), "timeCFD_Fit", kCFD);
+
+  std::vector<std::string> readBranches = {"event", "ampMax"};
+  for (const auto *names : {&colAmpMax_Fit_mV.BranchNames(), &chTimeCFD_Fit.BranchNames()}) {
+    readBranches.insert(readBranches.end(), names->begin(), names->end());
   }
+  PruneTreeBranches(tree, readBranches);
 
   // Locate sensor3 channel within this DAQ (used as timing reference)
   int sensor3Ch = -1;
@@ -740,27 +2109,21 @@ bool ExportCorryHits(const std::string &rootFile,
     return false;
   }
 
-  #pragma pack(push, 1)
-  struct HitRow {
-    uint16_t column;
-    uint16_t row;
-    uint8_t raw;
-    double charge;
-    double timestamp;
-    uint32_t trigger_number;
-  };
-  #pragma pack(pop)
-
   std::vector<HitRow> hits;
   hits.reserve(static_cast<size_t>(nEntries) * nChannels);
 
   for (Long64_t entry = 0; entry < nEntries; ++entry) {
-    tree->GetEntry(entry);
+    {
+      PerfScope scope(kPerfGetEntry);
+      tree->GetEntry(entry);
+    }
+    PerfAddEvents(1);
+    const std::vector<float> *ampMax_Fit_mV = colAmpMax_Fit_mV.Values();
 
     // Determine sensor3 reference time for this event
     // timeCFD_Fit_50pc of sensor3 in the same DAQ is used as the reference time
-    bool hasRef = (sensor3Ch >= 0 && chHasCFD_Fit[sensor3Ch]);
-    float refTime = hasRef ? chTimeCFD_Fit[sensor3Ch] : 0.0f;
+    bool hasRef = (sensor3Ch >= 0 && chTimeCFD_Fit.Has(sensor3Ch));
+    float refTime = hasRef ? chTimeCFD_Fit.Value(sensor3Ch) : 0.0f;
 
     for (int ch = 0; ch < nChannels; ++ch) {
       if (sensorFilter >= 0 && sensorIds && ch < static_cast<int>(sensorIds->size())) {
@@ -780,39 +2143,24 @@ bool ExportCorryHits(const std::string &rootFile,
         continue;
       }
 
-      HitRow hit{};
       // Column: default or per-channel mapping if provided
-      if (columnIds && ch < static_cast<int>(columnIds->size())) {
-        hit.column = static_cast<uint16_t>((*columnIds)[ch]);
-      } else {
-        hit.column = static_cast<uint16_t>(defaultColumn);
-      }
+      const int column = (columnIds && ch < static_cast<int>(columnIds->size()))
+                             ? (*columnIds)[ch] : defaultColumn;
       // Row: use strip_ids if available, otherwise use channel index
-      if (stripIds && ch < static_cast<int>(stripIds->size())) {
-        hit.row = static_cast<uint16_t>((*stripIds)[ch]);
-      } else {
-        hit.row = static_cast<uint16_t>(ch);
-      }
+      const int row = (stripIds && ch < static_cast<int>(stripIds->size())) ? (*stripIds)[ch] : ch;
 
-      // raw = ampMax (cast to uint8_t; clamped to [0, 255])
-      float rawAmp = (ampMax && ch < static_cast<int>(ampMax->size())) ? (*ampMax)[ch] : 0.0f;
-      hit.raw = static_cast<uint8_t>(std::min(255.0f, std::max(0.0f, rawAmp)));
-
-      // charge = ampMax_Fit_mV  (ampMax_Fit_mV is used as Corryvreckan charge)
-      hit.charge = (ampMax_Fit_mV && ch < static_cast<int>(ampMax_Fit_mV->size()))
-                   ? static_cast<double>((*ampMax_Fit_mV)[ch]) : 0.0;
+      // raw = ampMax, charge = ampMax_Fit_mV (used as Corryvreckan charge)
+      const float rawAmp = (ampMax && ch < static_cast<int>(ampMax->size())) ? (*ampMax)[ch] : 0.0f;
+      const float chargeMilliVolt = (ampMax_Fit_mV && ch < static_cast<int>(ampMax_Fit_mV->size()))
+                                        ? (*ampMax_Fit_mV)[ch] : 0.0f;
 
       // timestamp:
       //   DUT0-2: sensor3_timeCFD_Fit_50pc - hit_timeCFD_Fit_50pc
       //   sensor3: sensor3 timestamp is stored without reference subtraction
-      float rawCFD = chHasCFD_Fit[ch] ? chTimeCFD_Fit[ch] : 0.0f;
-      float finalTimestamp = (thisSensorId != 3 && hasRef)
-                             ? (refTime - rawCFD)
-                             : rawCFD;
-      hit.timestamp = static_cast<double>(finalTimestamp);
-      hit.trigger_number = static_cast<uint32_t>(event);
-
-      hits.push_back(hit);
+      hits.push_back(MakeCorryHit(static_cast<uint16_t>(column), static_cast<uint16_t>(row), rawAmp,
+                                  chargeMilliVolt, chTimeCFD_Fit.Value(ch),
+                                  thisSensorId != 3 && hasRef, refTime,
+                                  static_cast<uint32_t>(event)));
     }
   }
 
@@ -830,28 +2178,19 @@ bool ExportCorryHits(const std::string &rootFile,
     return false;
   }
 
-  hsize_t dim = hits.size();
-  hid_t space = H5Screate_simple(1, &dim, nullptr);
+  hid_t type = CreateHitRowType();
 
-  hid_t type = H5Tcreate(H5T_COMPOUND, sizeof(HitRow));
-  H5Tinsert(type, "column", HOFFSET(HitRow, column), H5T_NATIVE_UINT16);
-  H5Tinsert(type, "row", HOFFSET(HitRow, row), H5T_NATIVE_UINT16);
-  H5Tinsert(type, "raw", HOFFSET(HitRow, raw), H5T_NATIVE_UINT8);
-  H5Tinsert(type, "charge", HOFFSET(HitRow, charge), H5T_NATIVE_DOUBLE);
-  H5Tinsert(type, "timestamp", HOFFSET(HitRow, timestamp), H5T_NATIVE_DOUBLE);
-  H5Tinsert(type, "trigger_number", HOFFSET(HitRow, trigger_number), H5T_NATIVE_UINT32);
-
-  hid_t dset = H5Dcreate(file, "Hits", type, space,
-                        H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+  hid_t dset = CreateRowDataset(file, "Hits", type, hits.size(), storage);
   if (dset < 0) {
-    std::cerr << "ERROR: cannot create Hits dataset" << std::endl;
     H5Tclose(type);
-    H5Sclose(space);
     H5Fclose(file);
     return false;
   }
 
-  H5Dwrite(dset, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, hits.data());
+  {
+    PerfScope scope(kPerfWrite);
+    H5Dwrite(dset, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, hits.data());
+  }
 
   // Mark whether only Corryvreckan fields are stored
   hid_t attrSpace = H5Screate(H5S_SCALAR);
@@ -864,10 +2203,10 @@ bool ExportCorryHits(const std::string &rootFile,
     }
     H5Sclose(attrSpace);
   }
+  WriteStringAttribute(file, "calibration_version", calibrationVersion);
 
   H5Dclose(dset);
   H5Tclose(type);
-  H5Sclose(space);
   H5Fclose(file);
 
   std::cout << "HDF5 Corryvreckan Hits written to " << hdf5File << std::endl;
@@ -875,11 +2214,311 @@ bool ExportCorryHits(const std::string &rootFile,
 }
 
 // Export analysis features from multiple DAQ configs, merging data by sensor
+// Corryvreckan hit of the multi-DAQ export with the sensor it belongs to
+struct SensorHit {
+  int sensorId;
+  HitRow hit;
+};
+
+// Entries decoded per block by a DAQ reader thread
+constexpr size_t kCursorBlockEvents = 512;
+
+// One DAQ analysis tree read in event order on its own thread. Trees written
+// by Stage 2 are already ordered; otherwise the entries are visited through
+// a sorted index built from the event branch alone.
+struct DaqHitCursor {
+  const DaqConfig *cfg = nullptr;
+  TFile *file = nullptr;
+  TTree *tree = nullptr;
+  int event = 0;
+  std::vector<float> *ampMax = nullptr;  // stored in Hits.raw
+  MilliVoltColumn ampMaxFitMilliVolt;     // stored in Hits.charge
+  TimingColumnReader cfd;                 // timeCFD_Fit_50pc
+  int sensor3Channel = -1;                // timestamp reference, -1: none
+  std::vector<Long64_t> entryOrder;       // empty: sequential
+  Long64_t nEntries = 0;
+
+  // Decoded events handed from the reader thread to the merge
+  struct EventBlock {
+    std::vector<int> events;
+    std::vector<size_t> ends;  // hits of events[i] end at hits[ends[i]]
+    std::vector<SensorHit> hits;
+  };
+  std::thread reader;
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<EventBlock> blocks;  // at most 2 pending
+  bool finished = false;
+  bool stop = false;
+  EventBlock current;             // merge side
+  size_t currentIndex = 0;
+
+  ~DaqHitCursor() {
+    if (reader.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+      }
+      changed.notify_all();
+      reader.join();
+    }
+    if (file) file->Close();
+  }
+
+  void StartReading() {
+    reader = std::thread(&DaqHitCursor::Read, this);
+  }
+
+  // Event of the next pending entry; false when the tree is exhausted
+  bool Peek(int &nextEvent) {
+    while (currentIndex >= current.events.size()) {
+      std::unique_lock<std::mutex> lock(mutex);
+      changed.wait(lock, [this] { return !blocks.empty() || finished; });
+      if (blocks.empty()) {
+        return false;
+      }
+      current = std::move(blocks.front());
+      blocks.pop_front();
+      currentIndex = 0;
+      lock.unlock();
+      changed.notify_all();
+    }
+    nextEvent = current.events[currentIndex];
+    return true;
+  }
+
+  // Append the hits of the pending entry and move to the next one
+  void Take(std::vector<SensorHit> &hits) {
+    const size_t begin = (currentIndex == 0) ? 0 : current.ends[currentIndex - 1];
+    hits.insert(hits.end(), current.hits.begin() + begin,
+                current.hits.begin() + current.ends[currentIndex]);
+    ++currentIndex;
+  }
+
+  void Read() {
+    for (Long64_t position = 0; position < nEntries;) {
+      EventBlock block;
+      for (size_t n = 0; n < kCursorBlockEvents && position < nEntries; ++n, ++position) {
+        {
+          PerfScope scope(kPerfGetEntry);
+          tree->GetEntry(entryOrder.empty() ? position : entryOrder[position]);
+        }
+        PerfAddEvents(1);
+        block.events.push_back(event);
+        CollectHits(block.hits);
+        block.ends.push_back(block.hits.size());
+      }
+      std::unique_lock<std::mutex> lock(mutex);
+      changed.wait(lock, [this] { return blocks.size() < 2 || stop; });
+      if (stop) {
+        break;
+      }
+      blocks.push_back(std::move(block));
+      lock.unlock();
+      changed.notify_all();
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      finished = true;
+    }
+    changed.notify_all();
+  }
+
+  // Append the hits of the loaded entry
+  void CollectHits(std::vector<SensorHit> &hits) {
+    const std::vector<float> *ampMaxFit = ampMaxFitMilliVolt.Values();
+    const float referenceCFD = (sensor3Channel >= 0) ? cfd.Value(sensor3Channel) : 0.0f;
+    const int nChannels = std::min(cfg->nChannels, static_cast<int>(cfg->sensorIds.size()));
+    for (int ch = 0; ch < nChannels; ++ch) {
+      SensorHit entry{};
+      entry.sensorId = cfg->sensorIds[ch];
+      const int column = ch < static_cast<int>(cfg->columnIds.size()) ? cfg->columnIds[ch] : 1;
+      const int row = ch < static_cast<int>(cfg->stripIds.size()) ? cfg->stripIds[ch] : ch;
+
+      // raw = ampMax (uint8_t clamp), charge = ampMax_Fit_mV
+      const float rawAmp = (ampMax && ch < static_cast<int>(ampMax->size())) ? (*ampMax)[ch] : 0.0f;
+      const float chargeMilliVolt = (ampMaxFit && ch < static_cast<int>(ampMaxFit->size()))
+                                        ? (*ampMaxFit)[ch] : 0.0f;
+
+      // Timestamp: DUT0-2 = sensor3_timeCFD_Fit_50pc - hit_timeCFD_Fit_50pc
+      //            DUT3   = hit_timeCFD_Fit_50pc (no subtraction)
+      // Without a sensor3 reference in this DAQ the raw value is kept.
+      entry.hit = MakeCorryHit(static_cast<uint16_t>(column), static_cast<uint16_t>(row), rawAmp,
+                               chargeMilliVolt, cfd.Value(ch),
+                               entry.sensorId != 3 && sensor3Channel >= 0, referenceCFD,
+                               static_cast<uint32_t>(event));
+      hits.push_back(entry);
+    }
+  }
+};
+
+// Open a DAQ analysis file and bind the branches of the hit record.
+// Returns false when the DAQ has to be skipped (reported as a warning).
+bool OpenDaqHitCursor(const DaqConfig &daqCfg, const std::string &treeName,
+                      DaqHitCursor &cursor, std::string &calibrationVersions) {
+  std::cout << "\nReading " << daqCfg.daqName << ": " << daqCfg.rootFilePath << std::endl;
+  cursor.cfg = &daqCfg;
+
+  // Find the channel mapped to sensor3 in this DAQ (timestamp reference)
+  int sensor3Count = 0;
+  std::map<int, int> channelsPerSensor;
+  for (int ch = 0; ch < daqCfg.nChannels &&
+                   ch < static_cast<int>(daqCfg.sensorIds.size()); ++ch) {
+    channelsPerSensor[daqCfg.sensorIds[ch]]++;
+    if (daqCfg.sensorIds[ch] == 3) {
+      if (sensor3Count == 0) cursor.sensor3Channel = ch;
+      ++sensor3Count;
+    }
+  }
+  if (sensor3Count == 0) {
+    std::cout << "  INFO: " << daqCfg.daqName
+              << " has no sensor3 channel — no reference correction applied for this DAQ"
+              << std::endl;
+  } else if (sensor3Count > 1) {
+    std::cerr << "  WARNING: " << daqCfg.daqName << " has " << sensor3Count
+              << " channels mapped to sensor3 (expected 1), using first found (ch"
+              << cursor.sensor3Channel << ")" << std::endl;
+  }
+
+  cursor.file = TFile::Open(daqCfg.rootFilePath.c_str(), "READ");
+  if (!cursor.file || cursor.file->IsZombie()) {
+    std::cerr << "  WARNING: cannot open ROOT file " << daqCfg.rootFilePath
+              << ", skipping" << std::endl;
+    return false;
+  }
+
+  cursor.tree = dynamic_cast<TTree *>(cursor.file->Get(treeName.c_str()));
+  if (!cursor.tree) {
+    std::cerr << "  WARNING: tree " << treeName << " not found, skipping" << std::endl;
+    return false;
+  }
+  TTree *tree = cursor.tree;
+
+  tree->SetBranchAddress("event", &cursor.event);
+  if (tree->GetBranch("ampMax")) tree->SetBranchAddress("ampMax", &cursor.ampMax);
+  cursor.ampMaxFitMilliVolt.Bind(tree, "ampMax_Fit", CalibRule::kFitScaleOrZero, &daqCfg.calibration);
+  const std::string version = cursor.ampMaxFitMilliVolt.Computed() ? daqCfg.calibration.version
+                                                                   : TreeCalibrationVersion(tree);
+  calibrationVersions += (calibrationVersions.empty() ? "" : ";") + daqCfg.daqName + "=" + version;
+
+  // Read per-channel timeCFD_Fit_50pc (scalar or array branch layout)
+  cursor.cfd.Bind(tree, ReadAnalysisTreeLayout(tree, daqCfg.nChannels), "timeCFD_Fit", 50);
+  if (cursor.sensor3Channel >= 0 && !cursor.cfd.Has(cursor.sensor3Channel)) {
+    std::cerr << "  WARNING: timeCFD_Fit_50pc of ch" << cursor.sensor3Channel << " not found in "
+              << daqCfg.daqName << " — no reference correction applied" << std::endl;
+    cursor.sensor3Channel = -1;
+  }
+
+  std::vector<std::string> readBranches = {"event", "ampMax"};
+  for (const auto *names : {&cursor.ampMaxFitMilliVolt.BranchNames(), &cursor.cfd.BranchNames()}) {
+    readBranches.insert(readBranches.end(), names->begin(), names->end());
+  }
+  std::cout << "  ";
+  PruneTreeBranches(tree, readBranches);
+
+  // The merge needs the entries in event order: check it on the event branch
+  cursor.nEntries = tree->GetEntries();
+  TBranch *eventBranch = tree->GetBranch("event");
+  if (!eventBranch) {
+    std::cerr << "  WARNING: branch event not found, skipping" << std::endl;
+    return false;
+  }
+  bool ordered = true;
+  int previousEvent = 0;
+  for (Long64_t entry = 0; entry < cursor.nEntries && ordered; ++entry) {
+    eventBranch->GetEntry(entry);
+    ordered = (entry == 0 || cursor.event >= previousEvent);
+    previousEvent = cursor.event;
+  }
+  if (!ordered) {
+    std::cout << "  INFO: " << daqCfg.daqName << " entries are not in event order, reading through a sorted index"
+              << std::endl;
+    std::vector<int> events(static_cast<size_t>(cursor.nEntries));
+    cursor.entryOrder.resize(events.size());
+    for (Long64_t entry = 0; entry < cursor.nEntries; ++entry) {
+      eventBranch->GetEntry(entry);
+      events[entry] = cursor.event;
+      cursor.entryOrder[entry] = entry;
+    }
+    std::stable_sort(cursor.entryOrder.begin(), cursor.entryOrder.end(),
+                     [&events](Long64_t a, Long64_t b) { return events[a] < events[b]; });
+  }
+
+  for (const auto &sensor : channelsPerSensor) {
+    std::cout << "  Sensor " << sensor.first << ": " << sensor.second << " channels" << std::endl;
+  }
+  return true;
+}
+
+// Hits file of one sensor. The merge collects one chunk of rows at a time in
+// `batch`; the file is created, written and closed on the writer thread.
+struct HitSink {
+  std::string path;
+  hid_t file = -1;  // writer thread
+  hid_t dset = -1;  // writer thread
+  std::vector<unsigned char> batch;
+  hsize_t batchRows = 0;
+  hsize_t rows = 0;    // rows queued for writing
+  hsize_t chunks = 0;  // chunks handed to the encoder
+};
+
+// Queue the batched rows of a sink: encoded on the encoder threads when the
+// filters allow it, otherwise appended (and compressed by the library) on the
+// writer thread. The first batch also creates the file, so sensors without
+// hits get none.
+void QueueHitBatch(HitSink &sink, hid_t type, hsize_t chunkRows,
+                   const Hdf5StorageOptions &storage, Hdf5WriteQueue &writer,
+                   Hdf5ChunkEncoder *encoder) {
+  if (sink.batchRows == 0) {
+    return;
+  }
+  if (sink.rows == 0) {
+    writer.Push([&sink, type, chunkRows, &storage]() {
+      size_t lastSlash = sink.path.find_last_of('/');
+      if (lastSlash != std::string::npos && !CreateDirectoryIfNeeded(sink.path.substr(0, lastSlash))) {
+        std::cerr << "ERROR: failed to create output directory: " << sink.path.substr(0, lastSlash) << std::endl;
+        return false;
+      }
+      sink.file = H5Fcreate(sink.path.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+      if (sink.file < 0) {
+        std::cerr << "ERROR: cannot create HDF5 file " << sink.path << std::endl;
+        return false;
+      }
+      sink.dset = CreateAppendableDataset(sink.file, "Hits", type, 0, chunkRows, nullptr, &storage);
+      return sink.dset >= 0;
+    });
+  }
+
+  if (encoder) {
+    encoder->Submit(&sink.dset, sink.chunks++, chunkRows, sink.batchRows, sizeof(HitRow),
+                    std::move(sink.batch));
+  } else {
+    auto rows = std::make_shared<std::vector<unsigned char>>(std::move(sink.batch));
+    const hsize_t nRows = sink.batchRows;
+    writer.Push([&sink, type, nRows, rows]() {
+      PerfScope scope(kPerfWrite);
+      return AppendRows(sink.dset, type, nRows, 0, rows->data());
+    });
+  }
+  sink.rows += sink.batchRows;
+  sink.batch.clear();
+  sink.batchRows = 0;
+}
+
+void CloseHitSink(HitSink &sink) {
+  if (sink.dset >= 0) H5Dclose(sink.dset);
+  if (sink.file >= 0) H5Fclose(sink.file);
+  sink.dset = -1;
+  sink.file = -1;
+}
+
 bool ExportAnalysisFeaturesMultiDAQ(const std::vector<DaqConfig> &daqConfigs,
                                      const std::string &treeName,
                                      const std::string &outputDir,
                                      const std::string &baseOutputName,
-                                     bool splitBySensor = true) {
+                                     bool splitBySensor = true,
+                                     const Hdf5StorageOptions &storage = Hdf5StorageOptions(),
+                                     int threads = 0) {
   if (daqConfigs.empty()) {
     std::cerr << "ERROR: no DAQ configs provided" << std::endl;
     return false;
@@ -896,257 +2535,139 @@ bool ExportAnalysisFeaturesMultiDAQ(const std::vector<DaqConfig> &daqConfigs,
   std::cout << "Found " << uniqueSensorIds.size() << " unique sensors across "
             << daqConfigs.size() << " DAQs" << std::endl;
 
-  // Pre-pass: collect peak time of sensor3 per DAQ per event, used as reference time.
-  // reference_time[daqName][eventNumber] = peakTime of sensor3 channel
-  std::map<std::string, std::map<uint32_t, float>> sensor3RefTimes;
-  for (const auto &daqCfg : daqConfigs) {
-    // Find the channel(s) mapped to sensor3 in this DAQ
-    int sensor3Channel = -1;
-    int sensor3Count = 0;
-    for (int ch = 0; ch < daqCfg.nChannels &&
-                     ch < static_cast<int>(daqCfg.sensorIds.size()); ++ch) {
-      if (daqCfg.sensorIds[ch] == 3) {
-        if (sensor3Count == 0) sensor3Channel = ch;
-        ++sensor3Count;
-      }
-    }
-    if (sensor3Count == 0) {
-      std::cout << "  INFO: " << daqCfg.daqName
-                << " has no sensor3 channel — no reference correction applied for this DAQ"
-                << std::endl;
-      continue;
-    }
-    if (sensor3Count > 1) {
-      std::cerr << "  WARNING: " << daqCfg.daqName << " has " << sensor3Count
-                << " channels mapped to sensor3 (expected 1), using first found (ch"
-                << sensor3Channel << ")" << std::endl;
-    }
-
-    TFile *fref = TFile::Open(daqCfg.rootFilePath.c_str(), "READ");
-    if (!fref || fref->IsZombie()) {
-      std::cerr << "  WARNING: cannot open ROOT file for sensor3 pre-pass: "
-                << daqCfg.rootFilePath << std::endl;
-      continue;
-    }
-    TTree *tref = dynamic_cast<TTree *>(fref->Get(treeName.c_str()));
-    if (!tref) {
-      std::cerr << "  WARNING: tree " << treeName
-                << " not found in pre-pass for " << daqCfg.daqName << std::endl;
-      fref->Close();
-      continue;
-    }
-
-    int refEvent = 0;
-    float refCFD = 0.0f;
-    tref->SetBranchAddress("event", &refEvent);
-    char cfdBranchNameRef[64];
-    std::snprintf(cfdBranchNameRef, sizeof(cfdBranchNameRef), "ch%02d_timeCFD_Fit_50pc", sensor3Channel);
-    if (!tref->GetBranch(cfdBranchNameRef)) {
-      std::cerr << "  WARNING: branch " << cfdBranchNameRef << " not found in "
-                << daqCfg.daqName << " — no reference correction applied" << std::endl;
-      fref->Close();
-      continue;
-    }
-    tref->SetBranchAddress(cfdBranchNameRef, &refCFD);
+  // Each DAQ tree is read and decoded on its own thread (ROOT objects stay
+  // with the thread that reads them)
+  ROOT::EnableThreadSafety();
 
-    auto &refMap = sensor3RefTimes[daqCfg.daqName];
-    const Long64_t nRefEntries = tref->GetEntries();
-    for (Long64_t entry = 0; entry < nRefEntries; ++entry) {
-      tref->GetEntry(entry);
-      refMap[static_cast<uint32_t>(refEvent)] = refCFD;
+  // Open every DAQ once; the sensor3 reference time of a hit is taken from
+  // the same entry, so no per-event reference table is needed
+  std::string calibrationVersions;  // e.g. "daq00=pol1-v1;daq01=pol1-v1"
+  std::vector<std::unique_ptr<DaqHitCursor>> cursors;
+  for (const auto &daqCfg : daqConfigs) {
+    auto cursor = std::make_unique<DaqHitCursor>();
+    if (OpenDaqHitCursor(daqCfg, treeName, *cursor, calibrationVersions)) {
+      cursors.push_back(std::move(cursor));
     }
-    fref->Close();
-    std::cout << "  Pre-pass " << daqCfg.daqName << ": collected " << refMap.size()
-              << " sensor3 timeCFD_Fit_50pc reference times" << std::endl;
   }
 
-  // Process each sensor
+  // One output file per sensor; without splitBySensor all sensors share one
+  // sink, so the combined file holds every sensor's hits (per event in
+  // sensor order) instead of only the last sensor written
+  std::map<int, HitSink *> sinkBySensor;
+  std::map<std::string, HitSink> sinks;
   for (int sensorId : uniqueSensorIds) {
-    std::cout << "\nProcessing sensor " << sensorId << "..." << std::endl;
-
-    #pragma pack(push, 1)
-    struct HitRow {
-      uint16_t column;
-      uint16_t row;
-      uint8_t raw;
-      double charge;
-      double timestamp;
-      uint32_t trigger_number;
-    };
-    #pragma pack(pop)
-
-    std::vector<HitRow> allHits;
-
-    // Collect data from all DAQs for this sensor
-    for (const auto &daqCfg : daqConfigs) {
-      std::cout << "  Reading " << daqCfg.daqName << ": " << daqCfg.rootFilePath << std::endl;
-
-      TFile *fin = TFile::Open(daqCfg.rootFilePath.c_str(), "READ");
-      if (!fin || fin->IsZombie()) {
-        std::cerr << "  WARNING: cannot open ROOT file " << daqCfg.rootFilePath
-                  << ", skipping" << std::endl;
-        continue;
-      }
+    const std::string hdf5File = splitBySensor
+        ? outputDir + "/sensor" + std::to_string(sensorId) + "_" + baseOutputName
+        : outputDir + "/" + baseOutputName;
+    HitSink &sink = sinks[hdf5File];
+    sink.path = hdf5File;
+    sinkBySensor[sensorId] = &sink;
+  }
 
-      TTree *tree = dynamic_cast<TTree *>(fin->Get(treeName.c_str()));
-      if (!tree) {
-        std::cerr << "  WARNING: tree " << treeName << " not found, skipping" << std::endl;
-        fin->Close();
-        continue;
-      }
+  // Chunks of all sensor files are compressed on the encoder threads; every
+  // HDF5 call runs on the single writer thread
+  const unsigned int nThreads = (threads > 0) ? static_cast<unsigned int>(threads)
+                                              : std::max(1u, std::thread::hardware_concurrency());
+  const hsize_t chunkRows = ChunkRowsFor(storage, sizeof(HitRow));
+  hid_t type = CreateHitRowType();
+  Hdf5WriteQueue writer(2 * nThreads);
+  std::unique_ptr<Hdf5ChunkEncoder> encoder;
+  if (ChunksEncodable(storage)) {
+    encoder = std::make_unique<Hdf5ChunkEncoder>(nThreads, writer, storage);
+  }
+  writer.Start();
+  if (encoder) {
+    encoder->Start();
+  }
+  for (auto &cursor : cursors) {
+    cursor->StartReading();
+  }
 
+  // k-way merge of the event-ordered DAQ streams: take all entries of the
+  // smallest pending event, order its hits by sensor, column and row and
+  // append them to the sensor files. Hits therefore come out sorted by
+  // (trigger_number, column, row) per sensor without a global sort, and
+  // memory stays at a few blocks per DAQ and chunks per sensor.
+  std::cout << "\nMerging " << cursors.size() << " DAQ streams by event ("
+            << (encoder ? nThreads : 0) << " encoder threads)..." << std::endl;
+  std::vector<SensorHit> eventHits;
+  while (!writer.Failed()) {
+    bool pending = false;
+    int nextEvent = 0;
+    for (const auto &cursor : cursors) {
       int event = 0;
-      std::vector<float> *ampMax        = nullptr;  // stored in Hits.raw
-      std::vector<float> *ampMax_Fit_mV = nullptr;  // stored in Hits.charge
-
-      tree->SetBranchAddress("event", &event);
-      if (tree->GetBranch("ampMax"))        tree->SetBranchAddress("ampMax",        &ampMax);
-      if (tree->GetBranch("ampMax_Fit_mV")) tree->SetBranchAddress("ampMax_Fit_mV", &ampMax_Fit_mV);
-
-      // Read per-channel timeCFD_Fit_50pc branches
-      std::vector<float> chCFD(daqCfg.nChannels, 0.0f);
-      std::vector<bool> chHasCFD(daqCfg.nChannels, false);
-      for (int ch = 0; ch < daqCfg.nChannels; ++ch) {
-        char cfdBranchName[64];
-        std::snprintf(cfdBranchName, sizeof(cfdBranchName), "ch%02d_timeCFD_Fit_50pc", ch);
-        if (tree->GetBranch(cfdBranchName)) {
-          tree->SetBranchAddress(cfdBranchName, &chCFD[ch]);
-          chHasCFD[ch] = true;
-        }
+      if (cursor->Peek(event) && (!pending || event < nextEvent)) {
+        nextEvent = event;
+        pending = true;
       }
+    }
+    if (!pending) {
+      break;
+    }
 
-      const Long64_t nEntries = tree->GetEntries();
-      size_t channelsAdded = 0;
-
-      for (Long64_t entry = 0; entry < nEntries; ++entry) {
-        tree->GetEntry(entry);
-
-        for (int ch = 0; ch < daqCfg.nChannels; ++ch) {
-          // Filter by sensor
-          if (ch >= static_cast<int>(daqCfg.sensorIds.size())) {
-            continue;
-          }
-          if (daqCfg.sensorIds[ch] != sensorId) {
-            continue;  // This channel belongs to a different sensor
-          }
-
-          HitRow hit{};
-
-          // Column: from columnIds mapping
-          if (ch < static_cast<int>(daqCfg.columnIds.size())) {
-            hit.column = static_cast<uint16_t>(daqCfg.columnIds[ch]);
-          } else {
-            hit.column = 1;
-          }
-
-          // Row: from stripIds mapping
-          if (ch < static_cast<int>(daqCfg.stripIds.size())) {
-            hit.row = static_cast<uint16_t>(daqCfg.stripIds[ch]);
-          } else {
-            hit.row = static_cast<uint16_t>(ch);
-          }
-
-          // raw = ampMax (uint8_t clamp)
-          float rawAmp = (ampMax && ch < static_cast<int>(ampMax->size())) ? (*ampMax)[ch] : 0.0f;
-          hit.raw = static_cast<uint8_t>(std::min(255.0f, std::max(0.0f, rawAmp)));
-          // charge = ampMax_Fit_mV
-          hit.charge = (ampMax_Fit_mV && ch < static_cast<int>(ampMax_Fit_mV->size()))
-                           ? static_cast<double>((*ampMax_Fit_mV)[ch]) : 0.0;
-
-          // Timestamp: DUT0-2 = sensor3_timeCFD_Fit_50pc - hit_timeCFD_Fit_50pc
-          //            DUT3   = hit_timeCFD_Fit_50pc (no subtraction)
-          float rawCFD = chHasCFD[ch] ? chCFD[ch] : 0.0f;
-          float finalTimestamp = rawCFD;
-          if (daqCfg.sensorIds[ch] != 3) {
-            auto daqIt = sensor3RefTimes.find(daqCfg.daqName);
-            if (daqIt != sensor3RefTimes.end()) {
-              auto evIt = daqIt->second.find(static_cast<uint32_t>(event));
-              if (evIt != daqIt->second.end()) {
-                finalTimestamp = evIt->second - rawCFD;
-              }
-              // else: sensor3 ref missing for this event — keep rawCFD
-            }
-            // else: no sensor3 in this DAQ — keep rawCFD
-          }
-          hit.timestamp = static_cast<double>(finalTimestamp);
-          hit.trigger_number = static_cast<uint32_t>(event);
-
-          allHits.push_back(hit);
-          if (entry == 0) channelsAdded++;
-        }
+    eventHits.clear();
+    for (auto &cursor : cursors) {
+      int event = 0;
+      while (cursor->Peek(event) && event == nextEvent) {
+        cursor->Take(eventHits);
       }
-
-      fin->Close();
-      std::cout << "  Added " << channelsAdded << " channels from " << daqCfg.daqName << std::endl;
     }
-
-    // Sort hits by trigger_number (event), then by column, then by row
-    // This ensures Corryvreckan reads data event-by-event with all columns interleaved
-    std::cout << "  Sorting " << allHits.size() << " hits by event, column, row..." << std::endl;
-    std::sort(allHits.begin(), allHits.end(), [](const HitRow &a, const HitRow &b) {
-      if (a.trigger_number != b.trigger_number) return a.trigger_number < b.trigger_number;
-      if (a.column != b.column) return a.column < b.column;
-      return a.row < b.row;
+    std::stable_sort(eventHits.begin(), eventHits.end(), [](const SensorHit &a, const SensorHit &b) {
+      if (a.sensorId != b.sensorId) return a.sensorId < b.sensorId;
+      if (a.hit.column != b.hit.column) return a.hit.column < b.hit.column;
+      return a.hit.row < b.hit.row;
     });
 
-    if (allHits.empty()) {
-      std::cerr << "  WARNING: no hits for sensor " << sensorId << ", skipping" << std::endl;
-      continue;
+    for (const SensorHit &entry : eventHits) {
+      HitSink &sink = *sinkBySensor[entry.sensorId];
+      const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&entry.hit);
+      sink.batch.insert(sink.batch.end(), bytes, bytes + sizeof(HitRow));
+      if (++sink.batchRows == chunkRows) {
+        QueueHitBatch(sink, type, chunkRows, storage, writer, encoder.get());
+      }
     }
+  }
+  cursors.clear();
 
-    // Create output HDF5 file for this sensor
-    std::string hdf5File;
-    if (splitBySensor) {
-      hdf5File = outputDir + "/sensor" + std::to_string(sensorId) + "_" + baseOutputName;
-    } else {
-      hdf5File = outputDir + "/" + baseOutputName;
+  // Write the remaining rows, then close the sensor files
+  for (auto &entry : sinks) {
+    QueueHitBatch(entry.second, type, chunkRows, storage, writer, encoder.get());
+  }
+  bool ok = !encoder || encoder->Finish();
+  for (auto &entry : sinks) {
+    HitSink &sink = entry.second;
+    if (sink.rows > 0) {
+      writer.Push([&sink, &calibrationVersions]() {
+        WriteStringAttribute(sink.file, "calibration_version", calibrationVersions);
+        CloseHitSink(sink);
+        return true;
+      });
     }
+  }
+  ok = writer.Finish() && ok;
+  H5Tclose(type);
 
-    // Create output directory if needed
-    size_t lastSlash = hdf5File.find_last_of('/');
-    if (lastSlash != std::string::npos) {
-      std::string dirPath = hdf5File.substr(0, lastSlash);
-      if (!CreateDirectoryIfNeeded(dirPath)) {
-        std::cerr << "ERROR: failed to create output directory: " << dirPath << std::endl;
-        return false;
+  if (!ok) {
+    for (auto &entry : sinks) {
+      CloseHitSink(entry.second);
+      if (entry.second.rows > 0) {
+        std::remove(entry.second.path.c_str());
       }
     }
+    std::cerr << "ERROR: multi-DAQ export failed" << std::endl;
+    return false;
+  }
 
-    hid_t file = H5Fcreate(hdf5File.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
-    if (file < 0) {
-      std::cerr << "ERROR: cannot create HDF5 file " << hdf5File << std::endl;
-      return false;
+  for (int sensorId : uniqueSensorIds) {
+    if (sinkBySensor[sensorId]->rows == 0) {
+      std::cerr << "  WARNING: no hits for sensor " << sensorId << ", skipping" << std::endl;
     }
-
-    hsize_t dim = allHits.size();
-    hid_t space = H5Screate_simple(1, &dim, nullptr);
-    hid_t type = H5Tcreate(H5T_COMPOUND, sizeof(HitRow));
-
-    H5Tinsert(type, "column", HOFFSET(HitRow, column), H5T_NATIVE_UINT16);
-    H5Tinsert(type, "row", HOFFSET(HitRow, row), H5T_NATIVE_UINT16);
-    H5Tinsert(type, "raw", HOFFSET(HitRow, raw), H5T_NATIVE_UINT8);
-    H5Tinsert(type, "charge", HOFFSET(HitRow, charge), H5T_NATIVE_DOUBLE);
-    H5Tinsert(type, "timestamp", HOFFSET(HitRow, timestamp), H5T_NATIVE_DOUBLE);
-    H5Tinsert(type, "trigger_number", HOFFSET(HitRow, trigger_number), H5T_NATIVE_UINT32);
-
-    hid_t dset = H5Dcreate(file, "Hits", type, space,
-                          H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-    if (dset < 0) {
-      std::cerr << "ERROR: cannot create Hits dataset" << std::endl;
-      H5Tclose(type);
-      H5Sclose(space);
-      H5Fclose(file);
-      return false;
+  }
+  for (const auto &entry : sinks) {
+    if (entry.second.rows > 0) {
+      PerfAddBytesWritten(FileSizeBytes(entry.first));
+      std::cout << "  Wrote " << entry.second.rows << " hits to " << entry.first << std::endl;
     }
-
-    H5Dwrite(dset, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, allHits.data());
-
-    H5Dclose(dset);
-    H5Tclose(type);
-    H5Sclose(space);
-    H5Fclose(file);
-
-    std::cout << "  Wrote " << allHits.size() << " hits to " << hdf5File << std::endl;
   }
 
   std::cout << "\nMulti-DAQ export completed successfully" << std::endl;
@@ -1164,12 +2685,18 @@ void PrintUsage(const char *prog) {
             << "  --output-dir DIR    Output directory for HDF5 files (required)\n"
             << "  --output-name NAME  Base output filename (default: 'merged_analysis.h5')\n"
             << "  --split-by-sensor   Split output by sensor (default: true)\n"
+            << "  --no-split-by-sensor  One Hits file for all sensors, ordered by event, sensor,\n"
+            << "                      column and row\n"
+            << "  --threads N         Chunk compression threads (default 0: all cores)\n"
+            << "  --calibration FILE  ADC-to-mV table applied to all DAQs, overriding stored _mV\n"
+            << "                      branches (default: common.calibration_file of each config,\n"
+            << "                      used only where Stage 2 deferred the calibration)\n"
             << "\n"
             << "=== Single-DAQ Mode (Legacy) ===\n"
-            << "  --mode MODE         Export mode: 'raw', 'analysis', or 'corry' (required)\n"
+            << "  --mode MODE         Export mode: 'raw', 'analysis', 'corry' or 'npy' (required)\n"
             << "  --input FILE        Input ROOT file (required)\n"
             << "  --tree NAME         Input tree name (required)\n"
-            << "  --output FILE       Output HDF5 file (required)\n"
+            << "  --output FILE       Output HDF5 file (npy mode: output directory) (required)\n"
             << "  --channels N        Number of channels (default: 16)\n"
             << "  --output-dir DIR    Output directory (default: 'output')\n"
             << "  --sensor-id ID      Export only channels from this sensor ID\n"
@@ -1177,8 +2704,22 @@ void PrintUsage(const char *prog) {
             << "  --use-sensor-mapping BOOL  Enable/disable applying mapping (default: true)\n"
             << "  --corry-only-fields BOOL   If true, store only fields used by Corryvreckan (default: true)\n"
             << "  --column-id ID      Default column value for corry mode (default: 1)\n"
+            << "  --calibration FILE  ADC-to-mV table; _mV columns are computed from raw branches\n"
+            << "  --daq-name NAME     DAQ entry of the calibration table (default: from --sensor-mapping)\n"
+            << "  --layout L          Analysis mode layout: 'compound' (AnalysisFeatures table, default)\n"
+            << "                      'columnar' (one dataset per tree quantity under /Features)\n"
+            << "                      or 'wide' (AnalysisEvents: one row per event, [channels] fields)\n"
+            << "  --shards N          Raw mode: write N event-range shard files in parallel processes,\n"
+            << "                      joined by virtual datasets in the output file (default: 1)\n"
+            << "  --waveforms FILE    Npy mode: also write the raw waveforms of this ROOT file\n"
+            << "                      (waveforms.npy [events, channels, samples])\n"
+            << "  --waveforms-tree T  Tree of --waveforms (default: 'Waveforms')\n"
             << "\n"
             << "=== Common Options ===\n"
+            << "  --compression C     Dataset compression: none, deflate[:1-9], lz4, zstd[:1-22]\n"
+            << "                      (shuffled; lz4/zstd need the HDF5 filter plugin, default: deflate:4)\n"
+            << "  --chunk-rows N      Rows per dataset chunk (default 0: ~1 MiB, whole events)\n"
+            << "  --perf              Time reading/writing and write a .perf.json report next to the output\n"
             << "  -h, --help          Show this help message\n"
             << "\n"
             << "=== Examples ===\n"
@@ -1198,6 +2739,7 @@ int main(int argc, char **argv) {
   std::vector<std::string> configFiles;
   std::string outputName = "merged_analysis.h5";
   bool splitBySensor = true;
+  int threads = 0;  // encoder threads, 0: all cores
 
   // Single-DAQ mode variables (legacy)
   std::string mode;
@@ -1206,6 +2748,8 @@ int main(int argc, char **argv) {
   std::string outputHdf5;
   std::string outputDir;
   std::string sensorMappingFile;
+  std::string calibrationFile;
+  std::string daqName;
   bool useSensorMapping = true;
   bool corryOnlyFields = true;
   int nChannels = 16;
@@ -1214,9 +2758,18 @@ int main(int argc, char **argv) {
   std::vector<int> sensorIds;
   std::vector<int> columnIds;
   std::vector<int> stripIds;
+  std::string analysisLayout = "compound";
+  int shards = 1;
+  std::string waveformsRoot;
+  std::string waveformsTree = "Waveforms";
+  Hdf5StorageOptions storage;
 
   for (int i = 1; i < argc; ++i) {
     std::string arg = argv[i];
+    if (arg == "--perf") {
+      EnablePerf();
+      continue;
+    }
     if (arg == "--help" || arg == "-h") {
       PrintUsage(argv[0]);
       return 0;
@@ -1226,6 +2779,16 @@ int main(int argc, char **argv) {
         return 1;
       }
       configFiles.push_back(argv[++i]);
+    } else if (arg == "--layout") {
+      if (i + 1 >= argc) {
+        std::cerr << "ERROR: --layout requires a value" << std::endl;
+        return 1;
+      }
+      analysisLayout = argv[++i];
+      if (analysisLayout != "compound" && analysisLayout != "columnar" && analysisLayout != "wide") {
+        std::cerr << "ERROR: unknown --layout '" << analysisLayout << "' (compound, columnar, wide)" << std::endl;
+        return 1;
+      }
     } else if (arg == "--output-name") {
       if (i + 1 >= argc) {
         std::cerr << "ERROR: --output-name requires a value" << std::endl;
@@ -1234,6 +2797,8 @@ int main(int argc, char **argv) {
       outputName = argv[++i];
     } else if (arg == "--split-by-sensor") {
       splitBySensor = true;
+    } else if (arg == "--no-split-by-sensor") {
+      splitBySensor = false;
     } else if (arg == "--mode") {
       if (i + 1 >= argc) {
         std::cerr << "ERROR: --mode requires a value" << std::endl;
@@ -1264,6 +2829,65 @@ int main(int argc, char **argv) {
         return 1;
       }
       outputDir = argv[++i];
+    } else if (arg == "--compression") {
+      if (i + 1 >= argc) {
+        std::cerr << "ERROR: --compression requires a value" << std::endl;
+        return 1;
+      }
+      std::string err;
+      if (!ParseHdf5Compression(argv[++i], storage, &err)) {
+        std::cerr << "ERROR: " << err << std::endl;
+        return 1;
+      }
+    } else if (arg == "--chunk-rows") {
+      if (i + 1 >= argc) {
+        std::cerr << "ERROR: --chunk-rows requires a value" << std::endl;
+        return 1;
+      }
+      try {
+        const long long rows = std::stoll(argv[++i]);
+        if (rows < 0) throw std::out_of_range("negative");
+        storage.chunkRows = static_cast<hsize_t>(rows);
+      } catch (...) {
+        std::cerr << "ERROR: invalid number for --chunk-rows" << std::endl;
+        return 1;
+      }
+    } else if (arg == "--threads") {
+      if (i + 1 >= argc) {
+        std::cerr << "ERROR: --threads requires a value" << std::endl;
+        return 1;
+      }
+      try {
+        threads = std::stoi(argv[++i]);
+        if (threads < 0) throw std::out_of_range("negative");
+      } catch (...) {
+        std::cerr << "ERROR: invalid number for --threads" << std::endl;
+        return 1;
+      }
+    } else if (arg == "--shards") {
+      if (i + 1 >= argc) {
+        std::cerr << "ERROR: --shards requires a value" << std::endl;
+        return 1;
+      }
+      try {
+        shards = std::stoi(argv[++i]);
+        if (shards < 1) throw std::out_of_range("below 1");
+      } catch (...) {
+        std::cerr << "ERROR: invalid number for --shards" << std::endl;
+        return 1;
+      }
+    } else if (arg == "--waveforms") {
+      if (i + 1 >= argc) {
+        std::cerr << "ERROR: --waveforms requires a value" << std::endl;
+        return 1;
+      }
+      waveformsRoot = argv[++i];
+    } else if (arg == "--waveforms-tree") {
+      if (i + 1 >= argc) {
+        std::cerr << "ERROR: --waveforms-tree requires a value" << std::endl;
+        return 1;
+      }
+      waveformsTree = argv[++i];
     } else if (arg == "--channels") {
       if (i + 1 >= argc) {
         std::cerr << "ERROR: --channels requires a value" << std::endl;
@@ -1292,6 +2916,18 @@ int main(int argc, char **argv) {
         return 1;
       }
       sensorMappingFile = argv[++i];
+    } else if (arg == "--calibration") {
+      if (i + 1 >= argc) {
+        std::cerr << "ERROR: --calibration requires a value" << std::endl;
+        return 1;
+      }
+      calibrationFile = argv[++i];
+    } else if (arg == "--daq-name") {
+      if (i + 1 >= argc) {
+        std::cerr << "ERROR: --daq-name requires a value" << std::endl;
+        return 1;
+      }
+      daqName = argv[++i];
     } else if (arg == "--column-id") {
       if (i + 1 >= argc) {
         std::cerr << "ERROR: --column-id requires a value" << std::endl;
@@ -1368,6 +3004,12 @@ int main(int argc, char **argv) {
         std::cerr << "ERROR: failed to load config from " << cfgFile << std::endl;
         return 1;
       }
+      const std::string &tableFile = calibrationFile.empty() ? daqCfg.calibrationFile : calibrationFile;
+      if (!tableFile.empty() &&
+          !LoadExportCalibration(tableFile, daqCfg.daqName, daqCfg.nChannels,
+                                 !calibrationFile.empty(), daqCfg.calibration)) {
+        return 1;
+      }
       daqConfigs.push_back(daqCfg);
       std::cout << "Loaded " << daqCfg.daqName << " from " << cfgFile << std::endl;
       std::cout << "  ROOT file: " << daqCfg.rootFilePath << std::endl;
@@ -1375,7 +3017,12 @@ int main(int argc, char **argv) {
     }
 
     // Run multi-DAQ export
-    bool ok = ExportAnalysisFeaturesMultiDAQ(daqConfigs, treeName, outputDir, outputName, splitBySensor);
+    bool ok = ExportAnalysisFeaturesMultiDAQ(daqConfigs, treeName, outputDir, outputName, splitBySensor,
+                                             storage, threads);
+    if (ok) {
+      PerfAddBytesRead(TFile::GetFileBytesRead());
+      WritePerfReport(outputDir + "/export_to_hdf5.perf.json", "export_to_hdf5");
+    }
     return ok ? 0 : 2;
   }
 
@@ -1424,9 +3071,27 @@ int main(int argc, char **argv) {
     stripIdsPtr = &stripIds;
   }
 
+  // Export-time calibration: --calibration forces the table, otherwise the
+  // mapping config's table fills in for _mV branches Stage 2 did not store
+  ExportCalibration calibration;
+  if (mode != "raw") {
+    std::string tableFile = calibrationFile;
+    if (!sensorMappingFile.empty() && (tableFile.empty() || daqName.empty())) {
+      DaqConfig mappingCfg;
+      if (ExtractDaqConfig(sensorMappingFile, mappingCfg, mode, defaultColumnId)) {
+        if (tableFile.empty()) tableFile = mappingCfg.calibrationFile;
+        if (daqName.empty()) daqName = mappingCfg.daqName;
+      }
+    }
+    if (!tableFile.empty() &&
+        !LoadExportCalibration(tableFile, daqName, nChannels, !calibrationFile.empty(), calibration)) {
+      return 1;
+    }
+  }
+
   // Build full paths with directory structure
   std::string inputPath = BuildPath(outputDir, "root", inputRoot);
-  std::string outputPath = BuildPath(outputDir, "hdf5", outputHdf5);
+  std::string outputPath = BuildPath(outputDir, mode == "npy" ? "npy" : "hdf5", outputHdf5);
 
   // Create output directory if needed
   size_t lastSlash = outputPath.find_last_of('/');
@@ -1440,10 +3105,25 @@ int main(int argc, char **argv) {
 
   try {
     bool ok = false;
-    if (mode == "raw") {
-      ok = ExportRawWaveforms(inputPath, treeName, outputPath, nChannels, sensorFilter, sensorIdsPtr);
+    if (mode == "raw" && shards > 1) {
+      ok = ExportRawWaveformShards(inputPath, treeName, outputPath, nChannels, shards, sensorFilter,
+                                   sensorIdsPtr, storage);
+    } else if (mode == "raw") {
+      ok = ExportRawWaveforms(inputPath, treeName, outputPath, nChannels, sensorFilter, sensorIdsPtr,
+                              storage);
+    } else if (mode == "analysis" && analysisLayout == "columnar") {
+      ok = ExportAnalysisColumns(inputPath, treeName, outputPath, nChannels, sensorFilter, sensorIdsPtr, columnIdsPtr,
+                                 stripIdsPtr, &calibration, storage);
+    } else if (mode == "analysis" && analysisLayout == "wide") {
+      ok = ExportAnalysisEvents(inputPath, treeName, outputPath, nChannels, sensorFilter, sensorIdsPtr, columnIdsPtr,
+                                stripIdsPtr, &calibration, storage);
+    } else if (mode == "npy") {
+      const std::string rawPath = waveformsRoot.empty() ? "" : BuildPath(outputDir, "root", waveformsRoot);
+      ok = ExportAnalysisNpy(inputPath, treeName, outputPath, nChannels, sensorFilter, sensorIdsPtr, columnIdsPtr,
+                             stripIdsPtr, &calibration, rawPath, waveformsTree);
     } else if (mode == "analysis") {
-      ok = ExportAnalysisFeatures(inputPath, treeName, outputPath, nChannels, sensorFilter, sensorIdsPtr, columnIdsPtr, stripIdsPtr);
+      ok = ExportAnalysisFeatures(inputPath, treeName, outputPath, nChannels, sensorFilter, sensorIdsPtr, columnIdsPtr, stripIdsPtr,
+                                  false, &calibration, storage);
     } else if (mode == "corry") {
       ok = ExportCorryHits(inputPath,
                            treeName,
@@ -1454,18 +3134,21 @@ int main(int argc, char **argv) {
                            columnIdsPtr,
                            stripIdsPtr,
                            defaultColumnId,
-                           corryOnlyFields);
+                           corryOnlyFields,
+                           &calibration,
+                           storage);
       if (ok && !corryOnlyFields) {
         // Append analysis features for richer files if requested
         bool appended = ExportAnalysisFeatures(
-            inputPath, treeName, outputPath, nChannels, sensorFilter, sensorIdsPtr, columnIdsPtr, stripIdsPtr, true /*append*/);
+            inputPath, treeName, outputPath, nChannels, sensorFilter, sensorIdsPtr, columnIdsPtr, stripIdsPtr, true /*append*/,
+            &calibration, storage);
         if (!appended) {
           std::cerr << "ERROR: failed to append AnalysisFeatures dataset" << std::endl;
           return 1;
         }
       }
     } else {
-      std::cerr << "ERROR: unknown mode '" << mode << "'. Use 'raw', 'analysis', or 'corry'" << std::endl;
+      std::cerr << "ERROR: unknown mode '" << mode << "'. Use 'raw', 'analysis', 'corry' or 'npy'" << std::endl;
       return 1;
     }
 
@@ -1477,5 +3160,10 @@ int main(int argc, char **argv) {
     return 3;
   }
 
+  PerfAddBytesRead(TFile::GetFileBytesRead());
+  if (mode != "npy") {
+    PerfAddBytesWritten(FileSizeBytes(outputPath));  // npy: counted per file
+  }
+  WritePerfReport(PerfReportPath(outputPath), "export_to_hdf5");
   return 0;
 }
@@ -16,13 +16,21 @@
 #include "TStyle.h"
 #include "TROOT.h"
 
+#include "analysis/analysis_tree_layout.h"
 #include "config/analysis_config.h"
 #include "utils/filesystem_utils.h"
+#include "utils/perf_timer.h"
 
 using namespace std;
 
 namespace {
 
+// Sections of the performance report (--perf)
+const PerfSection kPerfGetEntry("GetEntry");
+const PerfSection kPerfFillHistograms("fill_histograms");
+const PerfSection kPerfEventCanvas("event_canvas");
+const PerfSection kPerfSummary("summary_and_write");
+
 std::string to6digits(int n) {
   std::ostringstream oss;
   oss << std::setw(6) << std::setfill('0') << n;
@@ -85,6 +93,39 @@ bool RunFastQA(const AnalysisConfig &cfg) {
   tree->SetBranchAddress("ampMax", &ampMax);
   tree->SetBranchAddress("baseline", &baseline);
 
+  std::vector<bool> *hasSignal = nullptr;
+  if (tree->GetBranch("hasSignal")) {
+    tree->SetBranchAddress("hasSignal", &hasSignal);
+  }
+
+  // CFD timing at the reference threshold (50% if available), read through the
+  // layout-independent reader so both scalar and array trees are supported
+  AnalysisTreeLayout layout = ReadAnalysisTreeLayout(tree, cfg.n_channels());
+  if (!layout.fromMetadata) {
+    layout.cfdThresholds = cfg.cfd_thresholds;
+  }
+  int cfdReference = layout.cfdThresholds.empty() ? 50 : layout.cfdThresholds.front();
+  if (std::find(layout.cfdThresholds.begin(), layout.cfdThresholds.end(), 50) !=
+      layout.cfdThresholds.end()) {
+    cfdReference = 50;
+  }
+  TimingColumnReader timeCFD;
+  if (timeCFD.Bind(tree, layout, "timeCFD", cfdReference)) {
+    std::cout << "Timing branch layout: " << TimingBranchLayoutName(layout.layout)
+              << ", using timeCFD at " << cfdReference << "%" << std::endl;
+  } else {
+    std::cerr << "WARNING: timeCFD_" << cfdReference
+              << "pc not found, skipping CFD timing histograms" << std::endl;
+  }
+
+  // Only the branches bound above are read
+  std::vector<std::string> readBranches = {"event", "nChannels", "sensorID", "sensorCol",
+                                           "sensorRow", "isHorizontal", "ampMax", "baseline",
+                                           "hasSignal"};
+  readBranches.insert(readBranches.end(), timeCFD.BranchNames().begin(),
+                      timeCFD.BranchNames().end());
+  std::cout << "Reading " << ReadOnlyBranches(tree, readBranches) << " branches" << std::endl;
+
   // Create output file
   std::string qualityCheckFileName = BuildOutputPath(outname_base, "quality_check",
                                                      "quality_check.root");
@@ -107,6 +148,7 @@ bool RunFastQA(const AnalysisConfig &cfg) {
   // Create histograms for accumulation across all events
   std::map<int, TH1F*> ampMaxHists;
   std::map<int, TH1F*> baselineHists;
+  std::map<int, TH1F*> timeCFDHists;
 
   int nCh = cfg.n_channels();
   for (int ch = 0; ch < nCh; ++ch) {
@@ -116,6 +158,9 @@ bool RunFastQA(const AnalysisConfig &cfg) {
     baselineHists[ch] = new TH1F(Form("baseline_ch%02d", ch),
                                   Form("Channel %d Baseline;Baseline (ADC);Events", ch),
                                   200, 3400, 3600);
+    timeCFDHists[ch] = new TH1F(Form("timeCFD_%dpc_ch%02d", cfdReference, ch),
+                                Form("Channel %d CFD %d%% Time;Time (ns);Events", ch, cfdReference),
+                                400, -100, 300);
   }
 
   // Process all events
@@ -139,7 +184,10 @@ bool RunFastQA(const AnalysisConfig &cfg) {
                 << " (" << (100 * i / nEntries) << "%)" << std::endl;
     }
 
-    tree->GetEntry(i);
+    {
+      PerfScope scope(kPerfGetEntry);
+      tree->GetEntry(i);
+    }
 
     // Debug: print first event's ampMax values
     if (i == 0) {
@@ -154,16 +202,25 @@ bool RunFastQA(const AnalysisConfig &cfg) {
     }
 
     // Fill histograms
-    for (int ch = 0; ch < nCh; ++ch) {
-      if (ch < static_cast<int>(ampMax->size())) {
-        ampMaxHists[ch]->Fill(ampMax->at(ch));
-      }
-      if (ch < static_cast<int>(baseline->size())) {
-        baselineHists[ch]->Fill(baseline->at(ch));
+    {
+      PerfScope scope(kPerfFillHistograms);
+      for (int ch = 0; ch < nCh; ++ch) {
+        if (ch < static_cast<int>(ampMax->size())) {
+          ampMaxHists[ch]->Fill(ampMax->at(ch));
+        }
+        if (ch < static_cast<int>(baseline->size())) {
+          baselineHists[ch]->Fill(baseline->at(ch));
+        }
+        bool signal = !hasSignal || (ch < static_cast<int>(hasSignal->size()) && hasSignal->at(ch));
+        if (signal && timeCFD.Has(ch)) {
+          timeCFDHists[ch]->Fill(timeCFD.Value(ch));
+        }
       }
     }
 
-    // Create amplitude maps per sensor for this event
+    // Create amplitude maps per sensor for this event (timed until the end
+    // of the iteration)
+    PerfScope canvasScope(kPerfEventCanvas);
     std::map<int, std::vector<int>> sensorChannels;
     std::map<int, int> sensorMinCol, sensorMaxCol, sensorMinStrip, sensorMaxStrip;
     for (int ch = 0; ch < nCh; ++ch) {
@@ -306,6 +363,7 @@ bool RunFastQA(const AnalysisConfig &cfg) {
 
   // Return to main directory
   outputFile->cd();
+  PerfScope summaryScope(kPerfSummary);
 
   std::cout << "Creating summary histograms..." << std::endl;
 
@@ -381,18 +439,26 @@ bool RunFastQA(const AnalysisConfig &cfg) {
   for (int ch = 0; ch < nCh; ++ch) {
     ampMaxHists[ch]->Write();
     baselineHists[ch]->Write();
+    if (timeCFD.IsBound()) {
+      timeCFDHists[ch]->Write();
+    }
   }
 
   // Clean up
   for (auto &pair : ampMaxHists) delete pair.second;
   for (auto &pair : baselineHists) delete pair.second;
+  for (auto &pair : timeCFDHists) delete pair.second;
   delete cAmpMax;
   delete cBaseline;
 
   outputFile->Close();
+  PerfAddEvents(nEntries);
+  PerfAddBytesRead(inputFile->GetBytesRead());
+  PerfAddBytesWritten(FileSizeBytes(qualityCheckFileName));
   inputFile->Close();
 
   std::cout << "Quality check complete. Output written to " << qualityCheckFileName << std::endl;
+  WritePerfReport(PerfReportPath(qualityCheckFileName), "fast_qa");
   return true;
 }
 
@@ -401,6 +467,7 @@ void PrintUsage(const char *prog) {
             << "Usage: " << prog << " [options]\n"
             << "Options:\n"
             << "  --config PATH    Load settings from JSON file\n"
+            << "  --perf           Time the QA stages and write a .perf.json report next to the output\n"
             << "  -h, --help       Show this help message\n";
 }
 
@@ -432,6 +499,8 @@ int main(int argc, char **argv) {
         return 1;
       }
       std::cout << "Loaded configuration from " << argv[i] << std::endl;
+    } else if (arg == "--perf") {
+      EnablePerf();
     } else {
       std::cerr << "ERROR: unknown option " << arg << std::endl;
       PrintUsage(argv[0]);
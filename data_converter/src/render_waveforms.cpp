@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+
+#include "TROOT.h"
+
+#include "analysis/waveform_plot_writer.h"
+#include "analysis/waveform_store.h"
+#include "config/analysis_config.h"
+#include "utils/filesystem_utils.h"
+#include "utils/perf_timer.h"
+
+namespace {
+
+std::string to6digits(int n) {
+  std::ostringstream oss;
+  oss << std::setw(6) << std::setfill('0') << n;
+  return oss.str();
+}
+
+void PrintUsage(const char *prog) {
+  std::cout << "Render waveforms: draw the waveform plots and quality-check canvases\n"
+            << "stored by analyze_waveforms (waveform_plots_format \"store\")\n"
+            << "Usage: " << prog << " [options]\n"
+            << "Options:\n"
+            << "  --config PATH          Load analysis settings from JSON file\n"
+            << "  --store FILE           Waveform store to read\n"
+            << "                         (default: <output_dir>/<run>/<daq>/output/waveform_store/<waveform_plots_dir>.root)\n"
+            << "  --event-range START:END  Render only events in range [START, END) (default: all)\n"
+            << "  --output-name NAME     Base name of the rendered files (default: waveform_plots_dir)\n"
+            << "  --perf                 Time the rendering stages and write a .perf.json report next to the store\n"
+            << "  -h, --help             Show this help message\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  AnalysisConfig cfg;
+
+  // Try to load default config
+  std::string defaultPath = "converter_config.json";
+  std::string err;
+  if (LoadAnalysisConfigFromJson(defaultPath, cfg, &err)) {
+    std::cout << "Loaded configuration from " << defaultPath << std::endl;
+  }
+
+  std::string storePath;
+  std::string outputName;
+  long long eventStart = std::numeric_limits<long long>::min();
+  long long eventEnd = std::numeric_limits<long long>::max();
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--help" || arg == "-h") {
+      PrintUsage(argv[0]);
+      return 0;
+    } else if (arg == "--config") {
+      if (i + 1 >= argc) {
+        std::cerr << "ERROR: --config requires a value" << std::endl;
+        return 1;
+      }
+      if (!LoadAnalysisConfigFromJson(argv[++i], cfg, &err)) {
+        std::cerr << "ERROR: " << err << std::endl;
+        return 1;
+      }
+      std::cout << "Loaded configuration from " << argv[i] << std::endl;
+    } else if (arg == "--store") {
+      if (i + 1 >= argc) {
+        std::cerr << "ERROR: --store requires a value" << std::endl;
+        return 1;
+      }
+      storePath = argv[++i];
+    } else if (arg == "--output-name") {
+      if (i + 1 >= argc) {
+        std::cerr << "ERROR: --output-name requires a value" << std::endl;
+        return 1;
+      }
+      outputName = argv[++i];
+    } else if (arg == "--event-range") {
+      if (i + 1 >= argc) {
+        std::cerr << "ERROR: --event-range requires a value (START:END)" << std::endl;
+        return 1;
+      }
+      std::string range = argv[++i];
+      size_t colonPos = range.find(':');
+      if (colonPos == std::string::npos) {
+        std::cerr << "ERROR: --event-range format must be START:END" << std::endl;
+        return 1;
+      }
+      try {
+        eventStart = std::stoll(range.substr(0, colonPos));
+        eventEnd = std::stoll(range.substr(colonPos + 1));
+      } catch (...) {
+        std::cerr << "ERROR: invalid event range format" << std::endl;
+        return 1;
+      }
+    } else if (arg == "--perf") {
+      EnablePerf();
+    } else {
+      std::cerr << "ERROR: unknown option " << arg << std::endl;
+      PrintUsage(argv[0]);
+      return 1;
+    }
+  }
+
+  std::string outnameBase = cfg.output_dir() + '/';
+  outnameBase += to6digits(cfg.runnumber()) + '/';
+  outnameBase += cfg.daq_name() + "/output/";
+
+  if (storePath.empty()) {
+    storePath = BuildOutputPath(outnameBase, "waveform_store", cfg.waveform_plots_dir + ".root");
+  }
+
+  gROOT->SetBatch(true);
+
+  WaveformStoreReader store;
+  if (!store.Open(storePath)) {
+    return 1;
+  }
+  const long long nEntries = store.Entries();
+  std::cout << "Reading waveform store: " << storePath << " (" << nEntries
+            << " stored events)" << std::endl;
+
+  // Selection and sampling were applied when the store was written
+  AnalysisConfig renderCfg = cfg;
+  renderCfg.waveform_plots_enabled = true;
+  renderCfg.waveform_plots_format = "graphs";
+  renderCfg.waveform_plots_only_signal = false;
+  renderCfg.waveform_plots_signal_events_only = false;
+  renderCfg.waveform_plots_every_n = 1;
+  renderCfg.quality_check_event_every_n = 1;  // canvases for every rendered event
+  if (!outputName.empty()) {
+    renderCfg.waveform_plots_dir = outputName;
+  }
+
+  // The canvases go to a file of their own; the Stage 2 quality_check file
+  // (run-level maps) is left untouched
+  WaveformPlotWriter writer(renderCfg, outnameBase);
+  writer.SetQualityCheckFile(BuildOutputPath(outnameBase, "quality_check",
+                                             renderCfg.waveform_plots_dir + "_quality_check.root"));
+  if (!writer.Start()) {
+    std::cerr << "ERROR: cannot open the plot output files" << std::endl;
+    return 1;
+  }
+
+  long long rendered = 0;
+  auto render = [&](long long entry) {
+    EventPlotRecord record;
+    if (!store.Read(entry, record)) {
+      return false;
+    }
+    writer.Push(std::move(record));
+    ++rendered;
+    return true;
+  };
+  const bool allEvents = eventStart == std::numeric_limits<long long>::min() &&
+                         eventEnd == std::numeric_limits<long long>::max();
+  if (allEvents) {
+    for (long long entry = 0; entry < nEntries; ++entry) {
+      if (!render(entry)) {
+        writer.Finish();
+        return 1;
+      }
+    }
+  } else {
+    // Look the events up in the store's event index
+    const long long first = std::max<long long>(eventStart, std::numeric_limits<int>::min());
+    const long long last = std::min<long long>(eventEnd, std::numeric_limits<int>::max());
+    for (long long event = first; event < last; ++event) {
+      const long long entry = store.EntryOf(static_cast<int>(event));
+      if (entry >= 0 && !render(entry)) {
+        writer.Finish();
+        return 1;
+      }
+    }
+  }
+  writer.Finish();
+  store.Close();
+
+  std::cout << "Rendered " << rendered << " events" << std::endl;
+  PerfAddEvents(rendered);
+  PerfAddBytesRead(FileSizeBytes(storePath));
+  WritePerfReport(PerfReportPath(storePath), "render_waveforms");
+  return 0;
+}
@@ -0,0 +1,149 @@
+#include "utils/hdf5_chunk_encoder.h"
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+
+#include <zlib.h>
+
+#include "utils/perf_timer.h"
+
+bool EncodeHdf5Chunk(const unsigned char *data,
+                     size_t elementSize,
+                     size_t nElements,
+                     const Hdf5StorageOptions &options,
+                     std::vector<unsigned char> &encoded) {
+  const size_t nBytes = elementSize * nElements;
+  if (!options.Compressed()) {
+    encoded.assign(data, data + nBytes);
+    return true;
+  }
+
+  // H5Z shuffle: byte j of every element goes to plane j
+  std::vector<unsigned char> shuffled;
+  if (options.shuffle && elementSize > 1) {
+    shuffled.resize(nBytes);
+    for (size_t i = 0; i < nElements; ++i) {
+      for (size_t j = 0; j < elementSize; ++j) {
+        shuffled[j * nElements + i] = data[i * elementSize + j];
+      }
+    }
+    data = shuffled.data();
+  }
+
+  // H5Z deflate: zlib stream written with compress2
+  uLongf encodedBytes = compressBound(static_cast<uLong>(nBytes));
+  encoded.resize(encodedBytes);
+  const int status = compress2(encoded.data(), &encodedBytes, data, static_cast<uLong>(nBytes),
+                               options.level);
+  if (status != Z_OK) {
+    std::cerr << "ERROR: deflate of a " << nBytes << " byte chunk failed (zlib " << status << ")"
+              << std::endl;
+    return false;
+  }
+  encoded.resize(encodedBytes);
+  return true;
+}
+
+Hdf5ChunkEncoder::Hdf5ChunkEncoder(size_t threads, Hdf5WriteQueue &writer,
+                                   const Hdf5StorageOptions &options)
+    : writer_(writer), options_(options), nThreads_(std::max<size_t>(1, threads)) {}
+
+Hdf5ChunkEncoder::~Hdf5ChunkEncoder() {
+  Finish();
+}
+
+void Hdf5ChunkEncoder::Start() {
+  if (running_) {
+    return;
+  }
+  stopping_ = false;
+  running_ = true;
+  for (size_t i = 0; i < nThreads_; ++i) {
+    threads_.emplace_back(&Hdf5ChunkEncoder::Run, this);
+  }
+}
+
+void Hdf5ChunkEncoder::Submit(const hid_t *dset, hsize_t chunkIndex, hsize_t chunkRows,
+                              hsize_t validRows, size_t rowBytes,
+                              std::vector<unsigned char> rows) {
+  if (!running_) {
+    return;
+  }
+  rows.resize(static_cast<size_t>(chunkRows) * rowBytes, 0);
+  auto job = [this, dset, chunkIndex, chunkRows, validRows, rowBytes,
+              rows = std::move(rows)]() {
+    auto encoded = std::make_shared<std::vector<unsigned char>>();
+    if (!EncodeHdf5Chunk(rows.data(), rowBytes, static_cast<size_t>(chunkRows), options_, *encoded)) {
+      return false;
+    }
+    const hsize_t offset = chunkIndex * chunkRows;
+    writer_.Push([dset, offset, validRows, encoded]() {
+      // Chunks may arrive out of order; the extent only grows
+      hid_t space = H5Dget_space(*dset);
+      hsize_t rows = 0;
+      H5Sget_simple_extent_dims(space, &rows, nullptr);
+      H5Sclose(space);
+      if (offset + validRows > rows) {
+        const hsize_t newRows = offset + validRows;
+        if (H5Dset_extent(*dset, &newRows) < 0) {
+          std::cerr << "ERROR: cannot extend dataset to " << newRows << " rows" << std::endl;
+          return false;
+        }
+      }
+      if (H5Dwrite_chunk(*dset, H5P_DEFAULT, 0, &offset, encoded->size(), encoded->data()) < 0) {
+        std::cerr << "ERROR: H5Dwrite_chunk at row " << offset << " failed" << std::endl;
+        return false;
+      }
+      return true;
+    });
+    return true;
+  };
+
+  static const PerfSection kSubmitSection("hdf5_encode_submit");
+  PerfScope scope(kSubmitSection);
+  std::unique_lock<std::mutex> lock(mutex_);
+  notFull_.wait(lock, [this] { return queue_.size() < 2 * nThreads_; });
+  queue_.push_back(std::move(job));
+  lock.unlock();
+  notEmpty_.notify_one();
+}
+
+void Hdf5ChunkEncoder::Run() {
+  static const PerfSection kEncodeSection("hdf5_encode");
+  while (true) {
+    std::function<bool()> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      notEmpty_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        break;  // stopping and drained
+      }
+      job = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    notFull_.notify_one();
+
+    PerfScope scope(kEncodeSection);
+    if (!job()) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      failed_ = true;
+    }
+  }
+}
+
+bool Hdf5ChunkEncoder::Finish() {
+  if (running_) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    notEmpty_.notify_all();
+    for (auto &thread : threads_) {
+      thread.join();
+    }
+    threads_.clear();
+    running_ = false;
+  }
+  return !failed_;
+}
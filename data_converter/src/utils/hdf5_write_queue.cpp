@@ -0,0 +1,68 @@
+#include "utils/hdf5_write_queue.h"
+
+#include <algorithm>
+
+#include "utils/perf_timer.h"
+
+Hdf5WriteQueue::Hdf5WriteQueue(size_t depth)
+    : capacity_(std::max<size_t>(1, depth)) {}
+
+Hdf5WriteQueue::~Hdf5WriteQueue() {
+  Finish();
+}
+
+void Hdf5WriteQueue::Start() {
+  if (running_) {
+    return;
+  }
+  stopping_ = false;
+  running_ = true;
+  thread_ = std::thread(&Hdf5WriteQueue::Run, this);
+}
+
+void Hdf5WriteQueue::Push(std::function<bool()> job) {
+  if (!running_) {
+    return;
+  }
+  static const PerfSection kPushSection("hdf5_queue_push");
+  PerfScope scope(kPushSection);
+  std::unique_lock<std::mutex> lock(mutex_);
+  notFull_.wait(lock, [this] { return queue_.size() < capacity_; });
+  queue_.push_back(std::move(job));
+  lock.unlock();
+  notEmpty_.notify_one();
+}
+
+void Hdf5WriteQueue::Run() {
+  while (true) {
+    std::function<bool()> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      notEmpty_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        break;  // stopping and drained
+      }
+      job = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    notFull_.notify_one();
+
+    // Keep draining after a failure so Push() never blocks forever
+    if (!failed_ && !job()) {
+      failed_ = true;
+    }
+  }
+}
+
+bool Hdf5WriteQueue::Finish() {
+  if (running_) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    notEmpty_.notify_one();
+    thread_.join();
+    running_ = false;
+  }
+  return !failed_;
+}
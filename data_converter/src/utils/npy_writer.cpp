@@ -0,0 +1,97 @@
+#include "utils/npy_writer.h"
+
+#include <iostream>
+
+namespace {
+
+constexpr size_t kNpyHeaderBytes = 128;  // magic + version + length + padded dict
+constexpr size_t kNpyPreambleBytes = 10;
+
+} // namespace
+
+std::string NpyDescr(char kind, size_t valueBytes) {
+  if (valueBytes == 1) {
+    return std::string("|") + kind + "1";
+  }
+  return std::string("<") + kind + std::to_string(valueBytes);
+}
+
+NpyWriter::~NpyWriter() {
+  if (file_) {
+    std::fclose(file_);
+  }
+}
+
+bool NpyWriter::Open(const std::string &path, const std::string &descr,
+                     const std::vector<size_t> &rowShape, size_t valueBytes) {
+  path_ = path;
+  descr_ = descr;
+  rowShape_ = rowShape;
+  rowBytes_ = valueBytes;
+  for (size_t dim : rowShape_) {
+    rowBytes_ *= dim;
+  }
+  rows_ = 0;
+  file_ = std::fopen(path.c_str(), "wb");
+  if (!file_) {
+    std::cerr << "ERROR: cannot create " << path << std::endl;
+    return false;
+  }
+  return WriteHeader();
+}
+
+bool NpyWriter::WriteHeader() {
+  std::string shape = "(" + std::to_string(rows_);
+  if (rowShape_.empty()) {
+    shape += ",";
+  }
+  for (size_t dim : rowShape_) {
+    shape += ", " + std::to_string(dim);
+  }
+  shape += ")";
+
+  std::string dict = "{'descr': '" + descr_ + "', 'fortran_order': False, 'shape': " + shape + ", }";
+  if (dict.size() + 1 > kNpyHeaderBytes - kNpyPreambleBytes) {
+    std::cerr << "ERROR: .npy header of " << path_ << " does not fit" << std::endl;
+    return false;
+  }
+  dict.resize(kNpyHeaderBytes - kNpyPreambleBytes - 1, ' ');
+  dict += '\n';
+
+  const unsigned short length = static_cast<unsigned short>(dict.size());
+  const unsigned char preamble[kNpyPreambleBytes] = {
+      0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0,
+      static_cast<unsigned char>(length & 0xff), static_cast<unsigned char>(length >> 8)};
+  if (std::fseek(file_, 0, SEEK_SET) != 0 ||
+      std::fwrite(preamble, 1, sizeof(preamble), file_) != sizeof(preamble) ||
+      std::fwrite(dict.data(), 1, dict.size(), file_) != dict.size()) {
+    std::cerr << "ERROR: cannot write .npy header of " << path_ << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool NpyWriter::Append(const void *rows, size_t nRows) {
+  if (!file_) {
+    return false;
+  }
+  if (std::fwrite(rows, rowBytes_, nRows, file_) != nRows) {
+    std::cerr << "ERROR: write to " << path_ << " failed" << std::endl;
+    return false;
+  }
+  rows_ += nRows;
+  return true;
+}
+
+bool NpyWriter::Close() {
+  if (!file_) {
+    return false;
+  }
+  const bool ok = WriteHeader();
+  const bool closed = std::fclose(file_) == 0;
+  file_ = nullptr;
+  if (!closed) {
+    std::cerr << "ERROR: cannot close " << path_ << std::endl;
+  }
+  return ok && closed;
+}
@@ -0,0 +1,201 @@
+#include "utils/perf_timer.h"
+
+#include <sys/resource.h>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#include "utils/filesystem_utils.h"
+
+bool gPerfEnabled = false;
+
+namespace {
+
+struct SectionTotals {
+  std::vector<std::string> names;
+  std::vector<uint64_t> ticks;
+  std::vector<uint64_t> calls;
+};
+
+std::mutex &RegistryMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+// Guarded by RegistryMutex()
+SectionTotals &Registry() {
+  static SectionTotals totals;
+  return totals;
+}
+
+std::atomic<long long> gEvents{0};
+std::atomic<long long> gBytesRead{0};
+std::atomic<long long> gBytesWritten{0};
+uint64_t gStartTicks = 0;
+std::chrono::steady_clock::time_point gStartTime;
+
+// Per-thread counters, added to the registry when the thread exits or the
+// report is written
+struct ThreadCounters {
+  std::vector<uint64_t> ticks;
+  std::vector<uint64_t> calls;
+
+  void MergeInto(SectionTotals &totals) {
+    for (size_t i = 0; i < ticks.size() && i < totals.ticks.size(); ++i) {
+      totals.ticks[i] += ticks[i];
+      totals.calls[i] += calls[i];
+    }
+    ticks.assign(ticks.size(), 0);
+    calls.assign(calls.size(), 0);
+  }
+
+  ~ThreadCounters() {
+    std::lock_guard<std::mutex> lock(RegistryMutex());
+    MergeInto(Registry());
+  }
+};
+
+ThreadCounters &LocalCounters() {
+  thread_local ThreadCounters counters;
+  return counters;
+}
+
+long long PeakRssKiB() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024;  // bytes on macOS
+#else
+  return usage.ru_maxrss;         // KiB on Linux
+#endif
+}
+
+std::string JsonEscape(const std::string &text) {
+  std::string out;
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+    }
+    out += c;
+  }
+  return out;
+}
+
+} // namespace
+
+PerfSection::PerfSection(const char *name) {
+  std::lock_guard<std::mutex> lock(RegistryMutex());
+  SectionTotals &totals = Registry();
+  id_ = static_cast<int>(totals.names.size());
+  totals.names.emplace_back(name);
+  totals.ticks.push_back(0);
+  totals.calls.push_back(0);
+}
+
+void PerfRecord(int section, uint64_t ticks) {
+  ThreadCounters &counters = LocalCounters();
+  if (static_cast<size_t>(section) >= counters.ticks.size()) {
+    counters.ticks.resize(section + 1, 0);
+    counters.calls.resize(section + 1, 0);
+  }
+  counters.ticks[section] += ticks;
+  ++counters.calls[section];
+}
+
+void EnablePerf() {
+  gStartTime = std::chrono::steady_clock::now();
+  gStartTicks = PerfNow();
+  gPerfEnabled = true;
+}
+
+void PerfAddEvents(long long n) {
+  if (gPerfEnabled) {
+    gEvents += n;
+  }
+}
+
+void PerfAddBytesRead(long long n) {
+  if (gPerfEnabled) {
+    gBytesRead += n;
+  }
+}
+
+void PerfAddBytesWritten(long long n) {
+  if (gPerfEnabled) {
+    gBytesWritten += n;
+  }
+}
+
+std::string PerfReportPath(const std::string &outputPath) {
+  const size_t slash = outputPath.find_last_of('/');
+  const size_t dot = outputPath.find_last_of('.');
+  std::string stem = outputPath;
+  if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+    stem = outputPath.substr(0, dot);
+  }
+  return stem + ".perf.json";
+}
+
+bool WritePerfReport(const std::string &path, const std::string &program) {
+  if (!gPerfEnabled) {
+    return true;
+  }
+  const uint64_t endTicks = PerfNow();
+  const double wallSeconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - gStartTime).count();
+  const double ticksPerSecond =
+      (wallSeconds > 0) ? static_cast<double>(endTicks - gStartTicks) / wallSeconds : 1.0;
+
+  SectionTotals totals;
+  {
+    std::lock_guard<std::mutex> lock(RegistryMutex());
+    LocalCounters().MergeInto(Registry());
+    totals = Registry();
+  }
+
+  size_t lastSlash = path.find_last_of('/');
+  if (lastSlash != std::string::npos && !CreateDirectoryIfNeeded(path.substr(0, lastSlash))) {
+    return false;
+  }
+  std::ofstream out(path);
+  if (!out) {
+    std::cerr << "WARNING: cannot write performance report " << path << std::endl;
+    return false;
+  }
+
+  const long long events = gEvents;
+  out << std::fixed << std::setprecision(6);
+  out << "{\n"
+      << "  \"program\": \"" << JsonEscape(program) << "\",\n"
+      << "  \"wall_seconds\": " << wallSeconds << ",\n"
+      << "  \"events\": " << events << ",\n"
+      << "  \"events_per_second\": " << (wallSeconds > 0 ? events / wallSeconds : 0.0) << ",\n"
+      << "  \"bytes_read\": " << gBytesRead.load() << ",\n"
+      << "  \"bytes_written\": " << gBytesWritten.load() << ",\n"
+      << "  \"peak_rss_kib\": " << PeakRssKiB() << ",\n"
+      << "  \"sections\": [";
+  bool first = true;
+  for (size_t i = 0; i < totals.names.size(); ++i) {
+    if (totals.calls[i] == 0) {
+      continue;
+    }
+    const double seconds = totals.ticks[i] / ticksPerSecond;
+    out << (first ? "\n" : ",\n")
+        << "    {\"name\": \"" << JsonEscape(totals.names[i]) << "\", "
+        << "\"seconds\": " << seconds << ", "
+        << "\"calls\": " << totals.calls[i] << ", "
+        << "\"fraction\": " << (wallSeconds > 0 ? seconds / wallSeconds : 0.0) << "}";
+    first = false;
+  }
+  out << "\n  ]\n}\n";
+
+  std::cout << "Performance report written to " << path << std::endl;
+  return true;
+}